@@ -24,55 +24,254 @@
  */
 
 #include "access_tracing.h"
+#include <condition_variable>
+#include <fcntl.h>
+#include <fstream>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 #include "bithacks.h"
+#include "lz_codec.h"
+#include "trace_format.h"
 #include <hdf5.h>
 #include <hdf5_hl.h>
 
 #define PT_CHUNKSIZE (1024*256u)  // 256K records (~6MB)
+#define FLAT_READAHEAD_CHUNKS 4  // flat traces: chunks to madvise ahead of the current one
 
-AccessTraceReader::AccessTraceReader(std::string _fname) : fname(_fname.c_str()) {
-    hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
-    if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
+using namespace tracefmt;
 
-    // Check that the trace finished
-    hid_t fAttr = H5Aopen(fid, "finished", H5P_DEFAULT);
-    uint32_t finished;
-    H5Aread(fAttr, H5T_NATIVE_UINT, &finished);
-    H5Aclose(fAttr);
+/* Decodes one block ahead of the reader. The reader hands it the next block
+ * when it starts a new one, and takes the decoded buffer (swapping it with its
+ * own) when it gets there.
+ */
+struct AccessTraceReader::Prefetcher {
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable cv;
+    uint32_t requested; //block to decode, -1 if none (or if it is being decoded)
+    uint32_t decoding; //-1 if idle
+    uint32_t ready; //block in buf, -1 if none
+    PackedAccessRecord* buf;
+    bool exit;
+};
 
-    if (!finished) panic("Trace file %s unfinished (halted simulation?)", fname.c_str());
-
-    // Populate numRecords & numChildren
-    hsize_t nPackets;
-    hid_t table = H5PTopen(fid, "accs");
-    if (table == H5I_INVALID_HID) panic("Could not open HDF5 packet table");
-    H5PTget_num_packets(table, &nPackets);
-    numRecords = nPackets;
-
-    hid_t ncAttr = H5Aopen(fid, "numChildren", H5P_DEFAULT);
-    H5Aread(ncAttr, H5T_NATIVE_UINT, &numChildren);
-    H5Aclose(ncAttr);
+AccessTraceReader::AccessTraceReader(std::string _fname, bool prefetch) : fname(_fname.c_str()), index(nullptr), numBlocks(0), curBlock(0),
+    prefetcher(nullptr), mapBase(nullptr), mapBytes(0)
+{
+    FileHeader fh;
+    std::ifstream in(fname.c_str(), std::ios_base::in | std::ios_base::binary);
+    in.read((char*)&fh, sizeof(fh));
+    bool hasHeader = in.good();
+    if (hasHeader && memcmp(fh.magic, FILE_MAGIC, sizeof(fh.magic)) == 0) format = TRACE_COMPRESSED;
+    else if (hasHeader && memcmp(fh.magic, FLAT_MAGIC, sizeof(fh.magic)) == 0) format = TRACE_FLAT;
+    else format = TRACE_HDF5;
 
     curFrameRecord = 0;
     cur = 0;
-    max = MIN(PT_CHUNKSIZE, numRecords);
-    buf = max? gm_calloc<PackedAccessRecord>(max) : nullptr;
+    max = 0;
+    buf = nullptr;
+
+    if (format == TRACE_COMPRESSED) {
+        if (!fh.finished) panic("Trace file %s unfinished (halted simulation?)", fname.c_str());
+        numRecords = fh.numRecords;
+        numChildren = fh.numChildren;
+        numBlocks = fh.numBlocks;
+
+        uint32_t maxBlockRecords = 0;
+        if (numBlocks) {
+            index = gm_calloc<IndexEntry>(numBlocks);
+            in.seekg(fh.indexOffset);
+            in.read((char*)index, numBlocks*sizeof(IndexEntry));
+            if (in.fail()) panic("Trace file %s: could not read block index", fname.c_str());
+            uint64_t nextRecord = 0;
+            for (uint32_t b = 0; b < numBlocks; b++) {
+                if (index[b].firstRecord != nextRecord || !index[b].numRecords) panic("Trace file %s: corrupted block index", fname.c_str());
+                nextRecord += index[b].numRecords;
+                maxBlockRecords = MAX(maxBlockRecords, index[b].numRecords);
+            }
+            if (nextRecord != numRecords) panic("Trace file %s: block index has %ld records, header has %ld", fname.c_str(), nextRecord, numRecords);
+        }
+        in.close();
+
+        if (maxBlockRecords) {
+            buf = gm_calloc<PackedAccessRecord>(maxBlockRecords);
+            if (prefetch && numBlocks > 1) {
+                prefetcher = new Prefetcher();
+                prefetcher->requested = 0;
+                prefetcher->decoding = prefetcher->ready = (uint32_t)-1;
+                prefetcher->buf = gm_calloc<PackedAccessRecord>(maxBlockRecords);
+                prefetcher->exit = false;
+                prefetcher->thread = std::thread(&AccessTraceReader::prefetchLoop, this);
+            }
+        }
+    } else if (format == TRACE_FLAT) {
+        in.close();
+        if (!fh.finished) panic("Trace file %s unfinished (halted simulation?)", fname.c_str());
+        numRecords = fh.numRecords;
+        numChildren = fh.numChildren;
+
+        int fd = open(fname.c_str(), O_RDONLY);
+        if (fd < 0) panic("Could not open trace file %s", fname.c_str());
+        struct stat st;
+        if (fstat(fd, &st) != 0) panic("Could not stat trace file %s", fname.c_str());
+        mapBytes = sizeof(FileHeader) + numRecords*sizeof(PackedAccessRecord);
+        if ((uint64_t)st.st_size < mapBytes) panic("Trace file %s truncated: %ld bytes, expected %ld", fname.c_str(), (uint64_t)st.st_size, mapBytes);
+        mapBase = mmap(nullptr, mapBytes, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapBase == MAP_FAILED) panic("Could not map trace file %s", fname.c_str());
+        madvise(mapBase, mapBytes, MADV_SEQUENTIAL);
+    } else {
+        in.close();
+        hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+        if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
+
+        // Check that the trace finished
+        hid_t fAttr = H5Aopen(fid, "finished", H5P_DEFAULT);
+        uint32_t finished;
+        H5Aread(fAttr, H5T_NATIVE_UINT, &finished);
+        H5Aclose(fAttr);
+
+        if (!finished) panic("Trace file %s unfinished (halted simulation?)", fname.c_str());
+
+        // Populate numRecords & numChildren
+        hsize_t nPackets;
+        hid_t table = H5PTopen(fid, "accs");
+        if (table == H5I_INVALID_HID) panic("Could not open HDF5 packet table");
+        H5PTget_num_packets(table, &nPackets);
+        numRecords = nPackets;
+
+        hid_t ncAttr = H5Aopen(fid, "numChildren", H5P_DEFAULT);
+        H5Aread(ncAttr, H5T_NATIVE_UINT, &numChildren);
+        H5Aclose(ncAttr);
+
+        H5PTclose(table);
+        H5Fclose(fid);
 
-    if (max) {
-        H5PTread_packets(table, 0, max, buf);
+        if (numRecords) buf = gm_calloc<PackedAccessRecord>(MIN(PT_CHUNKSIZE, numRecords));
     }
+}
 
-    H5PTclose(table);
-    H5Fclose(fid);
+AccessTraceReader::~AccessTraceReader() {
+    if (prefetcher) {
+        {
+            std::unique_lock<std::mutex> l(prefetcher->lock);
+            prefetcher->exit = true;
+        }
+        prefetcher->cv.notify_all();
+        prefetcher->thread.join();
+        gm_free(prefetcher->buf);
+        delete prefetcher;
+    }
+    if (mapBase) {
+        munmap(mapBase, mapBytes);
+    } else if (buf) {
+        gm_free(buf);
+    }
+    if (index) gm_free(index);
 }
 
-void AccessTraceReader::nextChunk() {
-    assert(cur == max);
-    curFrameRecord += max;
+void AccessTraceReader::loadBlock(uint32_t block, PackedAccessRecord* dst) const {
+    assert(block < numBlocks);
+    const IndexEntry& ie = index[block];
+    BlockHeader bh;
+    std::vector<uint8_t> stored(ie.storedBytes);
+    std::ifstream in(fname.c_str(), std::ios_base::in | std::ios_base::binary);
+    in.seekg(ie.offset);
+    in.read((char*)&bh, sizeof(bh));
+    in.read((char*)stored.data(), stored.size());
+    if (in.fail() || bh.magic != BLOCK_MAGIC || bh.numRecords != ie.numRecords || bh.storedBytes != ie.storedBytes) {
+        panic("Trace file %s: corrupted block %d", fname.c_str(), block);
+    }
 
-    if (curFrameRecord < numRecords) {
-        cur = 0;
-        max = MIN(PT_CHUNKSIZE, numRecords - curFrameRecord);
+    bool ok;
+    if (bh.flags & BLK_LZ) {
+        std::vector<uint8_t> raw(bh.rawBytes);
+        ok = lzDecompress(stored.data(), stored.data() + stored.size(), raw.data(), raw.size()) &&
+             tracefmt::decodeBlock(raw.data(), raw.data() + raw.size(), ie.numRecords, dst);
+    } else {
+        ok = tracefmt::decodeBlock(stored.data(), stored.data() + stored.size(), ie.numRecords, dst);
+    }
+    if (!ok) panic("Trace file %s: could not decode block %d", fname.c_str(), block);
+}
+
+void AccessTraceReader::prefetchLoop() {
+    Prefetcher* pf = prefetcher;
+    std::unique_lock<std::mutex> l(pf->lock);
+    while (true) {
+        pf->cv.wait(l, [pf] {return pf->exit || pf->requested != (uint32_t)-1;});
+        if (pf->exit) break;
+        uint32_t block = pf->decoding = pf->requested;
+        pf->requested = (uint32_t)-1;
+        l.unlock();
+        loadBlock(block, pf->buf);
+        l.lock();
+        pf->decoding = (uint32_t)-1;
+        pf->ready = block;
+        pf->cv.notify_all();
+    }
+}
+
+void AccessTraceReader::readChunk(uint64_t record) {
+    assert(record < numRecords);
+    if (format == TRACE_COMPRESSED) {
+        uint32_t block;
+        if (max && curBlock + 1 < numBlocks && index[curBlock + 1].firstRecord == record) {
+            block = curBlock + 1;  // common case, sequential reads
+        } else {
+            // Binary search for the last block that starts at or before record
+            uint32_t lo = 0;
+            uint32_t hi = numBlocks;
+            while (hi - lo > 1) {
+                uint32_t mid = (lo + hi)/2;
+                if (index[mid].firstRecord <= record) lo = mid;
+                else hi = mid;
+            }
+            block = lo;
+        }
+
+        if (prefetcher) {
+            Prefetcher* pf = prefetcher;
+            std::unique_lock<std::mutex> l(pf->lock);
+            // Wait for the block if it's in flight; any other in-flight block must finish before we reuse pf->buf
+            pf->cv.wait(l, [pf] {return pf->requested == (uint32_t)-1 && pf->decoding == (uint32_t)-1;});
+            if (pf->ready == block) {
+                std::swap(buf, pf->buf);
+            } else {
+                loadBlock(block, buf);
+            }
+            pf->ready = (uint32_t)-1;
+            if (block + 1 < numBlocks) {
+                pf->requested = block + 1;
+                pf->cv.notify_all();
+            }
+        } else {
+            loadBlock(block, buf);
+        }
+        curBlock = block;
+        curFrameRecord = index[block].firstRecord;
+        max = index[block].numRecords;
+    } else if (format == TRACE_FLAT) {
+        curFrameRecord = record;
+        max = MIN(PT_CHUNKSIZE, numRecords - record);
+        PackedAccessRecord* records = (PackedAccessRecord*)(((char*)mapBase) + sizeof(FileHeader));
+        buf = records + record;
+
+        // Ask the kernel to start reading a few chunks ahead
+        uint64_t aheadRecord = record + FLAT_READAHEAD_CHUNKS*PT_CHUNKSIZE;
+        if (aheadRecord < numRecords) {
+            uint64_t pageSize = sysconf(_SC_PAGESIZE);
+            uint64_t start = sizeof(FileHeader) + aheadRecord*sizeof(PackedAccessRecord);
+            uint64_t end = MIN(mapBytes, start + PT_CHUNKSIZE*sizeof(PackedAccessRecord));
+            start &= ~(pageSize - 1);
+            madvise(((char*)mapBase) + start, end - start, MADV_WILLNEED);
+        }
+    } else {
+        curFrameRecord = record;
+        max = MIN(PT_CHUNKSIZE, numRecords - record);
         hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
         if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
         hid_t table = H5PTopen(fid, "accs");
@@ -80,13 +279,62 @@ void AccessTraceReader::nextChunk() {
         H5PTread_packets(table, curFrameRecord, max, buf);
         H5PTclose(table);
         H5Fclose(fid);
+    }
+    cur = record - curFrameRecord;
+}
+
+void AccessTraceReader::nextChunk() {
+    assert(cur == max);
+    assert_msg(curFrameRecord + max < numRecords, "%ld %d %ld", curFrameRecord, max, numRecords);
+    readChunk(curFrameRecord + max);
+}
+
+void AccessTraceReader::seek(uint64_t record) {
+    assert_msg(record <= numRecords, "Seek to record %ld, trace has %ld", record, numRecords);
+    if (record == numRecords) {
+        curFrameRecord = numRecords;
+        cur = max = 0;
+    } else if (max && record >= curFrameRecord && record < curFrameRecord + max) {
+        cur = record - curFrameRecord;
     } else {
-        assert_msg(curFrameRecord == numRecords, "%ld %ld", curFrameRecord, numRecords);  // aaand we're done
+        readChunk(record);
     }
 }
 
 
-AccessTraceWriter::AccessTraceWriter(g_string _fname, uint32_t numChildren) : fname(_fname) {
+static AccessTraceFormat formatFromName(const g_string& fname) {
+    auto endsWith = [&](const char* suffix) {
+        size_t len = strlen(suffix);
+        return fname.size() >= len && fname.compare(fname.size() - len, len, suffix) == 0;
+    };
+    if (endsWith(".h5") || endsWith(".hdf5")) return TRACE_HDF5;
+    else if (endsWith(".raw")) return TRACE_FLAT;
+    else return TRACE_COMPRESSED;
+}
+
+AccessTraceWriter::AccessTraceWriter(g_string _fname, uint32_t _numChildren) : fname(_fname), format(formatFromName(_fname)),
+    numChildren(_numChildren), numRecords(0), fileBytes(0), index(nullptr), numBlocks(0), indexCapacity(0)
+{
+    if (format == TRACE_HDF5) {
+        initHdf5();
+        max = PT_CHUNKSIZE;
+    } else {
+        FileHeader fh = header(false);
+        std::ofstream out(fname.c_str(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+        out.write((const char*)&fh, sizeof(fh));
+        out.close();
+        if (out.fail()) panic("Could not create trace file %s", fname.c_str());
+        fileBytes = sizeof(fh);
+        max = (format == TRACE_COMPRESSED)? BLOCK_RECORDS : PT_CHUNKSIZE;
+    }
+
+    // Initialize buffer
+    buf = gm_calloc<PackedAccessRecord>(max);
+    cur = 0;
+    assert((uint32_t)(((char*) &buf[1]) - ((char*) &buf[0])) == sizeof(PackedAccessRecord));
+}
+
+void AccessTraceWriter::initHdf5() {
     // Create record structure
     hid_t accType = H5Tenum_create(H5T_NATIVE_USHORT);
     uint16_t val;
@@ -143,15 +391,28 @@ AccessTraceWriter::AccessTraceWriter(g_string _fname, uint32_t numChildren) : fn
     H5Aclose(fAttr);
 
     H5Fclose(fid);
+}
 
-    // Initialize buffer
-    buf = gm_calloc<PackedAccessRecord>(PT_CHUNKSIZE);
+void AccessTraceWriter::dump(bool cont) {
+    if (format == TRACE_HDF5) {
+        dumpHdf5(cont);
+    } else {
+        if (cur) {
+            if (format == TRACE_COMPRESSED) writeBlock();
+            else writeFlat();
+        }
+        if (!cont) finish();
+    }
+
+    if (!cont) {
+        gm_free(buf);
+        buf = nullptr;
+        max = 0;
+    }
     cur = 0;
-    max = PT_CHUNKSIZE;
-    assert((uint32_t)(((char*) &buf[1]) - ((char*) &buf[0])) == sizeof(PackedAccessRecord));
 }
 
-void AccessTraceWriter::dump(bool cont) {
+void AccessTraceWriter::dumpHdf5(bool cont) {
     hid_t fid = H5Fopen(fname.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
     if (fid == H5I_INVALID_HID) panic("Could not open HDF5 file %s", fname.c_str());
     hid_t table = H5PTopen(fid, "accs");
@@ -164,13 +425,91 @@ void AccessTraceWriter::dump(bool cont) {
         uint32_t finished = 1;
         H5Awrite(fAttr, H5T_NATIVE_UINT, &finished);
         H5Aclose(fAttr);
-
-        gm_free(buf);
-        buf = nullptr;
-        max = 0;
     }
 
-    cur = 0;
     H5PTclose(table);
     H5Fclose(fid);
 }
+
+/* As with the stats backends, dumps may come from multiple processes, so we
+ * reopen the file on every block write; all writer state is in global memory.
+ */
+void AccessTraceWriter::writeBlock() {
+    std::vector<uint8_t> raw;
+    raw.reserve(cur*8);
+    encodeBlock(buf, cur, raw);
+
+    std::vector<uint8_t> lz;
+    lz.reserve(raw.size());
+    lzCompress(raw.data(), raw.size(), lz);
+    bool useLz = lz.size() < raw.size();
+    const std::vector<uint8_t>& payload = useLz? lz : raw;
+
+    BlockHeader bh = {BLOCK_MAGIC, cur, (uint32_t)raw.size(), (uint32_t)payload.size(), useLz? (uint32_t)BLK_LZ : 0u, 0};
+    std::ofstream out(fname.c_str(), std::ios_base::out | std::ios_base::app | std::ios_base::binary);
+    out.write((const char*)&bh, sizeof(bh));
+    out.write((const char*)payload.data(), payload.size());
+    out.close();
+    if (out.fail()) panic("Could not write trace file %s", fname.c_str());
+
+    uint64_t minCycle = buf[0].reqCycle;
+    uint64_t maxCycle = buf[0].reqCycle;
+    for (uint32_t i = 1; i < cur; i++) {
+        minCycle = MIN(minCycle, buf[i].reqCycle);
+        maxCycle = MAX(maxCycle, buf[i].reqCycle);
+    }
+
+    if (numBlocks == indexCapacity) {
+        indexCapacity = MAX(16u, 2*indexCapacity);
+        IndexEntry* newIndex = gm_calloc<IndexEntry>(indexCapacity);
+        if (index) {
+            memcpy(newIndex, index, numBlocks*sizeof(IndexEntry));
+            gm_free(index);
+        }
+        index = newIndex;
+    }
+    index[numBlocks++] = {fileBytes, numRecords, minCycle, maxCycle, cur, (uint32_t)payload.size()};
+
+    fileBytes += sizeof(bh) + payload.size();
+    numRecords += cur;
+}
+
+void AccessTraceWriter::writeFlat() {
+    std::ofstream out(fname.c_str(), std::ios_base::out | std::ios_base::app | std::ios_base::binary);
+    out.write((const char*)buf, cur*sizeof(PackedAccessRecord));
+    out.close();
+    if (out.fail()) panic("Could not write trace file %s", fname.c_str());
+    fileBytes += cur*sizeof(PackedAccessRecord);
+    numRecords += cur;
+}
+
+tracefmt::FileHeader AccessTraceWriter::header(bool finished) const {
+    FileHeader fh;
+    memset(&fh, 0, sizeof(fh));
+    memcpy(fh.magic, (format == TRACE_COMPRESSED)? FILE_MAGIC : FLAT_MAGIC, sizeof(fh.magic));
+    fh.numChildren = numChildren;
+    fh.finished = finished;
+    fh.numRecords = numRecords;
+    if (format == TRACE_COMPRESSED) {
+        fh.indexOffset = finished? fileBytes : 0;
+        fh.numBlocks = numBlocks;
+        fh.blockRecords = BLOCK_RECORDS;
+    }
+    return fh;
+}
+
+void AccessTraceWriter::finish() {
+    FileHeader fh = header(true);
+
+    std::fstream out(fname.c_str(), std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+    out.seekp(fileBytes);
+    if (numBlocks) out.write((const char*)index, numBlocks*sizeof(IndexEntry));
+    out.seekp(0);
+    out.write((const char*)&fh, sizeof(fh));
+    out.close();
+    if (out.fail()) panic("Could not finish trace file %s", fname.c_str());
+
+    if (index) gm_free(index);
+    index = nullptr;
+    numBlocks = indexCapacity = 0;
+}
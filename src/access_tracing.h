@@ -29,7 +29,21 @@
 #include "g_std/g_string.h"
 #include "memory_hierarchy.h"
 
-/* HDF5-based classes read and write address traces in a consistent format */
+/* Classes to read and write address traces. Traces are written in one of
+ * three formats, picked by the file name:
+ *  - .h5 or .hdf5: the older HDF5 format
+ *  - .raw: flat, uncompressed records (see trace_format.h). Large, but the
+ *    reader maps the file and hands out records without copying them.
+ *  - anything else: the compressed, block-based format in trace_format.h
+ * The reader detects the format from the file contents.
+ */
+
+namespace tracefmt {
+struct FileHeader;
+struct IndexEntry;
+};
+
+enum AccessTraceFormat {TRACE_HDF5, TRACE_COMPRESSED, TRACE_FLAT};
 
 struct AccessRecord {
     Address lineAddr;
@@ -48,6 +62,12 @@ struct PackedAccessRecord {
 } /*__attribute__((packed))*/;  // 24 bytes --> no packing needed
 
 
+/* Chunks are loaded lazily, when the first record of each chunk is read. The
+ * reader maps flat traces, so they are never copied; for compressed traces,
+ * prefetch = true decodes the next block in a background thread while the
+ * current one is consumed. This uses a regular thread, so only standalone
+ * tools should ask for it, not the pintool.
+ */
 class AccessTraceReader {
     private:
         PackedAccessRecord* buf;
@@ -58,24 +78,50 @@ class AccessTraceReader {
         uint64_t curFrameRecord;
         uint64_t numRecords;
         uint32_t numChildren; //i.e., how many parallel streams does this file contain?
+        AccessTraceFormat format;
+
+        // Compressed traces only; a chunk is a block
+        tracefmt::IndexEntry* index;
+        uint32_t numBlocks;
+        uint32_t curBlock;
+        struct Prefetcher;
+        Prefetcher* prefetcher; //nullptr unless prefetching
+
+        // Flat traces only; buf points into the mapping
+        void* mapBase;
+        size_t mapBytes;
 
     public:
-        AccessTraceReader(std::string fname);
+        explicit AccessTraceReader(std::string fname, bool prefetch = false);
+        ~AccessTraceReader();
 
-        inline bool empty() const {return (cur == max);}
+        inline bool empty() const {return curFrameRecord + cur == numRecords;}
         uint32_t getNumChildren() const {return numChildren;}
         uint64_t getNumRecords() const {return numRecords;}
+        AccessTraceFormat getFormat() const {return format;}
 
-        inline AccessRecord read() {
-            assert(cur < max);
-            PackedAccessRecord& pr = buf[cur++];
-            AccessRecord rec = {pr.lineAddr, pr.reqCycle, pr.latency, pr.childId, (AccessType) pr.type};
+        // The next read will return the given record (or the reader will be empty if record == getNumRecords())
+        void seek(uint64_t record);
+
+        // Zero-copy read. The record stays valid until the next read or seek
+        // (flat traces: until the reader is destroyed).
+        inline const PackedAccessRecord* readPacked() {
             if (unlikely(cur == max)) nextChunk();
+            assert(cur < max);
+            return &buf[cur++];
+        }
+
+        inline AccessRecord read() {
+            const PackedAccessRecord* pr = readPacked();
+            AccessRecord rec = {pr->lineAddr, pr->reqCycle, pr->latency, pr->childId, (AccessType) pr->type};
             return rec;
         }
 
     private:
         void nextChunk();
+        void readChunk(uint64_t record); //loads the chunk that contains record
+        void loadBlock(uint32_t block, PackedAccessRecord* dst) const;
+        void prefetchLoop();
 };
 
 class AccessTraceWriter : public GlobAlloc {
@@ -85,6 +131,16 @@ class AccessTraceWriter : public GlobAlloc {
         uint32_t max;
         g_string fname;
 
+        AccessTraceFormat format;
+
+        // Compressed and flat traces only
+        uint32_t numChildren;
+        uint64_t numRecords;
+        uint64_t fileBytes; //where the next block goes
+        tracefmt::IndexEntry* index; //compressed traces only
+        uint32_t numBlocks;
+        uint32_t indexCapacity;
+
     public:
         AccessTraceWriter(g_string fname, uint32_t numChildren);
 
@@ -97,6 +153,14 @@ class AccessTraceWriter : public GlobAlloc {
         }
 
         void dump(bool cont);
+
+    private:
+        void initHdf5();
+        void dumpHdf5(bool cont);
+        void writeBlock();
+        void writeFlat();
+        tracefmt::FileHeader header(bool finished) const;
+        void finish();
 };
 
 #endif  // _ACCESS_TRACING_H
@@ -31,6 +31,13 @@
  *
  * PARALLELISM CONTROL: The barrier limits the number of threads that run at the same time.
  *
+ * WAITING: Waiting threads first spin on their (padded) futex word for an
+ * adaptive number of iterations, and only sleep on the futex if they are not
+ * woken up by then; wakers only issue a FUTEX_WAKE syscall if the thread went
+ * to sleep. Each thread doubles its spin budget whenever spinning pays off, and
+ * halves it whenever it ends up sleeping, so threads that typically wait long
+ * (e.g., with more threads than parallelThreads) do not burn host cores.
+ *
  * Author: Daniel Sanchez <sanchezd@stanford.edu>
  * Date: Apr 2011
  */
@@ -44,11 +51,15 @@
 #include <syscall.h>
 #include <time.h>
 #include <unistd.h>
+#include "bithacks.h"
 #include "constants.h"
 #include "galloc.h"
 #include "locks.h"
 #include "log.h"
 #include "mtrand.h"
+#include "pad.h"
+#include "profile_stats.h"
+#include "stats.h"
 
 // Configure futex timeouts (die rather than deadlock)
 #define TIMEOUT_LENGTH 20 //seconds
@@ -57,6 +68,13 @@
 //#define DEBUG_BARRIER(args...) info(args)
 #define DEBUG_BARRIER(args...)
 
+// Spin-then-futex waiting (spin budgets are in pause iterations)
+#define BARRIER_MIN_SPIN 64
+#define BARRIER_INIT_SPIN 1024
+#define BARRIER_MAX_SPIN (1 << 16)
+
+#define BARRIER_WAIT_BUCKETS 12  // log2 buckets of wait time, in us
+
 class Callee {
     public:
         virtual void callback() = 0;
@@ -69,11 +87,23 @@ class Barrier : public GlobAlloc {
 
         enum State {OFFLINE, WAITING, RUNNING, LEFT};
 
+        // Futex word values
+        enum {FW_WOKEN = 0, FW_SPINNING = 1, FW_SLEEPING = 2};
+
         struct ThreadSyncInfo {
             volatile State state;
             volatile uint32_t futexWord;
             uint32_t lastIdx;
-            uint32_t pad;
+            uint32_t spinBudget;
+
+            // Stats, only written by the owning thread
+            uint64_t waitNs;
+            uint64_t spinWakeups;
+            uint64_t futexSleeps;
+            uint64_t waitHist[BARRIER_WAIT_BUCKETS];
+
+            // Pad to whole cache lines so that threads spinning on their futexWords do not share lines
+            PAD_SZ(4*sizeof(uint32_t) + (3 + BARRIER_WAIT_BUCKETS)*sizeof(uint64_t));
         };
 
         ThreadSyncInfo threadList[MAX_THREADS];
@@ -101,11 +131,19 @@ class Barrier : public GlobAlloc {
         MTRand rnd;
         Callee* sched; //FIXME: I don't like this organization, but don't have time to refactor the barrier code, this is used for a callback when the phase is done
 
+        ClockStat profEndPhase; //time in the serialized end-of-phase section
+
     public:
         Barrier(uint32_t _parallelThreads, Callee* _sched) : parallelThreads(_parallelThreads), rnd(0xBA77137), sched(_sched) {
+            static_assert((sizeof(ThreadSyncInfo) % CACHE_LINE_BYTES) == 0, "ThreadSyncInfo must be padded to whole cache lines");
             for (uint32_t t = 0; t < MAX_THREADS; t++) {
                 threadList[t].state = OFFLINE;
-                threadList[t].futexWord = 0;
+                threadList[t].futexWord = FW_WOKEN;
+                threadList[t].spinBudget = BARRIER_INIT_SPIN;
+                threadList[t].waitNs = 0;
+                threadList[t].spinWakeups = 0;
+                threadList[t].futexSleeps = 0;
+                for (uint32_t b = 0; b < BARRIER_WAIT_BUCKETS; b++) threadList[t].waitHist[b] = 0;
             }
 
             runList = gm_calloc<uint32_t>(MAX_THREADS);
@@ -120,6 +158,32 @@ class Barrier : public GlobAlloc {
 
         ~Barrier() {}
 
+        void initStats(AggregateStat* parentStat) {
+            AggregateStat* barStats = new AggregateStat();
+            barStats->init("bar", "Phase barrier stats");
+
+            auto waitNsStat = makeLambdaStat([this]() { return sumThreads(&ThreadSyncInfo::waitNs); });
+            waitNsStat->init("waitNs", "Time threads spent waiting in the barrier (ns, summed over threads)");
+            auto spinStat = makeLambdaStat([this]() { return sumThreads(&ThreadSyncInfo::spinWakeups); });
+            spinStat->init("spinWakeups", "Waits that ended while spinning");
+            auto sleepStat = makeLambdaStat([this]() { return sumThreads(&ThreadSyncInfo::futexSleeps); });
+            sleepStat->init("futexSleeps", "Waits that ended sleeping on the futex");
+            auto histStat = makeLambdaVectorStat([this](uint32_t b) {
+                    uint64_t res = 0;
+                    for (uint32_t t = 0; t < MAX_THREADS; t++) res += threadList[t].waitHist[b];
+                    return res;
+                }, BARRIER_WAIT_BUCKETS);
+            histStat->init("waitHist", "Barrier wait time histogram (bucket i > 0 counts [2^(i-1), 2^i) us)");
+            profEndPhase.init("eopTime", "Time in the serialized end-of-phase section (ns)");
+
+            barStats->append(waitNsStat);
+            barStats->append(spinStat);
+            barStats->append(sleepStat);
+            barStats->append(histStat);
+            barStats->append(&profEndPhase);
+            parentStat->append(barStats);
+        }
+
         //Called with schedLock held; returns with schedLock unheld
         void join(uint32_t tid, lock_t* schedLock) {
             DEBUG_BARRIER("[%d] Joining, runningThreads %d, prevState %d", tid, runningThreads, threadList[tid].state);
@@ -147,18 +211,13 @@ class Barrier : public GlobAlloc {
 
 
             threadList[tid].state = WAITING;
-            threadList[tid].futexWord = 1;
+            threadList[tid].futexWord = FW_SPINNING;
             tryWakeNext(tid); //NOTE: You can't cause a phase to end here.
             futex_unlock(schedLock);
 
             if (threadList[tid].state == WAITING) {
                 DEBUG_BARRIER("[%d] Waiting on join", tid);
-                while (true) {
-                    int futex_res = syscall(SYS_futex, &threadList[tid].futexWord, FUTEX_WAIT, 1 /*a racing thread waking us up will change value to 0, and we won't block*/, nullptr, nullptr, 0);
-                    if (futex_res == 0 || threadList[tid].futexWord != 1) break;
-                }
-                //The thread that wakes us up changes this
-                assert(threadList[tid].state == RUNNING);
+                waitForWakeup(tid);
             }
         }
 
@@ -181,23 +240,68 @@ class Barrier : public GlobAlloc {
         void sync(uint32_t tid, lock_t* schedLock) {
             DEBUG_BARRIER("[%d] Sync", tid);
             assert_msg(threadList[tid].state == RUNNING, "[%d] sync: state was supposed to be %d, it is %d", tid, RUNNING, threadList[tid].state);
-            threadList[tid].futexWord = 1;
+            threadList[tid].futexWord = FW_SPINNING;
             threadList[tid].state = WAITING;
             runningThreads--;
             tryWakeNext(tid); //can trigger phase end
             futex_unlock(schedLock);
 
             if (threadList[tid].state == WAITING) {
-                while (true) {
-                    int futex_res = syscall(SYS_futex, &threadList[tid].futexWord, FUTEX_WAIT, 1 /*a racing thread waking us up will change value to 0, and we won't block*/, nullptr, nullptr, 0);
-                    if (futex_res == 0 || threadList[tid].futexWord != 1) break;
-                }
-                //The thread that wakes us up changes this
-                assert(threadList[tid].state == RUNNING);
+                waitForWakeup(tid);
             }
         }
 
     private:
+        //Called without schedLock held
+        void waitForWakeup(uint32_t tid) {
+            ThreadSyncInfo& ti = threadList[tid];
+            uint64_t startNs = getNs();
+
+            uint32_t spins = 0;
+            while (ti.futexWord == FW_SPINNING && spins < ti.spinBudget) {
+                __asm__ __volatile__("pause");
+                spins++;
+            }
+
+            if (ti.futexWord != FW_SPINNING) {
+                //Woken up while spinning (or before we even started)
+                ti.spinWakeups++;
+                ti.spinBudget = MIN(2*ti.spinBudget, (uint32_t)BARRIER_MAX_SPIN);
+            } else if (__sync_bool_compare_and_swap(&ti.futexWord, FW_SPINNING, FW_SLEEPING)) {
+                //The waker sees FW_SLEEPING and will issue a FUTEX_WAKE
+                while (ti.futexWord != FW_WOKEN) {
+                    int futex_res = syscall(SYS_futex, &ti.futexWord, FUTEX_WAIT, FW_SLEEPING /*if the waker already changed it, we won't block*/, nullptr, nullptr, 0);
+                    if (futex_res != 0 && errno != EAGAIN && errno != EINTR) panic("[%d] Barrier futex wait failed, errno %d", tid, errno);
+                }
+                ti.futexSleeps++;
+                ti.spinBudget = MAX(ti.spinBudget/2, (uint32_t)BARRIER_MIN_SPIN);
+            } else {
+                //Woken up right as we were about to sleep
+                ti.spinWakeups++;
+            }
+
+            //The thread that wakes us up changes this
+            assert(ti.state == RUNNING);
+
+            uint64_t waitNs = getNs() - startNs;
+            ti.waitNs += waitNs;
+            uint32_t bucket = (waitNs >= 1000)? ilog2(waitNs/1000) + 1 : 0;
+            ti.waitHist[MIN(bucket, (uint32_t)BARRIER_WAIT_BUCKETS - 1)]++;
+        }
+
+        //Called with schedLock held
+        inline void wakeThread(uint32_t tid, uint32_t wtid) {
+            uint32_t prev = __sync_lock_test_and_set(&threadList[wtid].futexWord, FW_WOKEN);
+            if (prev == FW_WOKEN) panic("Wakeup race in barrier?");
+            if (prev == FW_SLEEPING) syscall(SYS_futex, &threadList[wtid].futexWord, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+        }
+
+        uint64_t sumThreads(uint64_t ThreadSyncInfo::* field) const {
+            uint64_t res = 0;
+            for (uint32_t t = 0; t < MAX_THREADS; t++) res += threadList[t].*field;
+            return res;
+        }
+
         inline void checkEndPhase(uint32_t tid) {
             if (curThreadIdx == runListSize && runningThreads == 0) {
                 if (leftThreads == runListSize) {
@@ -206,7 +310,9 @@ class Barrier : public GlobAlloc {
                 }
                 DEBUG_BARRIER("[%d] Phase ended", tid);
                 // End of phase actions
+                profEndPhase.start();
                 sched->callback();
+                profEndPhase.end();
                 curThreadIdx = 0; //rewind list
 
                 if (((phaseCount++) & (32-1)) == 0) { //one out of 32 times, do
@@ -262,9 +368,7 @@ class Barrier : public GlobAlloc {
                     DEBUG_BARRIER("[%d] Waking %d runningThreads %d", tid, wtid, runningThreads);
                     threadList[wtid].state = RUNNING; //must be set before writing to futexWord to avoid wakeup race
                     threadList[wtid].lastIdx = idx;
-                    bool succ = __sync_bool_compare_and_swap(&threadList[wtid].futexWord, 1, 0);
-                    if (!succ) panic("Wakeup race in barrier?");
-                    syscall(SYS_futex, &threadList[wtid].futexWord, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+                    wakeThread(tid, wtid);
                     runningThreads++;
                 } else {
                     DEBUG_BARRIER("[%d] Skipping %d state %d", tid, wtid, threadList[wtid].state);
@@ -213,51 +213,51 @@ void Cache::updateFTMStats(MemReq& req){
 
    //info("Updating FTM Stats");
 
-   cc->incrementFirstTimeMiss(); 
+   cc->incrementFirstTimeMiss(req.srcId); 
 
    if ( req.flags & (1 << 9)) {
-      cc->incrementIcacheFirstTimeMiss();
+      cc->incrementIcacheFirstTimeMiss(req.srcId);
    }
    if ( req.flags & (1 << 10)) {
-      cc->incrementDcacheFirstTimeMiss();
+      cc->incrementDcacheFirstTimeMiss(req.srcId);
    }
    if ( req.flags & (1 << 8)) {
-      cc->incrementRXPFirstTimeMiss();
+      cc->incrementRXPFirstTimeMiss(req.srcId);
    }
    if ( req.flags & (1 << 11)) {
-      cc->incrementRPFirstTimeMiss();
+      cc->incrementRPFirstTimeMiss(req.srcId);
    }
    if ( req.flags & (1 << 7)) {
-      cc->incrementRWPFirstTimeMiss();
+      cc->incrementRWPFirstTimeMiss(req.srcId);
      // info ("FTM misses on RWP %lx\n", req.lineAddr << 6);
      // while (true);
    }
    if ( req.flags & (1 << 12)) {
-      cc->incrementRWXPFirstTimeMiss();
+      cc->incrementRWXPFirstTimeMiss(req.srcId);
    }
    if ( req.flags & (1 << 13)) {
-      cc->incrementBinaryFirstTimeMiss();
+      cc->incrementBinaryFirstTimeMiss(req.srcId);
    }
    if ( req.flags & (1 << 14)) {
-      cc->incrementHeapFirstTimeMiss();
+      cc->incrementHeapFirstTimeMiss(req.srcId);
    }
    if ( req.flags & (1 << 15)) {
-      cc->incrementSLFirstTimeMiss();
+      cc->incrementSLFirstTimeMiss(req.srcId);
    }
    if ( req.flags & (1 << 16)) {
-      cc->incrementMMAPFirstTimeMiss();
+      cc->incrementMMAPFirstTimeMiss(req.srcId);
    }
    if ( req.flags & (1 << 17)) {
-      cc->incrementSTACKFirstTimeMiss();
+      cc->incrementSTACKFirstTimeMiss(req.srcId);
    }
    if ( req.flags & (1 << 18)) {
-      cc->incrementVVARFirstTimeMiss();
+      cc->incrementVVARFirstTimeMiss(req.srcId);
    }
    if ( req.flags & (1 << 19)) {
-      cc->incrementVDSOFirstTimeMiss();
+      cc->incrementVDSOFirstTimeMiss(req.srcId);
    }
    if ( req.flags & (1 << 20)) {
-      cc->incrementVSYSCALLFirstTimeMiss();
+      cc->incrementVSYSCALLFirstTimeMiss(req.srcId);
    }
 
    return;
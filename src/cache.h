@@ -65,6 +65,10 @@ class Cache : public BaseCache {
         void setChildren(const g_vector<BaseCache*>& children, Network* network);
         void initStats(AggregateStat* parentStat);
 
+        uint64_t getCoherenceEvents() const {return cc->getCoherenceEvents();}
+        uint64_t getFills() const {return cc->getFills();}
+        void setRemoteParents(const g_vector<uint8_t>& remote) {cc->setRemoteParents(remote);}
+
         virtual uint64_t access(MemReq& req);
         virtual uint64_t accessSkew(MemReq& req);
 
@@ -35,9 +35,10 @@ SetAssocArray::SetAssocArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _r
     numSets = numLines/assoc;
     setMask = numSets - 1;
     assert_msg(isPow2(numSets), "must have a power of 2 # sets, but you specified %d", numSets);
-    partitionSetCount = numSets/(zinfo->numCores); 
+    uint32_t partitions = MAX(zinfo->numCores, 1u); //trace-driven runs have no cores
+    partitionSetCount = numSets/partitions;
     partitionMask = partitionSetCount - 1; 
-    partitionAssoc = assoc/(zinfo->numCores); 
+    partitionAssoc = assoc/partitions;
     if (partitionAssoc == 0) partitionAssoc=1;
 }
 
@@ -262,7 +263,11 @@ ZArray::ZArray(uint32_t _numLines, uint32_t _ways, uint32_t _candidates, ReplPol
     for (uint32_t i = 0; i < numLines; i++) {
         lookupArray[i] = i;  // start with a linear mapping; with swaps, it'll get progressively scrambled
     }
+    posArray = gm_calloc<uint32_t>(numLines*ways);
     swapArray = gm_calloc<uint32_t>(cands/ways + 2);  // conservative upper bound (tight within 2 ways)
+    walkArray = gm_calloc<ZWalkInfo>(cands + ways);  // extra ways entries to avoid checking on every expansion
+    insertPos = gm_calloc<uint32_t>(ways);
+    insertAddr = 0;
 }
 
 void ZArray::initStats(AggregateStat* parentStat) {
@@ -270,6 +275,10 @@ void ZArray::initStats(AggregateStat* parentStat) {
     objStats->init("array", "ZArray stats");
     statSwaps.init("swaps", "Block swaps in replacement process");
     objStats->append(&statSwaps);
+    statHashesSaved.init("hashesSaved", "Hash computations avoided by the position cache in replacement walks");
+    objStats->append(&statHashesSaved);
+    statWalkDepth.init("walkDepth", "Replacement walks by number of levels expanded", cands/ways + 2);
+    objStats->append(&statWalkDepth);
     parentStat->append(objStats);
 }
 
@@ -294,7 +303,7 @@ int32_t ZArray::lookup(const Address lineAddr, const MemReq* req, bool updateRep
 }
 
 uint32_t ZArray::preinsert(const Address lineAddr, const MemReq* req, Address* wbLineAddr) {
-    ZWalkInfo candidates[cands + ways]; //extra ways entries to avoid checking on every expansion
+    ZWalkInfo* candidates = walkArray;
 
     bool all_valid = true;
     uint32_t fringeStart = 0;
@@ -302,10 +311,12 @@ uint32_t ZArray::preinsert(const Address lineAddr, const MemReq* req, Address* w
 
     //info("Replacement for incoming 0x%lx", lineAddr);
 
-    //Seeds
+    //Seeds (the only hashes we compute; postinsert() reuses them)
+    insertAddr = lineAddr;
     for (uint32_t w = 0; w < ways; w++) {
         uint32_t pos = w*numSets + (hf->hash(w, lineAddr) & setMask);
         uint32_t lineId = lookupArray[pos];
+        insertPos[w] = pos;
         candidates[w].set(pos, lineId, -1);
         all_valid &= (array[lineId] != 0);
         //info("Seed Candidate %d addr 0x%lx pos %d lineId %d", w, array[lineId], pos, lineId);
@@ -314,11 +325,10 @@ uint32_t ZArray::preinsert(const Address lineAddr, const MemReq* req, Address* w
     //Expand fringe in BFS fashion
     while (numCandidates < cands && all_valid) {
         uint32_t fringeId = candidates[fringeStart].lineId;
-        Address fringeAddr = array[fringeId];
-        assert(fringeAddr);
+        assert(array[fringeId]);
+        const uint32_t* fringePos = &posArray[fringeId*ways];
         for (uint32_t w = 0; w < ways; w++) {
-            uint32_t hval = hf->hash(w, fringeAddr) & setMask;
-            uint32_t pos = w*numSets + hval;
+            uint32_t pos = fringePos[w];
             uint32_t lineId = lookupArray[pos];
 
             // Logically, you want to do this...
@@ -342,6 +352,11 @@ uint32_t ZArray::preinsert(const Address lineAddr, const MemReq* req, Address* w
     assert(!all_valid || numCandidates >= cands);
     numCandidates = (numCandidates > cands)? cands : numCandidates;
 
+    statHashesSaved.inc(fringeStart*ways);
+    uint32_t depth = 0;
+    for (int32_t idx = candidates[numCandidates-1].parentIdx; idx >= 0; idx = candidates[idx].parentIdx) depth++;
+    statWalkDepth.inc(depth);
+
     //info("Using %d candidates, all_valid=%d", numCandidates, all_valid);
 
     uint32_t bestCandidate = rp->rankCands(req, ZCands(&candidates[0], &candidates[numCandidates]));
@@ -391,6 +406,13 @@ void ZArray::postinsert(const Address lineAddr, const MemReq* req, uint32_t cand
     array[candidate] = lineAddr;
     rp->update(candidate, req);
 
+    uint32_t* candPos = &posArray[candidate*ways];
+    if (likely(lineAddr == insertAddr)) {
+        for (uint32_t w = 0; w < ways; w++) candPos[w] = insertPos[w];
+    } else {
+        for (uint32_t w = 0; w < ways; w++) candPos[w] = w*numSets + (hf->hash(w, lineAddr) & setMask);
+    }
+
     statSwaps.inc(swapArrayLen-1);
 }
 
@@ -75,6 +75,7 @@ class CacheArray : public GlobAlloc {
 
 class ReplPolicy;
 class HashFamily;
+struct ZWalkInfo;
 
 /* Set-associative cache array */
 class SetAssocArray : public CacheArray {
@@ -156,13 +157,25 @@ class ZArray : public CacheArray {
         uint32_t cands;
         uint32_t setMask;
 
+        //Per-way physical positions of every line, (numLines x ways), filled on insertion.
+        //Since lineIds never move (only lookupArray is permuted), the walk can expand a
+        //candidate with table lookups instead of recomputing its hashes.
+        uint32_t* posArray;
+
         //preinsert() stores the swaps that must be done here, postinsert() does the swaps
         uint32_t* swapArray; //contains physical positions
         uint32_t swapArrayLen; //set in preinsert()
 
+        //Walk buffers, reused across replacements
+        ZWalkInfo* walkArray; //cands + ways entries
+        uint32_t* insertPos; //positions of the incoming line, computed in preinsert() and saved for postinsert()
+        Address insertAddr;
+
         uint32_t lastCandIdx;
 
         Counter statSwaps;
+        Counter statHashesSaved;
+        VectorCounter statWalkDepth;
 
     public:
         ZArray(uint32_t _numLines, uint32_t _ways, uint32_t _candidates, ReplPolicy* _rp, HashFamily* _hf);
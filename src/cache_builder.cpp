@@ -0,0 +1,732 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cache_builder.h"
+#include <algorithm>
+#include <iterator>
+#include <list>
+#include <sstream>
+#include "cache.h"
+#include "cache_arrays.h"
+#include "config.h"
+#include "ddr_mem.h"
+#include "detailed_mem.h"
+#include "dramsim_mem_ctrl.h"
+#include "event_queue.h"
+#include "filter_cache.h"
+#include "galloc.h"
+#include "hash.h"
+#include "host_placement.h"
+#include "ideal_arrays.h"
+#include "log.h"
+#include "mem_ctrls.h"
+#include "network.h"
+#include "part_repl_policies.h"
+#include "prefetcher.h"
+#include "repl_policies.h"
+#include "str.h"
+#include "timing_cache.h"
+#include "trace_driver.h"
+#include "tracing_cache.h"
+#include "weave_md1_mem.h" //validation, could be taken out...
+#include "zsim.h"
+
+using std::list;
+using std::pair;
+using std::string;
+using std::stringstream;
+using std::unordered_map;
+using std::vector;
+
+Cache * llc_ptr;
+Cache * llc_ptr_1;
+static int llc_bank=0;
+static unordered_map<const BaseCache*, uint32_t> cacheDomains; //for host placement
+Cache** llc_ptrs;
+int llc_banks;
+
+BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name, uint32_t bankSize, bool isTerminal, uint32_t domain, bool isLLC_1) {
+    string type = config.get<const char*>(prefix + "type", "Simple");
+    // Shortcut for TraceDriven type
+    if (type == "TraceDriven") {
+        assert(zinfo->traceDriven);
+        assert(isTerminal);
+        return new TraceDriverProxyCache(name);
+    }
+
+    uint32_t lineSize = zinfo->lineSize;
+    assert(lineSize > 0); //avoid config deps
+    if (bankSize % lineSize != 0) panic("%s: Bank size must be a multiple of line size", name.c_str());
+
+    uint32_t numLines = bankSize/lineSize;
+
+    //Array
+    uint32_t numHashes = 1;
+    uint32_t ways = config.get<uint32_t>(prefix + "array.ways", 4);
+    string arrayType = config.get<const char*>(prefix + "array.type", "SetAssoc");
+    uint32_t candidates = (arrayType == "Z")? config.get<uint32_t>(prefix + "array.candidates", 16) : ways;
+
+    //Need to know number of hash functions before instantiating array
+    if (arrayType == "SetAssoc") {
+        numHashes = 1;
+    }else if (arrayType == "CEASER") {
+        numHashes = 1;
+        zinfo->isCEASER = true;
+    } else if (arrayType == "Z") {
+        numHashes = ways;
+        assert(ways > 1);
+    } else if (arrayType == "IdealLRU" || arrayType == "IdealLRUPart") {
+        ways = numLines;
+        numHashes = 0;
+    } else {
+        panic("%s: Invalid array type %s", name.c_str(), arrayType.c_str());
+    }
+
+    // Power of two sets check; also compute setBits, will be useful later
+    uint32_t numSets = numLines/ways;
+    uint32_t setBits = 31 - __builtin_clz(numSets);
+    if ((1u << setBits) != numSets) panic("%s: Number of sets must be a power of two (you specified %d sets)", name.c_str(), numSets);
+
+    //Hash function
+    HashFamily* hf = nullptr;
+    HashFamily* hf_1 = nullptr;
+    HashFamily* hf_2 = nullptr;
+    string hashType = config.get<const char*>(prefix + "array.hash", (arrayType == "Z")? "H3" : "None"); //zcaches must be hashed by default
+    if (numHashes) {
+        if (hashType == "None") {
+            if (arrayType == "Z") panic("ZCaches must be hashed!"); //double check for stupid user
+            assert(numHashes == 1);
+            hf = new IdHashFamily;
+        } else if (hashType == "Feistel") {
+            hf = new FeistelFamily(0xCAC7EAFFA1); 
+            hf_1 = new FeistelFamily(0x67089ddd34); 
+            hf_2 = new FeistelFamily(0x7d28431474); 
+        } else if (hashType == "H3") {
+            //STL hash function
+            size_t seed = std::_Fnv_hash_bytes(prefix.c_str(), prefix.size()+1, 0xB4AC5B);
+            size_t seed_1 = std::_Fnv_hash_bytes(prefix.c_str(), prefix.size()+1, 0x38C2E5);
+            size_t seed_2 = std::_Fnv_hash_bytes(prefix.c_str(), prefix.size()+1, 0x9128F6);
+            //info("%s -> %lx", prefix.c_str(), seed);
+            hf = new H3HashFamily(numHashes, setBits, 0xCAC7EAFFA1 + seed /*make randSeed depend on prefix*/);
+            hf_1 = new H3HashFamily(numHashes, setBits, 0x67089ddd34 + seed_1 /*make randSeed depend on prefix*/);
+            hf_2 = new H3HashFamily(numHashes, setBits, 0x7d28431474 + seed_2 /*make randSeed depend on prefix*/);
+        } else if (hashType == "SHA1") {
+            hf = new SHA1HashFamily(numHashes);
+        } else {
+            panic("%s: Invalid value %s on array.hash", name.c_str(), hashType.c_str());
+        }
+    }
+
+    //Replacement policy
+    string replType = config.get<const char*>(prefix + "repl.type", (arrayType == "IdealLRUPart")? "IdealLRUPart" : "LRU");
+    ReplPolicy* rp = nullptr;
+
+    if (replType == "LRU" || replType == "LRUNoSh") {
+        bool sharersAware = (replType == "LRU") && !isTerminal;
+        if (sharersAware) {
+            rp = new LRUReplPolicy<true>(numLines);
+            //rp = new SHARPReplPolicy<true>(numLines);
+        } else {
+            rp = new LRUReplPolicy<false>(numLines);
+        }
+    } else if (replType == "SHARP") {
+        bool sharersAware = (replType == "LRU") && !isTerminal;
+        if (sharersAware) {
+            //rp = new LRUReplPolicy<true>(numLines);
+            rp = new SHARPReplPolicy<true>(numLines);
+        } else {
+            rp = new LRUReplPolicy<false>(numLines);
+        }
+    } else if (replType == "LFU") {
+        rp = new LFUReplPolicy(numLines);
+    } else if (replType == "LRUProfViol") {
+        ProfViolReplPolicy< LRUReplPolicy<true> >* pvrp = new ProfViolReplPolicy< LRUReplPolicy<true> >(numLines);
+        pvrp->init(numLines);
+        rp = pvrp;
+    } else if (replType == "TreeLRU") {
+        rp = new TreeLRUReplPolicy(numLines, candidates);
+    } else if (replType == "NRU") {
+        rp = new NRUReplPolicy(numLines, candidates);
+    } else if (replType == "Rand") {
+        rp = new RandReplPolicy(candidates);
+    } else if (replType == "WayPart" || replType == "Vantage" || replType == "IdealLRUPart") {
+        if (replType == "WayPart" && arrayType != "SetAssoc") panic("WayPart replacement requires SetAssoc array");
+
+        //Partition mapper
+        // TODO: One partition mapper per cache (not bank).
+        string partMapper = config.get<const char*>(prefix + "repl.partMapper", "Core");
+        PartMapper* pm = nullptr;
+        if (partMapper == "Core") {
+            pm = new CorePartMapper(zinfo->numCores); //NOTE: If the cache is not fully shared, trhis will be inefficient...
+        } else if (partMapper == "InstrData") {
+            pm = new InstrDataPartMapper();
+        } else if (partMapper == "InstrDataCore") {
+            pm = new InstrDataCorePartMapper(zinfo->numCores);
+        } else if (partMapper == "Process") {
+            pm = new ProcessPartMapper(zinfo->numProcs);
+        } else if (partMapper == "InstrDataProcess") {
+            pm = new InstrDataProcessPartMapper(zinfo->numProcs);
+        } else if (partMapper == "ProcessGroup") {
+            pm = new ProcessGroupPartMapper();
+        } else {
+            panic("Invalid repl.partMapper %s on %s", partMapper.c_str(), name.c_str());
+        }
+
+        // Partition monitor
+        uint32_t umonLines = config.get<uint32_t>(prefix + "repl.umonLines", 256);
+        uint32_t umonWays = config.get<uint32_t>(prefix + "repl.umonWays", ways);
+        uint32_t buckets;
+        if (replType == "WayPart") {
+            buckets = ways; //not an option with WayPart
+        } else { //Vantage or Ideal
+            buckets = config.get<uint32_t>(prefix + "repl.buckets", 256);
+        }
+
+        string umonType = config.get<const char*>(prefix + "repl.umonType", "UMon");
+        PartitionMonitor* mon = nullptr;
+        if (umonType == "UMon") {
+            mon = new UMonMonitor(numLines, umonLines, umonWays, pm->getNumPartitions(), buckets);
+        } else if (umonType == "Dueling") {
+            // Leader groups (simulated allocations), max halvings of the sampling ratio, and sampled accesses/interval to aim for
+            uint32_t umonPoints = config.get<uint32_t>(prefix + "repl.umonPoints", 8);
+            uint32_t umonMaxSamplingShift = config.get<uint32_t>(prefix + "repl.umonMaxSamplingShift", 4);
+            uint32_t umonTargetSamples = config.get<uint32_t>(prefix + "repl.umonTargetSamples", 16*umonLines);
+            mon = new DuelingUMonMonitor(numLines, umonLines, umonWays, pm->getNumPartitions(), buckets,
+                                         umonPoints, umonMaxSamplingShift, umonTargetSamples);
+        } else {
+            panic("%s: Invalid repl.umonType %s", name.c_str(), umonType.c_str());
+        }
+
+        //Finally, instantiate the repl policy
+        PartReplPolicy* prp;
+        double allocPortion = 1.0;
+        if (replType == "WayPart") {
+            //if set, drives partitioner but doesn't actually do partitioning
+            bool testMode = config.get<bool>(prefix + "repl.testMode", false);
+            prp = new WayPartReplPolicy(mon, pm, numLines, ways, testMode);
+        } else if (replType == "IdealLRUPart") {
+            prp = new IdealLRUPartReplPolicy(mon, pm, numLines, buckets);
+        } else { //Vantage
+            uint32_t assoc = (arrayType == "Z")? candidates : ways;
+            allocPortion = .85;
+            bool smoothTransients = config.get<bool>(prefix + "repl.smoothTransients", false);
+            prp = new VantageReplPolicy(mon, pm, numLines, assoc, (uint32_t)(allocPortion * 100), 10, 50, buckets, smoothTransients);
+        }
+        rp = prp;
+
+        // Partitioner
+        // TODO: Depending on partitioner type, we want one per bank or one per cache.
+        string partitionerType = config.get<const char*>(prefix + "repl.partitioner", "Lookahead");
+        Partitioner* p = nullptr;
+        if (partitionerType == "Lookahead") {
+            p = new LookaheadPartitioner(prp, pm->getNumPartitions(), buckets, 1, allocPortion);
+        } else if (partitionerType == "IncrementalLookahead") {
+            p = new IncrementalLookaheadPartitioner(prp, pm->getNumPartitions(), buckets, 1, allocPortion);
+        } else {
+            panic("%s: Invalid repl.partitioner %s", name.c_str(), partitionerType.c_str());
+        }
+
+        //Schedule its tick
+        uint32_t interval = config.get<uint32_t>(prefix + "repl.interval", 5000); //phases
+        zinfo->eventQueue->insert(new Partitioner::PartitionEvent(p, interval));
+    } else {
+        panic("%s: Invalid replacement type %s", name.c_str(), replType.c_str());
+    }
+    assert(rp);
+
+
+    //Alright, build the array
+    CacheArray* array = nullptr;
+    //bool isLLC = false;
+    if (arrayType == "SetAssoc") {
+        array = new SetAssocArray(numLines, ways, rp, hf);
+        //isLLC = true;
+    } else if (arrayType == "CEASER") {
+        array = new CEASERArray(numLines, ways, rp, hf_1, hf_2);
+        //isLLC = true;
+        zinfo->llc_skew_assoc = ways;
+        zinfo->refreshCount = (float)(zinfo->refreshRate)*(zinfo->llc_skews)*(zinfo->llc_skew_assoc)*(zinfo->numCores)*(zinfo->numCores)/(1.0);
+        //It is there twice, because 
+        // 1. the count variable is shared among the cores.
+        // 2. all banks have a particular set flushed, and bank count = core count
+        info ("The refresh count is %f, refresh rate is %f", zinfo->refreshCount, zinfo->refreshRate);
+    } else if (arrayType == "Z") {
+        array = new ZArray(numLines, ways, candidates, rp, hf);
+    } else if (arrayType == "IdealLRU") {
+        assert(replType == "LRU");
+        assert(!hf);
+        IdealLRUArray* ila = new IdealLRUArray(numLines);
+        rp = ila->getRP();
+        array = ila;
+    } else if (arrayType == "IdealLRUPart") {
+        assert(!hf);
+        IdealLRUPartReplPolicy* irp = dynamic_cast<IdealLRUPartReplPolicy*>(rp);
+        if (!irp) panic("IdealLRUPart array needs IdealLRUPart repl policy!");
+        array = new IdealLRUPartArray(numLines, irp);
+    } else {
+        panic("This should not happen, we already checked for it!"); //unless someone changed arrayStr...
+    }
+
+    array->setLLC(isLLC_1);
+
+    //Latency
+    uint32_t latency = config.get<uint32_t>(prefix + "latency", 10);
+    uint32_t accLat = (isTerminal)? 0 : latency; //terminal caches has no access latency b/c it is assumed accLat is hidden by the pipeline
+    uint32_t invLat = latency;
+
+    // Inclusion?
+    bool nonInclusiveHack = config.get<bool>(prefix + "nonInclusiveHack", false);
+    if (nonInclusiveHack) assert(type == "Simple" && !isTerminal);
+
+    // Finally, build the cache
+    Cache* cache;
+    CC* cc;
+    if (isTerminal) {
+        cc = new MESITerminalCC(numLines, name);
+    } else {
+        cc = new MESICC(numLines, nonInclusiveHack, name);
+        cc->array = array;
+    }
+    rp->setCC(cc);
+    if (!isTerminal) {
+        if (type == "Simple") {
+            cache = new Cache(numLines, cc, array, rp, accLat, invLat, name);
+        } else if (type == "Timing") {
+            uint32_t mshrs = config.get<uint32_t>(prefix + "mshrs", 16);
+            uint32_t tagLat = config.get<uint32_t>(prefix + "tagLat", 5);
+            uint32_t timingCandidates = config.get<uint32_t>(prefix + "timingCandidates", candidates);
+            cache = new TimingCache(numLines, cc, array, rp, accLat, invLat, mshrs, tagLat, ways, timingCandidates, domain, name);
+        } else if (type == "Tracing") {
+            g_string traceFile = config.get<const char*>(prefix + "traceFile","");
+            if (traceFile.empty()) traceFile = g_string(zinfo->outputDir) + "/" + name + ".trace";
+            cache = new TracingCache(numLines, cc, array, rp, accLat, invLat, traceFile, name);
+        } else {
+            panic("Invalid cache type %s", type.c_str());
+        }
+    } else {
+        //Filter cache optimization
+        if (type != "Simple") panic("Terminal cache %s can only have type == Simple", name.c_str());
+        if (arrayType != "SetAssoc" || hashType != "None" || replType != "LRU") panic("Invalid FilterCache config %s", name.c_str());
+        cache = new FilterCache(numSets, numLines, cc, array, rp, accLat, invLat, name);
+    }
+
+#if 0
+    info("Built L%d bank, %d bytes, %d lines, %d ways (%d candidates if array is Z), %s array, %s hash, %s replacement, accLat %d, invLat %d name %s",
+            level, bankSize, numLines, ways, candidates, arrayType.c_str(), hashType.c_str(), replType.c_str(), accLat, invLat, name.c_str());
+#endif
+    cache->isLLC = isLLC_1;
+    if (cache->isLLC){
+      if (llc_bank == 0){
+        llc_ptr = cache;
+        zinfo->llc_ptr = (void *)cache;
+        info("llc ptr has been set, value is %lx", (uint64_t)llc_ptr);
+      }else if (llc_bank == 1)
+        llc_ptr_1 = cache;
+
+      zinfo->llc_ptrs[llc_bank]=cache;
+    }
+    llc_bank++;
+    return cache;
+}
+
+// NOTE: frequency is SYSTEM frequency; mem freq specified in tech
+DDRMemory* BuildDDRMemory(Config& config, uint32_t lineSize, uint32_t frequency, uint32_t domain, g_string name, const string& prefix) {
+    uint32_t ranksPerChannel = config.get<uint32_t>(prefix + "ranksPerChannel", 4);
+    uint32_t banksPerRank = config.get<uint32_t>(prefix + "banksPerRank", 8);  // DDR3 std is 8
+    uint32_t pageSize = config.get<uint32_t>(prefix + "pageSize", 8*1024);  // 1Kb cols, x4 devices
+    const char* tech = config.get<const char*>(prefix + "tech", "DDR3-1333-CL10");  // see cpp file for other techs
+    const char* addrMapping = config.get<const char*>(prefix + "addrMapping", "rank:col:bank");  // address splitter interleaves channels; row always on top
+
+    // If set, writes are deferred and bursted out to reduce WTR overheads
+    bool deferWrites = config.get<bool>(prefix + "deferWrites", true);
+    bool closedPage = config.get<bool>(prefix + "closedPage", true);
+
+    // Max row hits before we stop prioritizing further row hits to this bank.
+    // Balances throughput and fairness; 0 -> FCFS / high (e.g., -1) -> pure FR-FCFS
+    uint32_t maxRowHits = config.get<uint32_t>(prefix + "maxRowHits", 4);
+
+    // Request queues
+    uint32_t queueDepth = config.get<uint32_t>(prefix + "queueDepth", 16);
+    uint32_t controllerLatency = config.get<uint32_t>(prefix + "controllerLatency", 10);  // in system cycles
+
+    auto mem = new DDRMemory(zinfo->lineSize, pageSize, ranksPerChannel, banksPerRank, frequency, tech,
+            addrMapping, controllerLatency, queueDepth, maxRowHits, deferWrites, closedPage, domain, name);
+    return mem;
+}
+
+MemObject* BuildMemoryController(Config& config, uint32_t lineSize, uint32_t frequency, uint32_t domain, g_string& name) {
+    //Type
+    string type = config.get<const char*>("sys.mem.type", "Simple");
+
+    //Latency
+    uint32_t latency = (type == "DDR")? -1 : config.get<uint32_t>("sys.mem.latency", 100);
+
+    MemObject* mem = nullptr;
+    if (type == "Simple") {
+        mem = new SimpleMemory(latency, name);
+    } else if (type == "MD1") {
+        // The following params are for MD1 only
+        // NOTE: Frequency (in MHz) -- note this is a sys parameter (not sys.mem). There is an implicit assumption of having
+        // a single CCT across the system, and we are dealing with latencies in *core* clock cycles
+
+        // Peak bandwidth (in MB/s)
+        uint32_t bandwidth = config.get<uint32_t>("sys.mem.bandwidth", 6400);
+
+        mem = new MD1Memory(lineSize, frequency, bandwidth, latency, name);
+    } else if (type == "WeaveMD1") {
+        uint32_t bandwidth = config.get<uint32_t>("sys.mem.bandwidth", 6400);
+        uint32_t boundLatency = config.get<uint32_t>("sys.mem.boundLatency", latency);
+        mem = new WeaveMD1Memory(lineSize, frequency, bandwidth, latency, boundLatency, domain, name);
+    } else if (type == "WeaveSimple") {
+        uint32_t boundLatency = config.get<uint32_t>("sys.mem.boundLatency", 100);
+        mem = new WeaveSimpleMemory(latency, boundLatency, domain, name);
+    } else if (type == "DDR") {
+        mem = BuildDDRMemory(config, lineSize, frequency, domain, name, "sys.mem.");
+    } else if (type == "DRAMSim") {
+        uint64_t cpuFreqHz = 1000000 * frequency;
+        uint32_t capacity = config.get<uint32_t>("sys.mem.capacityMB", 16384);
+        string dramTechIni = config.get<const char*>("sys.mem.techIni");
+        string dramSystemIni = config.get<const char*>("sys.mem.systemIni");
+        string outputDir = config.get<const char*>("sys.mem.outputDir");
+        string traceName = config.get<const char*>("sys.mem.traceName");
+        mem = new DRAMSimMemory(dramTechIni, dramSystemIni, outputDir, traceName, capacity, cpuFreqHz, latency, domain, name);
+    } else if (type == "Detailed") {
+        // FIXME(dsm): Don't use a separate config file... see DDRMemory
+        g_string mcfg = config.get<const char*>("sys.mem.paramFile", "");
+        mem = new MemControllerBase(mcfg, lineSize, frequency, domain, name);
+    } else {
+        panic("Invalid memory controller type %s", type.c_str());
+    }
+    return mem;
+}
+
+CacheGroup* BuildCacheGroup(Config& config, const string& name, bool isTerminal) {
+    CacheGroup* cgp = new CacheGroup;
+    CacheGroup& cg = *cgp;
+
+    string prefix = "sys.caches." + name + ".";
+
+    bool isPrefetcher = config.get<bool>(prefix + "isPrefetcher", false);
+    if (isPrefetcher) { //build a prefetcher group
+        uint32_t prefetchers = config.get<uint32_t>(prefix + "prefetchers", 1);
+        cg.resize(prefetchers);
+        for (vector<BaseCache*>& bg : cg) bg.resize(1);
+        for (uint32_t i = 0; i < prefetchers; i++) {
+            stringstream ss;
+            ss << name << "-" << i;
+            g_string pfName(ss.str().c_str());
+            cg[i][0] = new StreamPrefetcher(pfName);
+        }
+        return cgp;
+    }
+
+    uint32_t size = config.get<uint32_t>(prefix + "size", 64*1024);
+    uint32_t banks = config.get<uint32_t>(prefix + "banks", 1);
+    uint32_t caches = config.get<uint32_t>(prefix + "caches", 1);
+    uint32_t skews = config.get<uint32_t>(prefix + "skews", 1);
+
+    info ("Name is %s", name.c_str());
+    string x("l3");
+    bool isLLC = false;
+    if (name.compare(x) == 0){
+      isLLC = true;
+      zinfo->llc_ptrs = gm_calloc<Cache*>(banks);
+      //llc_ptrs = gm_memalign<Cache *>(CACHE_LINE_BYTES, banks);
+      //zinfo->skewLocks = gm_calloc<lock_t>(banks);
+      llc_banks = banks;
+      zinfo->llc_banks = banks;
+      zinfo->llc_skews=skews;
+      info ("llc banks is %d, skews is %d", (int)banks, skews);
+      assert ((banks % skews) == 0);
+    }
+
+
+    uint32_t bankSize = size/banks;
+    if (size % banks != 0) {
+        panic("%s: banks (%d) does not divide the size (%d bytes)", name.c_str(), banks, size);
+    }
+
+    cg.resize(caches);
+    for (vector<BaseCache*>& bg : cg) bg.resize(banks);
+
+    for (uint32_t i = 0; i < caches; i++) {
+        for (uint32_t j = 0; j < banks; j++) {
+            stringstream ss;
+            ss << name << "-" << i;
+            if (banks > 1) {
+                ss << "b" << j;
+            }
+            g_string bankName(ss.str().c_str());
+            uint32_t domain = (i*banks + j)*zinfo->numDomains/(caches*banks); //(banks > 1)? nextDomain() : (i*banks + j)*zinfo->numDomains/(caches*banks);
+            void* bankStart = gm_top();
+            cg[i][j] = BuildCacheBank(config, prefix, bankName, bankSize, isTerminal, domain, isLLC);
+            cacheDomains[cg[i][j]] = domain;
+            if (zinfo->hostPlacement) zinfo->hostPlacement->bindBankMemory(bankStart, gm_top(), domain);
+        }
+    }
+
+    return cgp;
+}
+
+CacheHierarchy* BuildCacheHierarchy(Config& config) {
+    CacheHierarchy* h = new CacheHierarchy;
+    unordered_map<string, string>& parentMap = h->parentMap;
+    unordered_map<string, vector<vector<string>>>& childMap = h->childMap;
+    vector<const char*>& cacheGroupNames = h->groupNames;
+    unordered_map<string, CacheGroup*>& cMap = h->groups;
+    g_vector<MemObject*>& mems = h->mems;
+
+    zinfo->isCEASER=false; //will be set to true later
+
+    auto parseChildren = [](string children) {
+        // 1st dim: concatenated caches; 2nd dim: interleaved caches
+        // Example: "l2-beefy l1i-wimpy|l1d-wimpy" produces [["l2-beefy"], ["l1i-wimpy", "l1d-wimpy"]]
+        // If there are 2 of each cache, the final vector will be l2-beefy-0 l2-beefy-1 l1i-wimpy-0 l1d-wimpy-0 l1i-wimpy-1 l1d-wimpy-1
+        vector<string> concatGroups = ParseList<string>(children);
+        vector<vector<string>> cVec;
+        for (string cg : concatGroups) cVec.push_back(ParseList<string>(cg, "|"));
+        return cVec;
+    };
+
+    // If a network file is specified, build a Network
+    string networkFile = config.get<const char*>("sys.networkFile", "");
+    Network* network = (networkFile != "")? new Network(networkFile.c_str()) : nullptr;
+
+    // Build the caches
+    config.subgroups("sys.caches", cacheGroupNames);
+    string prefix = "sys.caches.";
+
+    for (const char* grp : cacheGroupNames) {
+        string group(grp);
+        if (group == "mem") panic("'mem' is an invalid cache group name");
+        if (childMap.count(group)) panic("Duplicate cache group %s", (prefix + group).c_str());
+
+        string children = config.get<const char*>(prefix + group + ".children", "");
+        childMap[group] = parseChildren(children);
+        for (auto v : childMap[group]) for (auto child : v) {
+            if (parentMap.count(child)) {
+                panic("Cache group %s can have only one parent (%s and %s found)", child.c_str(), parentMap[child].c_str(), grp);
+            }
+            parentMap[child] = group;
+        }
+    }
+
+    // Check that children are valid (another cache)
+    for (auto& it : parentMap) {
+        bool found = false;
+        for (auto& grp : cacheGroupNames) found |= it.first == grp;
+        if (!found) panic("%s has invalid child %s", it.second.c_str(), it.first.c_str());
+    }
+
+    // Get the (single) LLC
+    vector<string> parentlessCacheGroups;
+    for (auto& it : childMap) if (!parentMap.count(it.first)) parentlessCacheGroups.push_back(it.first);
+    if (parentlessCacheGroups.size() != 1) panic("Only one last-level cache allowed, found: %s", Str(parentlessCacheGroups).c_str());
+    h->llc = parentlessCacheGroups[0];
+    const string& llc = h->llc;
+    zinfo->llcName = gm_strdup(llc.c_str());
+
+    auto isTerminal = [&](string group) -> bool {
+        return childMap[group].size() == 0;
+    };
+
+    // Build each of the groups, starting with the LLC
+    list<string> fringe;  // FIFO
+    fringe.push_back(llc);
+    while (!fringe.empty()) {
+        string group = fringe.front();
+        fringe.pop_front();
+        if (cMap.count(group)) panic("The cache 'tree' has a loop at %s", group.c_str());
+        cMap[group] = BuildCacheGroup(config, group, isTerminal(group));
+        for (auto& childVec : childMap[group]) fringe.insert(fringe.end(), childVec.begin(), childVec.end());
+    }
+
+    //Check single LLC
+    if (cMap[llc]->size() != 1) panic("Last-level cache %s must have caches = 1, but %ld were specified", llc.c_str(), cMap[llc]->size());
+
+    /* Since we have checked for no loops, parent is mandatory, and all parents are checked valid,
+     * it follows that we have a fully connected tree finishing at the LLC.
+     */
+
+    //Build the memory controllers
+    uint32_t memControllers = config.get<uint32_t>("sys.mem.controllers", 1);
+    assert(memControllers > 0);
+
+    mems.resize(memControllers);
+
+    for (uint32_t i = 0; i < memControllers; i++) {
+        stringstream ss;
+        ss << "mem-" << i;
+        g_string name(ss.str().c_str());
+        //uint32_t domain = nextDomain(); //i*zinfo->numDomains/memControllers;
+        uint32_t domain = i*zinfo->numDomains/memControllers;
+        mems[i] = BuildMemoryController(config, zinfo->lineSize, zinfo->freqMHz, domain, name);
+    }
+
+    if (memControllers > 1) {
+        bool splitAddrs = config.get<bool>("sys.mem.splitAddrs", true);
+        if (splitAddrs) {
+            MemObject* splitter = new SplitAddrMemory(mems, "mem-splitter");
+            mems.resize(1);
+            mems[0] = splitter;
+        }
+    }
+
+    //Connect everything
+    bool printHierarchy = config.get<bool>("sim.printHierarchy", false);
+
+    // mem to llc is a bit special, only one llc
+    uint32_t childId = 0;
+    for (BaseCache* llcBank : (*cMap[llc])[0]) {
+        llcBank->setParents(childId++, mems, network);
+    }
+
+
+    // Rest of caches
+    for (const char* grp : cacheGroupNames) {
+        if (isTerminal(grp)) continue; //skip terminal caches
+
+        CacheGroup& parentCaches = *cMap[grp];
+        uint32_t parents = parentCaches.size();
+        assert(parents);
+
+        // Linearize concatenated / interleaved caches from childMap cacheGroups
+        CacheGroup childCaches;
+
+        for (auto childVec : childMap[grp]) {
+            if (!childVec.size()) continue;
+            size_t vecSize = cMap[childVec[0]]->size();
+            for (string child : childVec) {
+                if (cMap[child]->size() != vecSize) {
+                    panic("In interleaved group %s, %s has a different number of caches", Str(childVec).c_str(), child.c_str());
+                }
+            }
+
+            CacheGroup interleavedGroup;
+            for (uint32_t i = 0; i < vecSize; i++) {
+                for (uint32_t j = 0; j < childVec.size(); j++) {
+                    interleavedGroup.push_back(cMap[childVec[j]]->at(i));
+                }
+            }
+
+            childCaches.insert(childCaches.end(), interleavedGroup.begin(), interleavedGroup.end());
+        }
+
+        uint32_t children = childCaches.size();
+        assert(children);
+
+        uint32_t childrenPerParent = children/parents;
+        if (children % parents != 0) {
+            panic("%s has %d caches and %d children, they are non-divisible. "
+                  "Use multiple groups for non-homogeneous children per parent!", grp, parents, children);
+        }
+
+        for (uint32_t p = 0; p < parents; p++) {
+            g_vector<MemObject*> parentsVec;
+            parentsVec.insert(parentsVec.end(), parentCaches[p].begin(), parentCaches[p].end()); //BaseCache* to MemObject* is a safe cast
+
+            uint32_t childId = 0;
+            g_vector<BaseCache*> childrenVec;
+            for (uint32_t c = p*childrenPerParent; c < (p+1)*childrenPerParent; c++) {
+                for (BaseCache* bank : childCaches[c]) {
+                    bank->setParents(childId++, parentsVec, network);
+                    childrenVec.push_back(bank);
+
+                    Cache* cache = dynamic_cast<Cache*>(bank);
+                    if (zinfo->hostPlacement && cache) {
+                        uint32_t node = zinfo->hostPlacement->nodeOfDomain(cacheDomains[bank]);
+                        g_vector<uint8_t> remote;
+                        for (BaseCache* parent : parentCaches[p]) remote.push_back(zinfo->hostPlacement->nodeOfDomain(cacheDomains[parent]) != node);
+                        cache->setRemoteParents(remote);
+                    }
+                }
+            }
+
+            if (printHierarchy) {
+                vector<string> cacheNames;
+                std::transform(childrenVec.begin(), childrenVec.end(), std::back_inserter(cacheNames),
+                        [](BaseCache* c) -> string { string s = c->getName(); return s; });
+
+                string parentName = parentCaches[p][0]->getName();
+                if (parentCaches[p].size() > 1) {
+                    parentName += "..";
+                    parentName += parentCaches[p][parentCaches[p].size()-1]->getName();
+                }
+                info("Hierarchy: %s -> %s", Str(cacheNames).c_str(), parentName.c_str());
+            }
+
+            for (BaseCache* bank : parentCaches[p]) {
+                bank->setChildren(childrenVec, network);
+            }
+        }
+    }
+
+    //Check that all the terminal caches have a single bank
+    for (const char* grp : cacheGroupNames) {
+        if (isTerminal(grp)) {
+            uint32_t banks = (*cMap[grp])[0].size();
+            if (banks != 1) panic("Terminal cache group %s needs to have a single bank, has %d", grp, banks);
+        }
+    }
+
+    return h;
+}
+
+TraceDriver* BuildTraceDriver(Config& config, CacheHierarchy& hierarchy) {
+    vector<TraceDriverProxyCache*> proxies;
+    for (const char* grp : hierarchy.groupNames) {
+        if (hierarchy.isTerminal(grp)) {
+            for (vector<BaseCache*> cv : *hierarchy.groups[grp]) {
+                assert(cv.size() == 1);
+                TraceDriverProxyCache* proxy = dynamic_cast<TraceDriverProxyCache*>(cv[0]);
+                if (!proxy) panic("Terminal cache group %s must have type = \"TraceDriven\" to replay a trace", grp);
+                proxies.push_back(proxy);
+            }
+        }
+    }
+
+    //FIXME: For now, we assume we are driving a single-bank LLC
+    string traceFile = config.get<const char*>("sim.traceFile");
+    string retraceFile = config.get<const char*>("sim.retraceFile", ""); //leave empty to not retrace
+    return new TraceDriver(traceFile, retraceFile, proxies,
+            config.get<bool>("sim.useSkews", true), // incorporate skews in to playback and simulator results, not only the output trace
+            config.get<bool>("sim.playPuts", true),
+            config.get<bool>("sim.playAllGets", true),
+            config.get<uint32_t>("sim.traceThreads", 0)); // 0: replay the merged trace in order; >0: replay each child's stream separately on this many threads
+}
+
+void InitCacheHierarchyStats(CacheHierarchy& hierarchy, AggregateStat* parentStat) {
+    for (const char* group : hierarchy.groupNames) {
+        AggregateStat* groupStat = new AggregateStat(true);
+        groupStat->init(gm_strdup(group), "Cache stats");
+        for (vector<BaseCache*>& banks : *hierarchy.groups[group]) for (BaseCache* bank : banks) bank->initStats(groupStat);
+        parentStat->append(groupStat);
+    }
+
+    AggregateStat* memStat = new AggregateStat(true);
+    memStat->init("mem", "Memory controller stats");
+    for (auto mem : hierarchy.mems) mem->initStats(memStat);
+    parentStat->append(memStat);
+}
@@ -0,0 +1,74 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CACHE_BUILDER_H_
+#define CACHE_BUILDER_H_
+
+/* Builds the memory hierarchy (caches and memory controllers) described by
+ * sys.caches and sys.mem. This is shared by SimInit and by llcsim, the
+ * standalone trace-driven simulator, so it must not depend on Pin or on the
+ * cores; SimInit connects the cores to the terminal caches afterwards.
+ */
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "g_std/g_vector.h"
+
+class BaseCache;
+class Config;
+class MemObject;
+class AggregateStat;
+class TraceDriver;
+
+typedef std::vector<std::vector<BaseCache*>> CacheGroup;
+
+struct CacheHierarchy {
+    std::vector<const char*> groupNames; //in config order
+    std::unordered_map<std::string, CacheGroup*> groups;
+    std::unordered_map<std::string, std::string> parentMap; //child -> parent
+    std::unordered_map<std::string, std::vector<std::vector<std::string>>> childMap; //parent -> children (a parent may have multiple children)
+    std::string llc;
+    g_vector<MemObject*> mems;
+
+    bool isTerminal(const std::string& group) {
+        return childMap[group].size() == 0;
+    }
+
+    ~CacheHierarchy() {
+        for (auto& kv : groups) delete kv.second;
+    }
+};
+
+// Builds and connects all cache groups and memory controllers. Terminal groups are left unconnected.
+CacheHierarchy* BuildCacheHierarchy(Config& config);
+
+// Builds the trace driver that replays sim.traceFile through the terminal (TraceDriven) caches
+TraceDriver* BuildTraceDriver(Config& config, CacheHierarchy& hierarchy);
+
+// Registers the stats of every cache group and memory controller under parentStat
+void InitCacheHierarchyStats(CacheHierarchy& hierarchy, AggregateStat* parentStat);
+
+#endif  // CACHE_BUILDER_H_
@@ -188,7 +188,7 @@ uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessTy
         // A PUTS/PUTX does nothing w.r.t. higher coherence levels --- it dies here
         case PUTS: //Clean writeback, nothing to do (except profiling)
             assert(*state != I);
-            profPUTS.inc();
+            profPUTS.inc(srcId);
             break;
         case PUTX: //Dirty writeback
             assert(*state == M || *state == E);
@@ -196,7 +196,7 @@ uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessTy
                 //Silent transition, record that block was written to
                 *state = M;
             }
-            profPUTX.inc();
+            profPUTX.inc(srcId);
             break;
         case GETS:
             if (*state == I) {
@@ -230,21 +230,22 @@ uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessTy
                 }else {
                   nextLevelLat = parents[parentId]->access(req) - cycle;
                 }
+                if (unlikely(!remoteParents.empty()) && remoteParents[parentId]) profRemoteGETs.inc(srcId);
                 netLat = parentRTTs[parentId];
-                profGETNextLevelLat.inc(nextLevelLat);
-                profGETNetLat.inc(netLat);
+                profGETNextLevelLat.inc(srcId, nextLevelLat);
+                profGETNetLat.inc(srcId, netLat);
                 respCycle += nextLevelLat + netLat;
-                profGETSMiss.inc();
+                profGETSMiss.inc(srcId);
                 assert(*state == S || *state == E);
             } else {
-                profGETSHit.inc();
+                profGETSHit.inc(srcId);
             }
             break;
         case GETX:
             if (*state == I || *state == S) {
                 //Profile before access, state changes
-                if (*state == I) profGETXMissIM.inc();
-                else profGETXMissSM.inc();
+                if (*state == I) profGETXMissIM.inc(srcId);
+                else profGETXMissSM.inc(srcId);
                 uint32_t parentId = getParentId(lineAddr);
                 uint32_t nextLevelLat = 0;
                 uint32_t netLat = 0;
@@ -277,9 +278,10 @@ uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessTy
                   nextLevelLat = parents[parentId]->access(req) - cycle;
                 }
 
+                if (unlikely(!remoteParents.empty()) && remoteParents[parentId]) profRemoteGETs.inc(srcId);
                 netLat = parentRTTs[parentId];
-                profGETNextLevelLat.inc(nextLevelLat);
-                profGETNetLat.inc(netLat);
+                profGETNextLevelLat.inc(srcId, nextLevelLat);
+                profGETNetLat.inc(srcId, netLat);
                 respCycle += nextLevelLat + netLat;
             } else {
                 if (*state == E) {
@@ -292,7 +294,7 @@ uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessTy
                      */
                     *state = M;
                 }
-                profGETXHit.inc();
+                profGETXHit.inc(srcId);
             }
             assert_msg(*state == M, "Wrong final state on GETX, lineId %d numLines %d, finalState %s", lineId, numLines, MESIStateName(*state));
             break;
@@ -312,7 +314,7 @@ void MESIBottomCC::processWritebackOnAccess(Address lineAddr, uint32_t lineId, A
     }
 }
 
-void MESIBottomCC::processInval(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback) {
+void MESIBottomCC::processInval(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint32_t srcId) {
     MESIState* state = &array[lineId];
     assert(*state != I);
     switch (type) {
@@ -321,17 +323,17 @@ void MESIBottomCC::processInval(Address lineAddr, uint32_t lineId, InvType type,
             assert_msg(*state == E || *state == M, "Invalid state %s", MESIStateName(*state));
             if (*state == M) *reqWriteback = true;
             *state = S;
-            profINVX.inc();
+            profINVX.inc(srcId);
             break;
         case INV: //invalidate
             assert(*state != I);
             if (*state == M) *reqWriteback = true;
             *state = I;
-            profINV.inc();
+            profINV.inc(srcId);
             break;
         case FWD: //forward
             assert_msg(*state == S, "Invalid state %s on FWD", MESIStateName(*state));
-            profFWD.inc();
+            profFWD.inc(srcId);
             break;
         default: panic("!?");
     }
@@ -421,7 +423,10 @@ uint64_t MESITopCC::sendInvalidates(Address lineAddr, uint32_t lineId, InvType t
     if (!e->isEmpty()) {
         uint32_t numChildren = children.size();
         uint32_t sentInvs = 0;
-        for (uint32_t c = 0; c < numChildren; c++) {
+        uint32_t numSharers = e->numSharers;
+        if (numSharers == 1) profSoleSharerInvs.inc(srcId);
+        //Stop once all sharers are found; with private lines, there is a single one, usually well before the last child
+        for (uint32_t c = 0; c < numChildren && sentInvs < numSharers; c++) {
             if (e->sharers[c]) {
                 InvReq req = {lineAddr, type, reqWriteback, cycle, srcId};
                 uint64_t respCycle = children[c]->invalidate(req);
@@ -479,6 +484,7 @@ uint64_t MESITopCC::processAccess(Address lineAddr, uint32_t lineId, AccessType
         case GETS:
             if (e->isEmpty() && haveExclusive && !(flags & MemReq::NOEXCL)) {
                 //Give in E state
+                profPrivGETS.inc(srcId);
                 e->exclusive = true;
                 e->sharers[childId] = true;
                 e->owners[childId] = true;
@@ -505,6 +511,18 @@ uint64_t MESITopCC::processAccess(Address lineAddr, uint32_t lineId, AccessType
         case GETX:
             assert(haveExclusive); //the current cache better have exclusive access to this line
 
+            // No other sharer, so there is nothing to invalidate (the common case w/o sharing)
+            if (e->isEmpty() || (e->numSharers == 1 && e->sharers[childId])) {
+                assert_msg(!e->isExclusive(), "Spurious GETX, childId=%d numSharers=%d isExcl=%d excl=%d", childId, e->numSharers, e->isExclusive(), e->exclusive);
+                profPrivGETX.inc(srcId);
+                e->sharers[childId] = true;
+                e->owners[childId] = true;
+                e->numSharers = 1;
+                e->exclusive = true;
+                *childState = M; //give in M directly
+                break;
+            }
+
             // If child is in sharers list (this is an upgrade miss), take it out
             if (e->sharers[childId]) {
                 assert_msg(!e->isExclusive(), "Spurious GETX, childId=%d numSharers=%d isExcl=%d excl=%d", childId, e->numSharers, e->isExclusive(), e->exclusive);
@@ -27,6 +27,7 @@
 #define COHERENCE_CTRLS_H_
 
 #include <bitset>
+#include "bithacks.h"
 #include "constants.h"
 #include "g_std/g_string.h"
 #include "g_std/g_vector.h"
@@ -39,6 +40,14 @@
 
 //TODO: Now that we have a pure CC interface, the MESI controllers should go on different files.
 
+/* Shared caches shard their counters on the requester's srcId, which is a core
+ * id, or a trace driver child id in trace-driven mode. Sizing the shards by the
+ * number of children would fold several requesters into a slot, and they race.
+ */
+static inline uint32_t numRequesterShards() {
+    return zinfo->traceDriven? MAX_CACHE_CHILDREN : MAX(zinfo->numCores, 1u);
+}
+
 /* Generic, integrated controller interface */
 class CC : public GlobAlloc {
     public:
@@ -65,6 +74,22 @@ class CC : public GlobAlloc {
         virtual uint32_t numSharers(uint32_t lineId) = 0;
         virtual bool isValid(uint32_t lineId) = 0;
         virtual bool isSharer(uint32_t lineId, uint32_t srcId) = 0;
+
+        //Batched version of numSharers()/isValid() for contiguous lines (e.g., a whole set), so that
+        //replacement policies pay a single virtual call per replacement instead of two per candidate
+        virtual void getReplState(uint32_t firstLineId, uint32_t numLines, uint32_t* sharers, uint32_t* valid) {
+            for (uint32_t i = 0; i < numLines; i++) {
+                sharers[i] = numSharers(firstLineId + i);
+                valid[i] = isValid(firstLineId + i);
+            }
+        }
+
+        //Host placement: flags the parents that live on a different host node
+        virtual void setRemoteParents(const g_vector<uint8_t>& remote) {}
+
+        //Cumulative interaction counts, sampled once per phase by the adaptive phase length controller
+        virtual uint64_t getCoherenceEvents() const {return 0;} //invalidations, downgrades and forwards received
+        virtual uint64_t getFills() const {return 0;} //misses that brought a line in (and in steady state, evicted one)
         
         //Refresh function
         virtual void processRefresh(uint32_t set){;};
@@ -80,22 +105,22 @@ class CC : public GlobAlloc {
         virtual bool checkSameOwner(Address lineAddr, uint32_t lineId, uint32_t srcId)
         { return true; };
 
-        virtual void incrementFirstTimeMiss(){};
-        virtual void incrementIcacheFirstTimeMiss(){};
-        virtual void incrementDcacheFirstTimeMiss(){};
-        virtual void incrementRXPFirstTimeMiss(){};
-        virtual void incrementRWPFirstTimeMiss(){};
-        virtual void incrementRWXPFirstTimeMiss(){};
-        virtual void incrementRPFirstTimeMiss(){};
-
-        virtual void incrementBinaryFirstTimeMiss(){};
-        virtual void incrementHeapFirstTimeMiss(){};
-        virtual void incrementSLFirstTimeMiss(){};
-        virtual void incrementMMAPFirstTimeMiss(){};
-        virtual void incrementSTACKFirstTimeMiss(){};
-        virtual void incrementVVARFirstTimeMiss(){};
-        virtual void incrementVDSOFirstTimeMiss(){};
-        virtual void incrementVSYSCALLFirstTimeMiss(){};
+        virtual void incrementFirstTimeMiss(uint32_t srcId){};
+        virtual void incrementIcacheFirstTimeMiss(uint32_t srcId){};
+        virtual void incrementDcacheFirstTimeMiss(uint32_t srcId){};
+        virtual void incrementRXPFirstTimeMiss(uint32_t srcId){};
+        virtual void incrementRWPFirstTimeMiss(uint32_t srcId){};
+        virtual void incrementRWXPFirstTimeMiss(uint32_t srcId){};
+        virtual void incrementRPFirstTimeMiss(uint32_t srcId){};
+
+        virtual void incrementBinaryFirstTimeMiss(uint32_t srcId){};
+        virtual void incrementHeapFirstTimeMiss(uint32_t srcId){};
+        virtual void incrementSLFirstTimeMiss(uint32_t srcId){};
+        virtual void incrementMMAPFirstTimeMiss(uint32_t srcId){};
+        virtual void incrementSTACKFirstTimeMiss(uint32_t srcId){};
+        virtual void incrementVVARFirstTimeMiss(uint32_t srcId){};
+        virtual void incrementVDSOFirstTimeMiss(uint32_t srcId){};
+        virtual void incrementVSYSCALLFirstTimeMiss(uint32_t srcId){};
 
         /* End of FTM functions */
 
@@ -129,13 +154,17 @@ class MESIBottomCC : public GlobAlloc {
         MTRand *rng;  
 
         //Profiling counters
-        Counter profGETSHit, profGETSMiss, profGETXHit, profGETXMissIM /*from invalid*/, profGETXMissSM /*from S, i.e. upgrade misses*/;
-        Counter profPUTS, profPUTX /*received from downstream*/;
-        Counter profINV, profINVX, profFWD /*received from upstream*/;
+        //Sharded by srcId, since shared caches are updated by many simulation threads (and skewed accesses don't hold ccLock)
+        ShardedCounter profGETSHit, profGETSMiss, profGETXHit, profGETXMissIM /*from invalid*/, profGETXMissSM /*from S, i.e. upgrade misses*/;
+        ShardedCounter profPUTS, profPUTX /*received from downstream*/;
+        ShardedCounter profINV, profINVX, profFWD /*received from upstream*/;
         //Counter profWBIncl, profWBCoh /* writebacks due to inclusion or coherence, received from downstream, does not include PUTS */;
         // TODO: Measuring writebacks is messy, do if needed
-        Counter profGETNextLevelLat, profGETNetLat;
+        ShardedCounter profGETNextLevelLat, profGETNetLat;
 
+        //Host placement: parents whose state lives on a different host node (empty if placement is off)
+        g_vector<uint8_t> remoteParents;
+        ShardedCounter profRemoteGETs;
 
 
         bool nonInclusiveHack;
@@ -147,26 +176,26 @@ class MESIBottomCC : public GlobAlloc {
     public:
         /*  FTM Counters */
         /*  ************* */
-        Counter profFirstTimeMiss;
-        Counter profIcacheFirstTimeMiss;
-        Counter profDcacheFirstTimeMiss;
-        Counter profRXPFirstTimeMiss;
-        Counter profRPFirstTimeMiss;
-        Counter profRWPFirstTimeMiss;
-        Counter profRWXPFirstTimeMiss;
-        Counter profSSRXPFirstTimeMiss;
-        Counter profSSRPFirstTimeMiss;
-        Counter profSSRWPFirstTimeMiss;
-        Counter profSSRWXPFirstTimeMiss;
-
-        Counter profBinaryFirstTimeMiss;
-        Counter profHeapFirstTimeMiss;
-        Counter profSLFirstTimeMiss;
-        Counter profMMAPFirstTimeMiss;
-        Counter profSTACKFirstTimeMiss;
-        Counter profVVARFirstTimeMiss;
-        Counter profVDSOFirstTimeMiss;
-        Counter profVSYSCALLFirstTimeMiss;
+        ShardedCounter profFirstTimeMiss;
+        ShardedCounter profIcacheFirstTimeMiss;
+        ShardedCounter profDcacheFirstTimeMiss;
+        ShardedCounter profRXPFirstTimeMiss;
+        ShardedCounter profRPFirstTimeMiss;
+        ShardedCounter profRWPFirstTimeMiss;
+        ShardedCounter profRWXPFirstTimeMiss;
+        ShardedCounter profSSRXPFirstTimeMiss;
+        ShardedCounter profSSRPFirstTimeMiss;
+        ShardedCounter profSSRWPFirstTimeMiss;
+        ShardedCounter profSSRWXPFirstTimeMiss;
+
+        ShardedCounter profBinaryFirstTimeMiss;
+        ShardedCounter profHeapFirstTimeMiss;
+        ShardedCounter profSLFirstTimeMiss;
+        ShardedCounter profMMAPFirstTimeMiss;
+        ShardedCounter profSTACKFirstTimeMiss;
+        ShardedCounter profVVARFirstTimeMiss;
+        ShardedCounter profVDSOFirstTimeMiss;
+        ShardedCounter profVSYSCALLFirstTimeMiss;
 
         /*  ************* */
         /* End FTM Counters */
@@ -210,37 +239,38 @@ class MESIBottomCC : public GlobAlloc {
 
         void setInvalid(Address lineAddr, uint32_t lineId);
 
-        void initStats(AggregateStat* parentStat) {
-            profGETSHit.init("hGETS", "GETS hits");
-            profGETXHit.init("hGETX", "GETX hits");
-            profGETSMiss.init("mGETS", "GETS misses");
-            profGETXMissIM.init("mGETXIM", "GETX I->M misses");
-            profGETXMissSM.init("mGETXSM", "GETX S->M misses (upgrade misses)");
-            profPUTS.init("PUTS", "Clean evictions (from lower level)");
-            profPUTX.init("PUTX", "Dirty evictions (from lower level)");
-            profINV.init("INV", "Invalidates (from upper level)");
-            profINVX.init("INVX", "Downgrades (from upper level)");
-            profFWD.init("FWD", "Forwards (from upper level)");
-            profGETNextLevelLat.init("latGETnl", "GET request latency on next level");
-            profGETNetLat.init("latGETnet", "GET request latency on network to next level");
-
-
-            profFirstTimeMiss.init("firstTimeMiss", "Number of first time misses on shared data");
-            profIcacheFirstTimeMiss.init("firstTimeMissIcache", "Number of instruction cache first time misses on shared data");
-            profDcacheFirstTimeMiss.init("firstTimeMissDcache", "Number of data cache first time misses on shared data");
-            profRXPFirstTimeMiss.init("firstTimeMissRXP", "Number of RXP first time misses on shared data");
-            profRPFirstTimeMiss.init("firstTimeMissRP", "Number of RP first time misses on shared data");
-            profRWPFirstTimeMiss.init("firstTimeMissRWP", "Number of RWP first time misses on shared data");
-            profRWXPFirstTimeMiss.init("firstTimeMissRWXP", "Number of RWXP first time misses on shared data");
-
-            profBinaryFirstTimeMiss.init("BinaryFirstTimeMiss", "Number of first time misses in the binary");
-            profHeapFirstTimeMiss.init("HeapFirstTimeMiss", "Number of first time misses in the heap");
-            profSLFirstTimeMiss.init("SLFirstTimeMiss", "Number of first time misses in shared library");
-            profMMAPFirstTimeMiss.init("MMAPFirstTimeMiss", "Number of first time misses in MMAP'ed region");
-            profSTACKFirstTimeMiss.init("STACKFirstTimeMiss", "Number of first time misses in the stack");
-            profVVARFirstTimeMiss.init("VVARFirstTimeMiss", "Number of first time misses in VVAR");
-            profVDSOFirstTimeMiss.init("VDSOFirstTimeMiss", "Number of first time misses in VDSO");
-            profVSYSCALLFirstTimeMiss.init("VSYSCALLFirstTimeMiss", "Number of first time misses in VSYSCALL");
+        //shards: number of distinct requesters expected to update these counters concurrently
+        void initStats(AggregateStat* parentStat, uint32_t shards) {
+            profGETSHit.init("hGETS", "GETS hits", shards);
+            profGETXHit.init("hGETX", "GETX hits", shards);
+            profGETSMiss.init("mGETS", "GETS misses", shards);
+            profGETXMissIM.init("mGETXIM", "GETX I->M misses", shards);
+            profGETXMissSM.init("mGETXSM", "GETX S->M misses (upgrade misses)", shards);
+            profPUTS.init("PUTS", "Clean evictions (from lower level)", shards);
+            profPUTX.init("PUTX", "Dirty evictions (from lower level)", shards);
+            profINV.init("INV", "Invalidates (from upper level)", shards);
+            profINVX.init("INVX", "Downgrades (from upper level)", shards);
+            profFWD.init("FWD", "Forwards (from upper level)", shards);
+            profGETNextLevelLat.init("latGETnl", "GET request latency on next level", shards);
+            profGETNetLat.init("latGETnet", "GET request latency on network to next level", shards);
+
+
+            profFirstTimeMiss.init("firstTimeMiss", "Number of first time misses on shared data", shards);
+            profIcacheFirstTimeMiss.init("firstTimeMissIcache", "Number of instruction cache first time misses on shared data", shards);
+            profDcacheFirstTimeMiss.init("firstTimeMissDcache", "Number of data cache first time misses on shared data", shards);
+            profRXPFirstTimeMiss.init("firstTimeMissRXP", "Number of RXP first time misses on shared data", shards);
+            profRPFirstTimeMiss.init("firstTimeMissRP", "Number of RP first time misses on shared data", shards);
+            profRWPFirstTimeMiss.init("firstTimeMissRWP", "Number of RWP first time misses on shared data", shards);
+            profRWXPFirstTimeMiss.init("firstTimeMissRWXP", "Number of RWXP first time misses on shared data", shards);
+
+            profBinaryFirstTimeMiss.init("BinaryFirstTimeMiss", "Number of first time misses in the binary", shards);
+            profHeapFirstTimeMiss.init("HeapFirstTimeMiss", "Number of first time misses in the heap", shards);
+            profSLFirstTimeMiss.init("SLFirstTimeMiss", "Number of first time misses in shared library", shards);
+            profMMAPFirstTimeMiss.init("MMAPFirstTimeMiss", "Number of first time misses in MMAP'ed region", shards);
+            profSTACKFirstTimeMiss.init("STACKFirstTimeMiss", "Number of first time misses in the stack", shards);
+            profVVARFirstTimeMiss.init("VVARFirstTimeMiss", "Number of first time misses in VVAR", shards);
+            profVDSOFirstTimeMiss.init("VDSOFirstTimeMiss", "Number of first time misses in VDSO", shards);
+            profVSYSCALLFirstTimeMiss.init("VSYSCALLFirstTimeMiss", "Number of first time misses in VSYSCALL", shards);
 
             parentStat->append(&profGETSHit);
             parentStat->append(&profGETXHit);
@@ -254,6 +284,10 @@ class MESIBottomCC : public GlobAlloc {
             parentStat->append(&profFWD);
             parentStat->append(&profGETNextLevelLat);
             parentStat->append(&profGETNetLat);
+            if (zinfo->hostPlacement) {
+                profRemoteGETs.init("remGETs", "GETs sent to a parent on a different host node", shards);
+                parentStat->append(&profRemoteGETs);
+            }
 
 
             parentStat->append(&profFirstTimeMiss);
@@ -281,7 +315,7 @@ class MESIBottomCC : public GlobAlloc {
 
         void processWritebackOnAccess(Address lineAddr, uint32_t lineId, AccessType type);
 
-        void processInval(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback);
+        void processInval(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint32_t srcId);
 
         uint64_t processNonInclusiveWriteback(Address lineAddr, AccessType type, uint64_t cycle, MESIState* state, uint32_t srcId, uint32_t flags);
 
@@ -298,6 +332,20 @@ class MESIBottomCC : public GlobAlloc {
             return array[lineId] != I;
         }
 
+        void setRemoteParents(const g_vector<uint8_t>& remote) {
+            assert(remote.size() == parents.size());
+            remoteParents = remote;
+        }
+
+        /* Interaction counts (see CC) */
+        uint64_t getCoherenceEvents() const {
+            return profINV.get() + profINVX.get() + profFWD.get();
+        }
+
+        uint64_t getFills() const {
+            return profGETSMiss.get() + profGETXMissIM.get();
+        }
+
         //Could extend with isExclusive, isDirty, etc, but not needed for now.
 
     private:
@@ -337,6 +385,11 @@ class MESITopCC : public GlobAlloc {
 
         bool nonInclusiveHack;
 
+        //Profiling counters
+        ShardedCounter profPrivGETS; //GETS on lines no child has, granted in E
+        ShardedCounter profPrivGETX; //GETX on lines no other child has, so there is nothing to invalidate
+        ShardedCounter profSoleSharerInvs; //invalidates/downgrades sent to a single sharer
+
         PAD();
         lock_t ccLock;
         PAD();
@@ -369,6 +422,15 @@ class MESITopCC : public GlobAlloc {
         void evictAddr(Address lineAddr, uint32_t lineId);
         void init(const g_vector<BaseCache*>& _children, Network* network, const char* name);
 
+        void initStats(AggregateStat* parentStat) {
+            profPrivGETS.init("privGETS", "GETS on lines no child has, granted in E", numRequesterShards());
+            profPrivGETX.init("privGETX", "GETX on lines no other child has (no invalidations needed)", numRequesterShards());
+            profSoleSharerInvs.init("soleShInv", "Invalidates/downgrades to a single sharer", numRequesterShards());
+            parentStat->append(&profPrivGETS);
+            parentStat->append(&profPrivGETX);
+            parentStat->append(&profSoleSharerInvs);
+        }
+
         uint64_t processEviction(Address wbLineAddr, uint32_t lineId, bool* reqWriteback, uint64_t cycle, uint32_t srcId);
 
         uint64_t processAccess(Address lineAddr, uint32_t lineId, AccessType type, uint32_t childId, bool haveExclusive,
@@ -394,6 +456,10 @@ class MESITopCC : public GlobAlloc {
             return array[lineId].sharers[srcId];
         }
 
+        uint32_t getNumChildren() const {
+            return children.size();
+        }
+
 
     private:
         uint64_t sendInvalidates(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId);
@@ -444,57 +510,57 @@ class MESICC : public CC {
            return tcc->checkSameOwner(lineAddr, lineId, srcId);
         };
 
-        void incrementFirstTimeMiss(){
-          bcc->profFirstTimeMiss.inc();
+        void incrementFirstTimeMiss(uint32_t srcId){
+          bcc->profFirstTimeMiss.inc(srcId);
         }
 
-        void incrementIcacheFirstTimeMiss(){
-          bcc->profIcacheFirstTimeMiss.inc();
+        void incrementIcacheFirstTimeMiss(uint32_t srcId){
+          bcc->profIcacheFirstTimeMiss.inc(srcId);
         }
 
-        void incrementDcacheFirstTimeMiss(){
-          bcc->profDcacheFirstTimeMiss.inc();
+        void incrementDcacheFirstTimeMiss(uint32_t srcId){
+          bcc->profDcacheFirstTimeMiss.inc(srcId);
         }
 
-        void incrementRXPFirstTimeMiss(){
-          bcc->profRXPFirstTimeMiss.inc();
+        void incrementRXPFirstTimeMiss(uint32_t srcId){
+          bcc->profRXPFirstTimeMiss.inc(srcId);
         };
 
-        void incrementRWPFirstTimeMiss(){
-          bcc->profRWPFirstTimeMiss.inc();
+        void incrementRWPFirstTimeMiss(uint32_t srcId){
+          bcc->profRWPFirstTimeMiss.inc(srcId);
         };
 
-        void incrementRPFirstTimeMiss(){
-          bcc->profRPFirstTimeMiss.inc();
+        void incrementRPFirstTimeMiss(uint32_t srcId){
+          bcc->profRPFirstTimeMiss.inc(srcId);
         };
 
-        void incrementRWXPFirstTimeMiss(){
-          bcc->profRWXPFirstTimeMiss.inc();
+        void incrementRWXPFirstTimeMiss(uint32_t srcId){
+          bcc->profRWXPFirstTimeMiss.inc(srcId);
         };
 
-        void incrementBinaryFirstTimeMiss(){
-          bcc->profBinaryFirstTimeMiss.inc();
+        void incrementBinaryFirstTimeMiss(uint32_t srcId){
+          bcc->profBinaryFirstTimeMiss.inc(srcId);
         };
-        void incrementHeapFirstTimeMiss(){
-          bcc->profHeapFirstTimeMiss.inc();
+        void incrementHeapFirstTimeMiss(uint32_t srcId){
+          bcc->profHeapFirstTimeMiss.inc(srcId);
         };
-        void incrementSLFirstTimeMiss(){
-          bcc->profSLFirstTimeMiss.inc();
+        void incrementSLFirstTimeMiss(uint32_t srcId){
+          bcc->profSLFirstTimeMiss.inc(srcId);
         };
-        void incrementMMAPFirstTimeMiss(){
-          bcc->profMMAPFirstTimeMiss.inc();
+        void incrementMMAPFirstTimeMiss(uint32_t srcId){
+          bcc->profMMAPFirstTimeMiss.inc(srcId);
         };
-        void incrementSTACKFirstTimeMiss(){
-          bcc->profSTACKFirstTimeMiss.inc();
+        void incrementSTACKFirstTimeMiss(uint32_t srcId){
+          bcc->profSTACKFirstTimeMiss.inc(srcId);
         };
-        void incrementVVARFirstTimeMiss(){
-          bcc->profVVARFirstTimeMiss.inc();
+        void incrementVVARFirstTimeMiss(uint32_t srcId){
+          bcc->profVVARFirstTimeMiss.inc(srcId);
         };
-        void incrementVDSOFirstTimeMiss(){
-          bcc->profVDSOFirstTimeMiss.inc();
+        void incrementVDSOFirstTimeMiss(uint32_t srcId){
+          bcc->profVDSOFirstTimeMiss.inc(srcId);
         };
-        void incrementVSYSCALLFirstTimeMiss(){
-          bcc->profVSYSCALLFirstTimeMiss.inc();
+        void incrementVSYSCALLFirstTimeMiss(uint32_t srcId){
+          bcc->profVSYSCALLFirstTimeMiss.inc(srcId);
         };
 
 
@@ -516,8 +582,8 @@ class MESICC : public CC {
         }
 
         void initStats(AggregateStat* cacheStat) {
-            //no tcc stats
-            bcc->initStats(cacheStat);
+            bcc->initStats(cacheStat, numRequesterShards());
+            tcc->initStats(cacheStat);
         }
 
 
@@ -704,7 +770,7 @@ class MESICC : public CC {
 
         uint64_t processInv(const InvReq& req, int32_t lineId, uint64_t startCycle) {
             uint64_t respCycle = tcc->processInval(req.lineAddr, lineId, req.type, req.writeback, startCycle, req.srcId); //send invalidates or downgrades to children
-            bcc->processInval(req.lineAddr, lineId, req.type, req.writeback); //adjust our own state
+            bcc->processInval(req.lineAddr, lineId, req.type, req.writeback, req.srcId); //adjust our own state
 
             bcc->unlock();
             return respCycle;
@@ -714,6 +780,17 @@ class MESICC : public CC {
         uint32_t numSharers(uint32_t lineId) {return tcc->numSharers(lineId);}
         bool isSharer(uint32_t lineId, uint32_t srcId) {return tcc->isSharer(lineId,srcId);}
         bool isValid(uint32_t lineId) {return bcc->isValid(lineId);}
+
+        void getReplState(uint32_t firstLineId, uint32_t numLines, uint32_t* sharers, uint32_t* valid) {
+            for (uint32_t i = 0; i < numLines; i++) {
+                sharers[i] = tcc->numSharers(firstLineId + i);
+                valid[i] = bcc->isValid(firstLineId + i);
+            }
+        }
+
+        uint64_t getCoherenceEvents() const {return bcc->getCoherenceEvents();}
+        uint64_t getFills() const {return bcc->getFills();}
+        void setRemoteParents(const g_vector<uint8_t>& remote) {bcc->setRemoteParents(remote);}
 };
 
 // Terminal CC, i.e., without children --- accepts GETS/X, but not PUTS/X
@@ -737,7 +814,7 @@ class MESITerminalCC : public CC {
         }
 
         void initStats(AggregateStat* cacheStat) {
-            bcc->initStats(cacheStat);
+            bcc->initStats(cacheStat, 1); //private, only its core updates it
         }
 
         //Access methods
@@ -794,7 +871,7 @@ class MESITerminalCC : public CC {
         }
 
         uint64_t processInv(const InvReq& req, int32_t lineId, uint64_t startCycle) {
-            bcc->processInval(req.lineAddr, lineId, req.type, req.writeback); //adjust our own state
+            bcc->processInval(req.lineAddr, lineId, req.type, req.writeback, req.srcId); //adjust our own state
             bcc->unlock();
             return startCycle; //no extra delay in terminal caches
         }
@@ -814,6 +891,17 @@ class MESITerminalCC : public CC {
         uint32_t numSharers(uint32_t lineId) {return 0;} //no sharers
         bool isSharer(uint32_t lineId, uint32_t srcId) {return 0;} //no sharers
         bool isValid(uint32_t lineId) {return bcc->isValid(lineId);}
+
+        void getReplState(uint32_t firstLineId, uint32_t numLines, uint32_t* sharers, uint32_t* valid) {
+            for (uint32_t i = 0; i < numLines; i++) {
+                sharers[i] = 0;
+                valid[i] = bcc->isValid(firstLineId + i);
+            }
+        }
+
+        uint64_t getCoherenceEvents() const {return bcc->getCoherenceEvents();}
+        uint64_t getFills() const {return bcc->getFills();}
+        void setRemoteParents(const g_vector<uint8_t>& remote) {bcc->setRemoteParents(remote);}
 };
 
 #endif  // COHERENCE_CTRLS_H_
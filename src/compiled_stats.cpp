@@ -0,0 +1,156 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "compiled_stats.h"
+#include <string.h>
+#include <typeinfo>
+#include "log.h"
+
+CompiledStats::CompiledStats(AggregateStat* rootStat, bool _skipVectors, bool _sumRegularAggregates) :
+    skipVectors(_skipVectors), sumRegularAggregates(_sumRegularAggregates)
+{
+    uint32_t dst = 0;
+    compile(rootStat, dst, false);
+    recordSize = dst;
+}
+
+void CompiledStats::emit(OpKind kind, bool accumulate, uint32_t dst, uint32_t width, const void* src, const uint64_t* gatherPtr) {
+    if (!ops.empty()) {
+        // Extend the previous op if this one continues it
+        Op& last = ops.back();
+        bool adjacent = last.accumulate == accumulate && last.dst + last.width == dst;
+        if (adjacent && kind == OP_GATHER && last.kind == OP_GATHER) {
+            gatherPtrs.push_back(gatherPtr); //last's pointers are at the end of gatherPtrs
+            last.width++;
+            return;
+        }
+        if (adjacent && kind == OP_SPAN && last.kind == OP_SPAN && static_cast<const uint64_t*>(last.src) + last.width == src) {
+            last.width += width;
+            return;
+        }
+    }
+
+    Op op;
+    op.kind = kind;
+    op.accumulate = accumulate;
+    op.dst = dst;
+    op.width = width;
+    op.gatherIdx = gatherPtrs.size();
+    op.src = src;
+    if (kind == OP_GATHER) gatherPtrs.push_back(gatherPtr);
+    ops.push_back(op);
+}
+
+// Same walk (and skipping rules) the backends used to do on every dump
+void CompiledStats::compile(Stat* s, uint32_t& dst, bool accumulate) {
+    if (skipVectors && dynamic_cast<VectorStat*>(s)) return;
+    if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
+        if (as->isRegular() && sumRegularAggregates) {
+            uint32_t start = dst;
+            compile(as->get(0), dst, accumulate);
+            for (uint32_t i = 1; i < as->size(); i++) {
+                uint32_t childDst = start;
+                compile(as->get(i), childDst, true);
+                assert(childDst == dst);
+            }
+        } else {
+            for (uint32_t i = 0; i < as->size(); i++) {
+                compile(as->get(i), dst, accumulate);
+            }
+        }
+    } else if (ScalarStat* ss = dynamic_cast<ScalarStat*>(s)) {
+        // Exact types only, subclasses may override get()
+        const std::type_info& type = typeid(*ss);
+        if (type == typeid(Counter)) {
+            emit(OP_GATHER, accumulate, dst, 1, nullptr, &static_cast<Counter*>(ss)->_count);
+        } else if (type == typeid(ProxyStat) && static_cast<ProxyStat*>(ss)->_statPtr) {
+            emit(OP_GATHER, accumulate, dst, 1, nullptr, static_cast<ProxyStat*>(ss)->_statPtr);
+        } else if (type == typeid(ShardedCounter)) {
+            emit(OP_SHARDED, accumulate, dst, 1, ss);
+        } else {
+            emit(OP_SCALAR, accumulate, dst, 1, ss);
+        }
+        dst++;
+    } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
+        if (!vs->size()) return;
+        if (typeid(*vs) == typeid(VectorCounter)) {
+            emit(OP_SPAN, accumulate, dst, vs->size(), &static_cast<VectorCounter*>(vs)->_counters[0]);
+        } else {
+            emit(OP_VECTOR, accumulate, dst, vs->size(), vs);
+        }
+        dst += vs->size();
+    } else {
+        panic("Unrecognized stat type");
+    }
+}
+
+void CompiledStats::dump(uint64_t* out) const {
+    for (const Op& op : ops) {
+        uint64_t* o = out + op.dst;
+        switch (op.kind) {
+            case OP_GATHER:
+                {
+                    const uint64_t* const* p = &gatherPtrs[op.gatherIdx];
+                    if (op.accumulate) {
+                        for (uint32_t i = 0; i < op.width; i++) o[i] += *p[i];
+                    } else {
+                        for (uint32_t i = 0; i < op.width; i++) o[i] = *p[i];
+                    }
+                }
+                break;
+            case OP_SPAN:
+                {
+                    const uint64_t* p = static_cast<const uint64_t*>(op.src);
+                    if (op.accumulate) {
+                        for (uint32_t i = 0; i < op.width; i++) o[i] += p[i];
+                    } else {
+                        memcpy(o, p, op.width*sizeof(uint64_t));
+                    }
+                }
+                break;
+            case OP_SHARDED:
+                {
+                    uint64_t v = static_cast<const ShardedCounter*>(op.src)->ShardedCounter::get(); //non-virtual
+                    *o = op.accumulate? *o + v : v;
+                }
+                break;
+            case OP_SCALAR:
+                {
+                    uint64_t v = static_cast<const ScalarStat*>(op.src)->get();
+                    *o = op.accumulate? *o + v : v;
+                }
+                break;
+            case OP_VECTOR:
+                {
+                    const VectorStat* vs = static_cast<const VectorStat*>(op.src);
+                    for (uint32_t i = 0; i < op.width; i++) {
+                        uint64_t v = vs->count(i);
+                        o[i] = op.accumulate? o[i] + v : v;
+                    }
+                }
+                break;
+        }
+    }
+}
@@ -0,0 +1,81 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMPILED_STATS_H_
+#define COMPILED_STATS_H_
+
+#include <stdint.h>
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "stats.h"
+
+/* Flattened, dump-ready form of a (immutable) stats tree.
+ *
+ * Backends dump the same tree thousands of times, so instead of walking it
+ * with dynamic_casts at every node, we compile it once into a linear list of
+ * ops, each of which fills a range of the output record:
+ * - Runs of Counters and ProxyStats become a single gather over their raw
+ *   values, and VectorCounters become memcpy-able spans.
+ * - ShardedCounters are summed inline (no virtual call).
+ * - Other stats (e.g., lambdas, breakdowns) keep their virtual get()/count().
+ * Regular aggregates can be summed: the ops of children 1..n-1 accumulate on
+ * the output range of child 0, in walk order.
+ *
+ * The output record has the same layout as the in-order walk the backends
+ * used to do, so it can be written as is.
+ */
+class CompiledStats : public GlobAlloc {
+    private:
+        enum OpKind {OP_GATHER, OP_SPAN, OP_SHARDED, OP_SCALAR, OP_VECTOR};
+
+        struct Op {
+            OpKind kind;
+            bool accumulate; //add to the output instead of overwriting it
+            uint32_t dst; //offset in the output record
+            uint32_t width; //elements written
+            uint32_t gatherIdx; //OP_GATHER: first pointer in gatherPtrs
+            const void* src; //OP_SPAN: const uint64_t*; others: the stat
+        };
+
+        g_vector<Op> ops;
+        g_vector<const uint64_t*> gatherPtrs;
+        uint32_t recordSize; //in uint64_ts
+        bool skipVectors;
+        bool sumRegularAggregates;
+
+        void compile(Stat* s, uint32_t& dst, bool accumulate);
+        void emit(OpKind kind, bool accumulate, uint32_t dst, uint32_t width, const void* src, const uint64_t* gatherPtr = nullptr);
+
+    public:
+        CompiledStats(AggregateStat* rootStat, bool skipVectors, bool sumRegularAggregates);
+
+        uint32_t size() const {return recordSize;}
+        uint32_t numOps() const {return ops.size();}
+
+        // Fills out[0..size())
+        void dump(uint64_t* out) const;
+};
+
+#endif  // COMPILED_STATS_H_
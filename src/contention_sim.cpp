@@ -31,6 +31,7 @@
 #include <typeinfo>
 #include <unordered_map>
 #include <vector>
+#include "host_placement.h"
 #include "log.h"
 #include "ooo_core.h"
 #include "timing_core.h"
@@ -58,10 +59,20 @@ void ContentionSim::SimThreadTrampoline(void* arg) {
     csim->simThreadLoop(thid);
 }
 
-ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
+ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads, bool _workStealing, uint32_t _stealSlice, uint32_t _ringSize) {
     numDomains = _numDomains;
     numSimThreads = _numSimThreads;
+    workStealing = _workStealing;
+    stealSlice = _stealSlice;
+    ringSize = _ringSize;
+    xingRings = nullptr;
+    numRingSrcs = 0;
     threadsDone = 0;
+    domainsFinished = 0;
+    adaptiveSkip = false;
+    recording = true;
+    lastCoreInstrs = nullptr;
+    savedRecorders = nullptr;
     limit = 0;
     lastLimit = 0;
     inCSim = false;
@@ -73,15 +84,22 @@ ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
         new (&domains[i].pq) PrioQueue<TimingEvent, PQ_BLOCKS>();
         domains[i].curCycle = 0;
         futex_init(&domains[i].pqLock);
+        domains[i].claimed = 0;
+        domains[i].finished = false;
+        domains[i].drained = false;
     }
 
-    if ((numDomains % numSimThreads) != 0) panic("numDomains(%d) must be a multiple of numSimThreads(%d) for now", numDomains, numSimThreads);
+    //With work stealing, the static assignment only gives each thread its preferred (home) domains
+    if (!workStealing && (numDomains % numSimThreads) != 0) panic("numDomains(%d) must be a multiple of numSimThreads(%d) for now", numDomains, numSimThreads);
+    if (workStealing && stealSlice == 0) panic("Work-stealing contention simulation needs a non-zero slice");
+    if (ringSize && !isPow2(ringSize)) panic("Crossing ring size (%d) must be a power of 2", ringSize);
 
     for (uint32_t i = 0; i < numSimThreads; i++) {
         futex_init(&simThreads[i].wakeLock);
         futex_lock(&simThreads[i].wakeLock); //starts locked, so first actual call to lock blocks
         simThreads[i].firstDomain = i*numDomains/numSimThreads;
         simThreads[i].supDomain = (i+1)*numDomains/numSimThreads;
+        for (uint32_t d = simThreads[i].firstDomain; d < simThreads[i].supDomain; d++) domains[d].homeThread = i;
     }
 
     futex_init(&waitLock);
@@ -100,20 +118,50 @@ ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
     lastCrossing = gm_calloc<CrossingEventInfo>(numDomains*numDomains*MAX_THREADS); //TODO: refine... this allocs too much
 }
 
+void ContentionSim::setAdaptiveSkip(double threshold, uint32_t window, uint32_t maxSkip, double changeThreshold) {
+    if (window == 0 || maxSkip < window) panic("Adaptive contention skipping needs 0 < window (%d) <= maxSkip (%d)", window, maxSkip);
+    adaptiveSkip = true;
+    skipThreshold = threshold;
+    skipWindow = window;
+    maxSkipPhases = maxSkip;
+    skipChangeThreshold = changeThreshold;
+    lowPhases = 0;
+    lowPhaseInstrs = 0;
+    refPhaseInstrs = 0;
+    skipLeft = 0;
+    skipLen = window;
+    lastContentionCycles = 0;
+}
+
 void ContentionSim::postInit() {
+    skipContention = true;
     for (uint32_t i = 0; i < zinfo->numCores; i++) {
         TimingCore* tcore = dynamic_cast<TimingCore*>(zinfo->cores[i]);
-        if (tcore) {
-            skipContention = false;
-            return;
-        }
         OOOCore* ocore = dynamic_cast<OOOCore*>(zinfo->cores[i]);
-        if (ocore) {
+        if (tcore || ocore) {
             skipContention = false;
-            return;
+            break;
         }
     }
-    skipContention = true;
+
+    if (adaptiveSkip && !skipContention) {
+        lastCoreInstrs = gm_calloc<uint64_t>(zinfo->numCores);
+        savedRecorders = gm_calloc<EventRecorder*>(zinfo->numCores);
+        for (uint32_t i = 0; i < zinfo->numCores; i++) savedRecorders[i] = zinfo->eventRecorders[i];
+    }
+
+    //Crossing sources are the cores' event recorders, so we can only size the rings now
+    if (ringSize && !skipContention) {
+        numRingSrcs = zinfo->numCores;
+        CrossingRing* rings = gm_calloc<CrossingRing>(numDomains*numRingSrcs);
+        for (uint32_t i = 0; i < numDomains*numRingSrcs; i++) {
+            rings[i].head = 0;
+            rings[i].tail = 0;
+            rings[i].buf = gm_calloc<CrossingEventInfo>(ringSize);
+            rings[i].spills = 0;
+        }
+        xingRings = rings;
+    }
 }
 
 void ContentionSim::initStats(AggregateStat* parentStat) {
@@ -124,22 +172,72 @@ void ContentionSim::initStats(AggregateStat* parentStat) {
         ss << "domain-" << i;
         AggregateStat* domStat = new AggregateStat();
         domStat->init(gm_strdup(ss.str().c_str()), "Domain stats");
-#if PROFILE_CROSSINGS
         new (&domains[i].profIncomingCrossings) VectorCounter();
         new (&domains[i].profIncomingCrossingSims) VectorCounter();
         new (&domains[i].profIncomingCrossingHist) VectorCounter();
+        new (&domains[i].profBatchedCrossings) Counter();
+        new (&domains[i].profCrossingBatchHist) VectorCounter();
         domains[i].profIncomingCrossings.init("ixe", "Incoming crossing events", numDomains);
         domains[i].profIncomingCrossingSims.init("ixs", "Incoming crossings simulated but held", numDomains);
         domains[i].profIncomingCrossingHist.init("ixh", "Incoming crossings held count histogram", 33 /*32 means >31*/);
+        domains[i].profBatchedCrossings.init("ixb", "Incoming crossings delivered through rings");
+        domains[i].profCrossingBatchHist.init("ixbh", "Ring drain batch size histogram (log2 buckets)", XING_BATCH_BUCKETS);
         domStat->append(&domains[i].profIncomingCrossings);
         domStat->append(&domains[i].profIncomingCrossingSims);
         domStat->append(&domains[i].profIncomingCrossingHist);
-#endif
+        domStat->append(&domains[i].profBatchedCrossings);
+        domStat->append(&domains[i].profCrossingBatchHist);
+        auto spills = [this, i]() -> uint64_t {
+            uint64_t res = 0;
+            if (xingRings) {
+                for (uint32_t s = 0; s < numRingSrcs; s++) res += xingRings[i*numRingSrcs + s].spills;
+            }
+            return res;
+        };
+        auto spillStat = makeLambdaStat(spills);
+        spillStat->init("ixspill", "Incoming crossings queued synced because their ring was full");
+        domStat->append(spillStat);
         new (&domains[i].profTime) ClockStat();
         domains[i].profTime.init("time", "Weave simulation time");
         domStat->append(&domains[i].profTime);
         objStat->append(domStat);
     }
+    if (workStealing) {
+        for (uint32_t i = 0; i < numSimThreads; i++) {
+            std::stringstream ss;
+            ss << "thread-" << i;
+            AggregateStat* thStat = new AggregateStat();
+            thStat->init(gm_strdup(ss.str().c_str()), "Weave thread stats");
+            new (&simThreads[i].profState) TimeBreakdownStat();
+            new (&simThreads[i].profSlices) Counter();
+            new (&simThreads[i].profStolenSlices) Counter();
+            const char* stateNames[] = {"outside", "busy", "idle"};
+            simThreads[i].profState.init("state", "Time spent outside weave, simulating events, and idle in weave (ns)", 3, stateNames);
+            simThreads[i].profSlices.init("slices", "Domain time slices simulated");
+            simThreads[i].profStolenSlices.init("stolen", "Domain time slices simulated on a domain from another thread's static set");
+            thStat->append(&simThreads[i].profState);
+            thStat->append(&simThreads[i].profSlices);
+            thStat->append(&simThreads[i].profStolenSlices);
+            objStat->append(thStat);
+        }
+    }
+    if (adaptiveSkip) {
+        profRecordedPhases.init("recPhases", "Phases with memory event recording (full weave)");
+        profSkippedPhases.init("skipPhases", "Phases with memory event recording skipped (low contention)");
+        profSkipEpisodes.init("skips", "Times event recording was turned off");
+        profSkipChangeExits.init("skipChangeExits", "Skips ended early by a change in per-phase instructions");
+        objStat->append(&profRecordedPhases);
+        objStat->append(&profSkippedPhases);
+        objStat->append(&profSkipEpisodes);
+        objStat->append(&profSkipChangeExits);
+        auto activeFrac = [this]() -> uint64_t {
+            uint64_t total = profRecordedPhases.get() + profSkippedPhases.get();
+            return total? 1000*profRecordedPhases.get()/total : 1000;
+        };
+        auto activeStat = makeLambdaStat(activeFrac);
+        activeStat->init("weaveActive", "Fraction of phases with full weave, in per mille");
+        objStat->append(activeStat);
+    }
     parentStat->append(objStat);
 }
 
@@ -157,6 +255,13 @@ void ContentionSim::simulatePhase(uint64_t limit) {
         if (ocore) ocore->cSimStart();
     }
 
+    for (uint32_t i = 0; i < numDomains; i++) domains[i].drained = false;
+
+    if (workStealing) {
+        for (uint32_t i = 0; i < numDomains; i++) domains[i].finished = false;
+        domainsFinished = 0;
+    }
+
     inCSim = true;
     __sync_synchronize();
 
@@ -178,19 +283,93 @@ void ContentionSim::simulatePhase(uint64_t limit) {
         if (ocore) ocore->cSimEnd();
     }
 
+    if (adaptiveSkip) adaptContention();
+
     lastLimit = limit;
     __sync_synchronize();
 }
 
+/* Adaptive contention skipping. At the end of each phase, we measure how much
+ * delay weave added, as the increase in the cores' contention cycles per active
+ * core cycle. After skipWindow consecutive phases below skipThreshold, we stop
+ * recording memory events for skipLen phases, so the bound phase runs
+ * contention-free and weave only simulates the cores' own (few) events. A skip
+ * ends early if the per-phase instruction count moves by more than
+ * skipChangeThreshold, which catches program phase changes. Once it ends,
+ * recording is back on, and if contention is still low after skipWindow
+ * phases, the next skip is twice as long (up to maxSkipPhases).
+ */
+void ContentionSim::adaptContention() {
+    uint64_t contentionCycles = 0;
+    uint64_t phaseInstrs = 0;
+    uint32_t activeCores = 0;
+    for (uint32_t i = 0; i < zinfo->numCores; i++) {
+        uint64_t instrs = zinfo->cores[i]->getInstrs();
+        if (instrs != lastCoreInstrs[i]) activeCores++;
+        phaseInstrs += instrs - lastCoreInstrs[i];
+        lastCoreInstrs[i] = instrs;
+
+        TimingCore* tcore = dynamic_cast<TimingCore*>(zinfo->cores[i]);
+        if (tcore) contentionCycles += tcore->getContentionCycles();
+        OOOCore* ocore = dynamic_cast<OOOCore*>(zinfo->cores[i]);
+        if (ocore) contentionCycles += ocore->getContentionCycles();
+    }
+    uint64_t phaseContentionCycles = contentionCycles - lastContentionCycles;
+    lastContentionCycles = contentionCycles;
+
+    if (recording) {
+        profRecordedPhases.inc();
+        double delay = activeCores? ((double)phaseContentionCycles)/((double)activeCores*zinfo->phaseLength) : 0.0;
+        if (delay < skipThreshold) {
+            lowPhases++;
+            lowPhaseInstrs += phaseInstrs;
+        } else {
+            lowPhases = 0;
+            lowPhaseInstrs = 0;
+            skipLen = skipWindow; //contention is back, restart the backoff
+        }
+
+        if (lowPhases >= skipWindow) {
+            refPhaseInstrs = lowPhaseInstrs/lowPhases;
+            skipLeft = skipLen;
+            skipLen = MIN(2*skipLen, maxSkipPhases);
+            profSkipEpisodes.inc();
+            setRecording(false);
+        }
+    } else {
+        profSkippedPhases.inc();
+        uint64_t instrDiff = (phaseInstrs > refPhaseInstrs)? phaseInstrs - refPhaseInstrs : refPhaseInstrs - phaseInstrs;
+        bool changed = instrDiff > skipChangeThreshold*MAX(refPhaseInstrs, (uint64_t)1);
+        if (changed) {
+            profSkipChangeExits.inc();
+            skipLen = skipWindow;
+        }
+        if (changed || --skipLeft == 0) {
+            lowPhases = 0;
+            lowPhaseInstrs = 0;
+            setRecording(true);
+        }
+    }
+}
+
+// Called between phases, so no core is in the middle of an access
+void ContentionSim::setRecording(bool enable) {
+    assert(recording != enable);
+    for (uint32_t i = 0; i < zinfo->numCores; i++) {
+        zinfo->eventRecorders[i] = enable? savedRecorders[i] : nullptr;
+    }
+    recording = enable;
+}
+
 void ContentionSim::enqueue(TimingEvent* ev, uint64_t cycle) {
     assert(inCSim);
     assert(ev);
     assert_msg(cycle >= lastLimit, "Enqueued event before last limit! cycle %ld min %ld", cycle, lastLimit);
     //Hacky, but helpful to chase events scheduled too far ahead due to bugs (e.g., cycle -1). We should probably formalize this a bit more
-    assert_msg(cycle < lastLimit+10*zinfo->phaseLength+1000000, "Queued event too far into the future, cycle %ld lastLimit %ld", cycle, lastLimit);
+    assert_msg(cycle < lastLimit+10*zinfo->maxPhaseLength+1000000, "Queued event too far into the future, cycle %ld lastLimit %ld", cycle, lastLimit);
 
     assert_msg(cycle >= domains[ev->domain].curCycle, "Queued event goes back in time, cycle %ld curCycle %ld", cycle, domains[ev->domain].curCycle);
-    ev->privCycle = cycle;
+    ev->cycle = cycle;
     assert(ev->numParents == 0);
     assert(ev->domain != -1);
     assert(ev->domain < (int32_t)numDomains);
@@ -208,8 +387,8 @@ void ContentionSim::enqueueSynced(TimingEvent* ev, uint64_t cycle) {
 
     assert_msg(cycle >= lastLimit, "Enqueued (synced) event before last limit! cycle %ld min %ld", cycle, lastLimit);
     //Hacky, but helpful to chase events scheduled too far ahead due to bugs (e.g., cycle -1). We should probably formalize this a bit more
-    assert_msg(cycle < lastLimit+10*zinfo->phaseLength+10000, "Queued  (synced) event too far into the future, cycle %ld lastLimit %ld", cycle, lastLimit);
-    ev->privCycle = cycle;
+    assert_msg(cycle < lastLimit+10*zinfo->maxPhaseLength+10000, "Queued  (synced) event too far into the future, cycle %ld lastLimit %ld", cycle, lastLimit);
+    ev->cycle = cycle;
     assert(ev->numParents == 0);
     domains[ev->domain].pq.enqueue(ev, cycle);
 
@@ -243,10 +422,25 @@ void ContentionSim::enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t
             assert_msg(last->cycle <= cycle, "last->cycle (%ld) > cycle (%ld)", last->cycle, cycle);
             last->ev->addChild(ev, evRec);
         } else {
-            //We can't queue --- queue directly (synced, we're in phase 1)
+            //We can't chain --- hand it to the destination through our ring, or queue directly (synced, we're in phase 1) if it's full
             assert(cycle >= srcDomCycle);
             //info("Queuing xing %ld %ld (lst eve too old at cycle %ld)", cycle, srcDomCycle, last->cycle);
-            enqueueSynced(ev, cycle);
+            CrossingRing* ring = (srcId < numRingSrcs)? &xingRings[dstDomain*numRingSrcs + srcId] : nullptr;
+            if (ring && ring->tail - ring->head < ringSize) {
+                assert(!inCSim);
+                assert_msg(cycle >= lastLimit, "Enqueued (ring) crossing before last limit! cycle %ld min %ld", cycle, lastLimit);
+                assert_msg(cycle < lastLimit+10*zinfo->maxPhaseLength+10000, "Queued (ring) crossing too far into the future, cycle %ld lastLimit %ld", cycle, lastLimit);
+                assert(ev->numParents == 0);
+                uint32_t tail = ring->tail;
+                CrossingEventInfo& slot = ring->buf[tail & (ringSize-1)];
+                slot.cycle = cycle;
+                slot.ev = ev;
+                __asm__ __volatile__("" ::: "memory"); //fill the slot before publishing it (TSO keeps the stores in order)
+                ring->tail = tail + 1;
+            } else {
+                if (ring) ring->spills++;
+                enqueueSynced(ev, cycle);
+            }
         }
         //Store this one as the last req
         last->cycle = cycle;
@@ -254,20 +448,38 @@ void ContentionSim::enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t
     }
 }
 
+/* Moves the crossings that sources pushed to this domain's rings during the
+ * bound phase into its pq. Called by the thread that simulates the domain,
+ * before it runs any of its events, so the pq needs no lock.
+ */
+void ContentionSim::drainCrossings(uint32_t domain) {
+    DomainData& dom = domains[domain];
+    dom.drained = true;
+    if (!xingRings) return;
+    for (uint32_t s = 0; s < numRingSrcs; s++) {
+        CrossingRing& ring = xingRings[domain*numRingSrcs + s];
+        uint32_t head = ring.head;
+        uint32_t tail = ring.tail;
+        if (head == tail) continue;
+        __asm__ __volatile__("" ::: "memory"); //read the slots after the tail
+        uint32_t batch = tail - head;
+        for (; head != tail; head++) {
+            CrossingEventInfo& slot = ring.buf[head & (ringSize-1)];
+            TimingEvent* ev = slot.ev;
+            ev->cycle = slot.cycle;
+            dom.pq.enqueue(ev, slot.cycle);
+        }
+        __asm__ __volatile__("" ::: "memory");
+        ring.head = head;
+        dom.profBatchedCrossings.inc(batch);
+        dom.profCrossingBatchHist.inc(MIN(ilog2(batch), (uint32_t)XING_BATCH_BUCKETS-1));
+    }
+}
+
 void ContentionSim::simThreadLoop(uint32_t thid) {
     info("Started contention simulation thread %d", thid);
-#if 0
-    //Pin
-    uint32_t nprocs = sysconf(_SC_NPROCESSORS_ONLN);
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    //CPU_SET(domain % nprocs, cpuset); //basically no difference
-    //CPU_SET(0, cpuset); CPU_SET(1, cpuset); CPU_SET(2, cpuset); CPU_SET(3, cpuset); //don't use hyperthreads; confuses the scheduler to no end, does worse
-    CPU_SET(thid % nprocs, &cpuset); CPU_SET((thid % nprocs) + (nprocs/2), &cpuset); //pin to a single core but can use both its hyperthreads, works best (~20% gain)
-    //TODO: Must make this optional, or multiple simulations/machine will work horribly
-    int r = sched_setaffinity(0 /*calling thread, equiv to syscall(SYS_gettid)*/, sizeof(cpuset), &cpuset);
-    assert_msg(r == 0, "sched_setaffinity failed (%d)", r);
-#endif
+    //Pin to the host node of our domains, or anywhere if we steal (optional, so that multiple simulations per machine still work)
+    if (zinfo->hostPlacement && zinfo->hostPlacement->pinsThreads()) zinfo->hostPlacement->pinWeaveThread(thid, simThreads[thid].firstDomain, workStealing);
     while (true) {
         futex_lock_nospin(&simThreads[thid].wakeLock);
 
@@ -276,7 +488,8 @@ void ContentionSim::simThreadLoop(uint32_t thid) {
         }
 
         //info("%d --- phase start", domain);
-        simulatePhaseThread(thid);
+        if (workStealing) simulatePhaseThreadStealing(thid);
+        else simulatePhaseThread(thid);
         //info("%d --- phase end", domain);
 
         uint32_t val = __sync_add_and_fetch(&threadsDone, 1);
@@ -292,6 +505,8 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
     uint32_t thDomains = simThreads[thid].supDomain - simThreads[thid].firstDomain;
     uint32_t numFinished = 0;
 
+    for (uint32_t i = simThreads[thid].firstDomain; i < simThreads[thid].supDomain; i++) drainCrossings(i);
+
     if (thDomains == 1) {
         DomainData& domain = domains[simThreads[thid].firstDomain];
         domain.profTime.start();
@@ -410,6 +625,80 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
     __sync_synchronize();
 }
 
+/* Work-stealing weave. Domains are no longer statically owned: a thread claims
+ * the unclaimed, unfinished domain with the lowest curCycle (preferring its
+ * home domains on ties), simulates up to stealSlice events, and releases it.
+ * A domain stalled on a crossing (prio != 0) is released right away, so its
+ * thread moves on to other work instead of spinning on it.
+ *
+ * Crossing ordering is preserved because it only relies on each domain's
+ * curCycle being monotonic and on a single thread simulating a domain at a
+ * time (all intra-weave enqueues target the domain being simulated); the claim
+ * CAS and the release fence hand the domain's queue over between threads.
+ */
+ContentionSim::DomainData* ContentionSim::claimDomain(uint32_t thid) {
+    while (true) {
+        DomainData* best = nullptr;
+        for (uint32_t i = 0; i < numDomains; i++) {
+            DomainData* d = &domains[i];
+            if (d->claimed || d->finished) continue;
+            if (!best || d->curCycle < best->curCycle ||
+                    (d->curCycle == best->curCycle && d->homeThread == thid && best->homeThread != thid)) {
+                best = d;
+            }
+        }
+        if (!best) return nullptr; //everything is claimed or finished
+        if (__sync_bool_compare_and_swap(&best->claimed, 0, 1)) {
+            if (!best->finished) return best;
+            best->claimed = 0; //finished between the scan and the claim
+        }
+    }
+}
+
+void ContentionSim::simulatePhaseThreadStealing(uint32_t thid) {
+    SimThreadData& th = simThreads[thid];
+    th.profState.transition(ST_IDLE);
+    while (domainsFinished < numDomains) {
+        DomainData* domain = claimDomain(thid);
+        if (!domain) {
+            __asm__ __volatile__("pause");  // all remaining domains are being simulated by other threads
+            continue;
+        }
+
+        th.profState.transition(ST_BUSY);
+        th.profSlices.inc();
+        if (domain->homeThread != thid) th.profStolenSlices.inc();
+        domain->profTime.start(); //only the claiming thread touches it
+        if (!domain->drained) drainCrossings(domain - domains); //first claim this phase
+
+        PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain->pq;
+        for (uint32_t ev = 0; ev < stealSlice; ev++) {
+            if (!pq.size() || pq.firstCycle() > limit) {
+                domain->curCycle = limit;
+                domain->finished = true;
+                __sync_fetch_and_add(&domainsFinished, 1);
+                break;
+            }
+            uint64_t cycle;
+            TimingEvent* te = pq.dequeue(cycle);
+            assert(cycle >= domain->curCycle);
+            if (cycle != domain->curCycle) domain->curCycle = cycle;
+            te->run(cycle);
+            uint64_t newCycle = pq.size()? pq.firstCycle() : limit;
+            domain->curCycle = MIN(newCycle, limit);
+            domain->queuePrio = domain->curCycle;
+            if (domain->prio != 0) break;  // stalled on a crossing, let the source domain make progress
+        }
+
+        domain->profTime.end();
+        __sync_synchronize();  // publish the domain's state before someone else claims it
+        domain->claimed = 0;
+        th.profState.transition(ST_IDLE);
+    }
+    th.profState.transition(ST_OUTSIDE);
+    __sync_synchronize();
+}
+
 void ContentionSim::finish() {
     assert(!terminate);
     terminate = true;
@@ -39,16 +39,15 @@
 #include "profile_stats.h"
 #include "stats.h"
 
-//Set to 1 to produce stats of how many event crossings are generated and run. Useful for debugging, but adds overhead.
-#define PROFILE_CROSSINGS 0
-//#define PROFILE_CROSSINGS 1
-
 class TimingEvent;
 class DelayEvent;
 class CrossingEvent;
 
 #define PQ_BLOCKS 1024
 
+//Buckets of the per-domain crossing batch size histogram (log2 of the batch size, last one is >= 2^(N-1))
+#define XING_BATCH_BUCKETS 8
+
 class ContentionSim : public GlobAlloc {
     private:
         struct CompareEvents : public std::binary_function<TimingEvent*, TimingEvent*, bool> {
@@ -62,6 +61,23 @@ class ContentionSim : public GlobAlloc {
 
         CrossingEventInfo* lastCrossing; //indexed by [srcId*doms*doms + srcDom*doms + dstDom]
 
+        /* Single-producer, single-consumer ring of crossings from one source
+         * (core) to one destination domain. The source's thread pushes in the
+         * bound phase, and the destination domain's weave thread drains it into
+         * the domain's pq before simulating, so neither side takes a lock.
+         */
+        struct CrossingRing {
+            volatile uint32_t head; //written by the consumer (weave)
+            volatile uint32_t tail; //written by the producer (bound phase)
+            CrossingEventInfo* buf;
+            uint64_t spills; //crossings that found the ring full and were queued synced; written by the producer only
+            PAD_SZ(2*sizeof(uint32_t) + sizeof(CrossingEventInfo*) + sizeof(uint64_t));
+        };
+
+        CrossingRing* xingRings; //indexed by [dstDom*numRingSrcs + srcId], so each domain drains contiguous rings
+        uint32_t numRingSrcs;
+        uint32_t ringSize; //entries per ring, power of 2; 0 disables batching (every crossing is queued synced)
+
         struct DomainData : public GlobAlloc {
             PrioQueue<TimingEvent, PQ_BLOCKS> pq;
 
@@ -74,15 +90,22 @@ class ContentionSim : public GlobAlloc {
             uint32_t prio;
             uint64_t queuePrio;
 
+            //Work-stealing mode only: a domain is simulated by at most one thread at a time (the one that claimed it)
+            volatile uint32_t claimed;
+            volatile bool finished;
+            bool drained; //crossing rings already drained this phase
+            uint32_t homeThread;
+
             PAD();
 
             ClockStat profTime;
 
-#if PROFILE_CROSSINGS
+            //Only updated by the thread simulating the domain, so they are cheap enough to always keep
             VectorCounter profIncomingCrossingSims;
             VectorCounter profIncomingCrossings;
             VectorCounter profIncomingCrossingHist;
-#endif
+            Counter profBatchedCrossings;
+            VectorCounter profCrossingBatchHist;
         };
 
         struct CompareDomains : public std::binary_function<DomainData*, DomainData*, bool> {
@@ -95,8 +118,15 @@ class ContentionSim : public GlobAlloc {
             uint32_t supDomain; //supreme, ie first not included
 
             std::vector<std::pair<uint64_t, TimingEvent*> > logVec;
+
+            //Work-stealing mode only
+            TimeBreakdownStat profState; //outside weave / busy simulating / idle (looking for work or spinning)
+            Counter profSlices;
+            Counter profStolenSlices;
         };
 
+        enum SimThreadState {ST_OUTSIDE, ST_BUSY, ST_IDLE};
+
         //RO
         DomainData* domains;
         SimThreadData* simThreads;
@@ -106,6 +136,28 @@ class ContentionSim : public GlobAlloc {
         uint32_t numDomains;
         uint32_t numSimThreads;
         bool skipContention;
+        bool workStealing; //if set, idle threads steal time slices of any domain instead of sticking to their static set
+        uint32_t stealSlice; //max events simulated per domain claim
+
+        //Adaptive contention skipping: when weave adds little delay for a while, stop recording memory events
+        bool adaptiveSkip;
+        bool recording; //if false, zinfo->eventRecorders are nulled, so the memory hierarchy records no events
+        double skipThreshold; //contention cycles per active core cycle below which a phase counts as low-contention
+        uint32_t skipWindow; //consecutive low-contention phases needed to stop recording; also the initial skip length
+        uint32_t maxSkipPhases;
+        double skipChangeThreshold; //relative change in per-phase instructions that ends a skip early
+        uint32_t lowPhases;
+        uint64_t lowPhaseInstrs; //instructions over the current run of low-contention phases
+        uint64_t refPhaseInstrs; //per-phase instructions when we stopped recording
+        uint32_t skipLeft;
+        uint32_t skipLen; //doubles every time a probe confirms low contention, up to maxSkipPhases
+        uint64_t lastContentionCycles;
+        uint64_t* lastCoreInstrs;
+        EventRecorder** savedRecorders;
+        Counter profRecordedPhases;
+        Counter profSkippedPhases;
+        Counter profSkipEpisodes;
+        Counter profSkipChangeExits;
 
         PAD();
 
@@ -116,6 +168,7 @@ class ContentionSim : public GlobAlloc {
         volatile bool terminate;
 
         volatile uint32_t threadsDone;
+        volatile uint32_t domainsFinished; //work-stealing mode only
         volatile uint32_t threadTicket; //used only at init
 
         volatile bool inCSim; //true when inside contention simulation
@@ -126,7 +179,10 @@ class ContentionSim : public GlobAlloc {
         lock_t postMortemLock;
 
     public:
-        ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads);
+        ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads, bool _workStealing = false, uint32_t _stealSlice = 64, uint32_t _ringSize = 64);
+
+        //Must be called before initStats(); threshold is contention cycles per core cycle (e.g., 0.01 = 1%)
+        void setAdaptiveSkip(double threshold, uint32_t window, uint32_t maxSkip, double changeThreshold);
 
         void initStats(AggregateStat* parentStat);
 
@@ -142,6 +198,8 @@ class ContentionSim : public GlobAlloc {
 
         uint64_t getLastLimit() {return lastLimit;}
 
+        bool isSkippingRecording() const {return !recording;}
+
         uint64_t getCurCycle(uint32_t domain) {
             assert(domain < numDomains);
             uint64_t c = domains[domain].curCycle;
@@ -151,17 +209,21 @@ class ContentionSim : public GlobAlloc {
 
         void setPrio(uint32_t domain, uint32_t prio) {domains[domain].prio = prio;}
 
-#if PROFILE_CROSSINGS
+        //Called by the destination domain's thread when a crossing completes
         void profileCrossing(uint32_t srcDomain, uint32_t dstDomain, uint32_t count) {
             domains[dstDomain].profIncomingCrossings.inc(srcDomain);
             domains[dstDomain].profIncomingCrossingSims.inc(srcDomain, count);
             domains[dstDomain].profIncomingCrossingHist.inc(MIN(count, (unsigned)32));
         }
-#endif
 
     private:
         void simThreadLoop(uint32_t thid);
         void simulatePhaseThread(uint32_t thid);
+        void simulatePhaseThreadStealing(uint32_t thid);
+        DomainData* claimDomain(uint32_t thid);
+        void drainCrossings(uint32_t domain);
+        void adaptContention();
+        void setRecording(bool enable);
 
         static void SimThreadTrampoline(void* arg);
 };
@@ -146,6 +146,7 @@ void CoreRecorder::recordAccess(uint64_t startCycle) {
 
 
 uint64_t CoreRecorder::cSimStart(uint64_t curCycle) {
+    eventRecorder.samplePhase();
     if (state == HALTED) return curCycle; //nothing to do
 
     DEBUG_MSG("[%s] Cycle %ld cSimStart %d", name.c_str(), curCycle, state);
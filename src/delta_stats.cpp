@@ -0,0 +1,170 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "compiled_stats.h"
+#include "delta_stats.h"
+#include "galloc.h"
+#include "log.h"
+#include "stats.h"
+#include "zsim.h"
+
+using namespace deltastats;
+
+/* Delta-encoded backend (see delta_stats.h for the format). Dumps copy the
+ * stats into a column-major block buffer; once blockRecords records are
+ * buffered (or on unbuffered dumps), the block is encoded, appended to the
+ * file, and indexed. As with the other backends, dump may be called from
+ * multiple processes, so we reopen the files on every block write.
+ */
+class DeltaBackendImpl : public GlobAlloc {
+    private:
+        const char* filename;
+        const char* indexFilename;
+        AggregateStat* rootStat;
+        bool skipVectors;
+
+        uint32_t numCols; //including the phase column
+        uint32_t blockRecords;
+        CompiledStats* flatStats; //columns 1..numCols-1
+        uint64_t* record; //last dump, row-major
+        uint64_t* block; //column-major, numCols x blockRecords
+        uint32_t bufferedRecords;
+        uint64_t fileBytes; //where the next block goes
+        uint64_t writtenRecords;
+
+        // Same skipping rule as the HDF5 backend
+        bool skipStat(Stat* s) {
+            return skipVectors && dynamic_cast<VectorStat*>(s);
+        }
+
+        void nameWalk(Stat* s, const std::string& prefix, std::vector<std::string>& names) {
+            if (skipStat(s)) return;
+            std::string name = prefix.empty()? s->name() : prefix + "." + s->name();
+            if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
+                for (uint32_t i = 0; i < as->size(); i++) nameWalk(as->get(i), name, names);
+            } else if (dynamic_cast<ScalarStat*>(s)) {
+                names.push_back(name);
+            } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
+                for (uint32_t i = 0; i < vs->size(); i++) {
+                    names.push_back(name + "." + (vs->hasCounterNames()? std::string(vs->counterName(i)) : std::to_string(i)));
+                }
+            } else {
+                panic("Unrecognized stat type");
+            }
+        }
+
+        void writeBlock() {
+            uint32_t n = bufferedRecords;
+            std::vector<uint32_t> offsets(numCols + 1);
+            std::vector<uint8_t> payload;
+            payload.reserve(numCols*4);
+            for (uint32_t c = 0; c < numCols; c++) {
+                offsets[c] = payload.size();
+                encodeColumn(&block[c*blockRecords], n, payload);
+            }
+            offsets[numCols] = payload.size();
+
+            BlockHeader bh = {BLOCK_MAGIC, n, payload.size()};
+            std::ofstream out(filename, std::ios_base::out | std::ios_base::app | std::ios_base::binary);
+            out.write((const char*)&bh, sizeof(bh));
+            out.write((const char*)&offsets[0], offsets.size()*sizeof(uint32_t));
+            out.write((const char*)&payload[0], payload.size());
+            out.close();
+            if (out.fail()) panic("Delta stats backend: could not write %s", filename);
+
+            IndexEntry ie = {block[0], block[n-1], fileBytes, writtenRecords, n, 0};
+            std::ofstream idx(indexFilename, std::ios_base::out | std::ios_base::app | std::ios_base::binary);
+            idx.write((const char*)&ie, sizeof(ie));
+            idx.close();
+            if (idx.fail()) panic("Delta stats backend: could not write %s", indexFilename);
+
+            fileBytes += sizeof(bh) + offsets.size()*sizeof(uint32_t) + payload.size();
+            writtenRecords += n;
+        }
+
+    public:
+        DeltaBackendImpl(const char* _filename, AggregateStat* _rootStat, uint32_t _blockRecords, bool _skipVectors) :
+            filename(_filename), rootStat(_rootStat), skipVectors(_skipVectors), blockRecords(_blockRecords)
+        {
+            assert(blockRecords > 0);
+            std::vector<std::string> names;
+            names.push_back("phase");
+            nameWalk(rootStat, "", names);
+            numCols = names.size();
+
+            std::string idxName = std::string(filename) + ".idx";
+            indexFilename = gm_strdup(idxName.c_str());
+
+            info("Delta stats backend: Opening %s, %d columns, %d records/block", filename, numCols, blockRecords);
+            FileHeader fh;
+            memcpy(fh.magic, FILE_MAGIC, sizeof(fh.magic));
+            fh.numCols = numCols;
+            fh.blockRecords = blockRecords;
+            std::ofstream out(filename, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+            out.write((const char*)&fh, sizeof(fh));
+            fileBytes = sizeof(fh);
+            for (const std::string& name : names) {
+                uint16_t len = name.size();
+                out.write((const char*)&len, sizeof(len));
+                out.write(name.c_str(), len);
+                fileBytes += sizeof(len) + len;
+            }
+            out.close();
+            if (out.fail()) panic("Delta stats backend: could not create %s", filename);
+            std::ofstream idx(indexFilename, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+            idx.close();
+            if (idx.fail()) panic("Delta stats backend: could not create %s", indexFilename);
+
+            flatStats = new CompiledStats(rootStat, skipVectors, false);
+            assert(flatStats->size() + 1 == numCols);
+            record = gm_calloc<uint64_t>(flatStats->size());
+            block = gm_calloc<uint64_t>((uint64_t)numCols*blockRecords);
+            bufferedRecords = 0;
+            writtenRecords = 0;
+        }
+
+        void dump(bool buffered) {
+            block[bufferedRecords] = zinfo->numPhases; //column 0
+            flatStats->dump(record);
+            for (uint32_t c = 1; c < numCols; c++) block[c*blockRecords + bufferedRecords] = record[c-1];
+            bufferedRecords++;
+
+            if (bufferedRecords == blockRecords || !buffered) {
+                writeBlock();
+                bufferedRecords = 0;
+            }
+        }
+};
+
+DeltaBackend::DeltaBackend(const char* filename, AggregateStat* rootStat, uint32_t blockRecords, bool skipVectors) {
+    backend = new DeltaBackendImpl(filename, rootStat, blockRecords, skipVectors);
+}
+
+void DeltaBackend::dump(bool buffered) {
+    backend->dump(buffered);
+}
@@ -0,0 +1,175 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTA_STATS_H_
+#define DELTA_STATS_H_
+
+/* Delta-encoded stats format, written by DeltaBackend and read by statsreader.
+ *
+ * Periodic dumps are stored in blocks of up to blockRecords records, and each
+ * block stores every column (one counter) separately, as the delta from the
+ * previous record. Most counters change little or not at all across dumps, so
+ * they take a byte or less per record.
+ *
+ * File: FileHeader, then numCols names (uint16 length + chars), then blocks.
+ *   Column 0 is always "phase", the phase each record was dumped at.
+ * Block: BlockHeader, uint32 colOffsets[numCols+1] (relative to the payload
+ *   start; the last one is the payload size), then the payload. Each column is
+ *   self-contained, so a block (or a single column of a block) can be decoded
+ *   on its own:
+ *     DCOL_CONST:  varint value (all records are equal)
+ *     DCOL_VARINT: varint first value, then numRecords-1 zigzag varint deltas
+ *     DCOL_FOR:    varint first value, zigzag varint minimum delta, uint8 bit
+ *                  width w, then numRecords-1 (delta - min) packed in w bits
+ *                  each, LSB first (frame of reference)
+ * Index (<file>.idx): one IndexEntry per block, appended as blocks are
+ *   written, so readers can seek to a phase range without scanning the file.
+ *
+ * All integers are in host (little-endian) order.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "varint.h"
+
+namespace deltastats {
+
+static const char FILE_MAGIC[8] = {'Z', 'S', 'D', 'S', 'T', 'A', 'T', '1'};
+static const uint32_t BLOCK_MAGIC = 0x4b4c4244; // "DBLK"
+
+enum ColumnEncoding {DCOL_CONST = 0, DCOL_VARINT = 1, DCOL_FOR = 2};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t numCols;
+    uint32_t blockRecords;
+};
+
+struct BlockHeader {
+    uint32_t magic;
+    uint32_t numRecords;
+    uint64_t payloadBytes;
+};
+
+struct IndexEntry {
+    uint64_t firstPhase;
+    uint64_t lastPhase;
+    uint64_t offset; //of the BlockHeader
+    uint64_t firstRecord;
+    uint32_t numRecords;
+    uint32_t pad;
+};
+
+// Appends the encoding of vals[0..n) to out, picking the smallest of the three encodings
+static inline void encodeColumn(const uint64_t* vals, uint32_t n, std::vector<uint8_t>& out) {
+    int64_t minDelta = 0;
+    int64_t maxDelta = 0;
+    uint64_t varintBytes = 0;
+    for (uint32_t i = 1; i < n; i++) {
+        int64_t d = (int64_t)(vals[i] - vals[i-1]);
+        if (i == 1 || d < minDelta) minDelta = d;
+        if (i == 1 || d > maxDelta) maxDelta = d;
+        varintBytes += varintSize(zigzag(d));
+    }
+
+    if (n <= 1 || (minDelta == 0 && maxDelta == 0)) {
+        out.push_back(DCOL_CONST);
+        putVarint(n? vals[0] : 0, out);
+        return;
+    }
+
+    uint64_t range = (uint64_t)maxDelta - (uint64_t)minDelta;
+    uint32_t width = 0;
+    while (width < 64 && (range >> width)) width++;
+    uint64_t forBytes = varintSize(zigzag(minDelta)) + 1 + ((uint64_t)(n-1)*width + 7)/8;
+
+    if (varintBytes <= forBytes) {
+        out.push_back(DCOL_VARINT);
+        putVarint(vals[0], out);
+        for (uint32_t i = 1; i < n; i++) putVarint(zigzag((int64_t)(vals[i] - vals[i-1])), out);
+    } else {
+        out.push_back(DCOL_FOR);
+        putVarint(vals[0], out);
+        putVarint(zigzag(minDelta), out);
+        out.push_back((uint8_t)width);
+        size_t base = out.size();
+        out.resize(base + forBytes - varintSize(zigzag(minDelta)) - 1, 0);
+        uint64_t bitPos = 0;
+        for (uint32_t i = 1; i < n; i++) {
+            uint64_t v = (vals[i] - vals[i-1]) - (uint64_t)minDelta;
+            for (uint32_t b = 0; b < width;) {
+                uint32_t bit = bitPos & 7;
+                uint32_t take = (width - b < 8 - bit)? width - b : 8 - bit;
+                out[base + bitPos/8] |= (uint8_t)(((v >> b) & ((1u << take) - 1)) << bit);
+                b += take;
+                bitPos += take;
+            }
+        }
+    }
+}
+
+// Decodes n values from [p, end) into vals. Returns false on malformed input.
+static inline bool decodeColumn(const uint8_t* p, const uint8_t* end, uint32_t n, uint64_t* vals) {
+    if (p == end || !n) return false;
+    uint8_t enc = *(p++);
+    uint64_t v;
+    if (!getVarint(p, end, v)) return false;
+    vals[0] = v;
+    if (enc == DCOL_CONST) {
+        for (uint32_t i = 1; i < n; i++) vals[i] = v;
+    } else if (enc == DCOL_VARINT) {
+        for (uint32_t i = 1; i < n; i++) {
+            uint64_t zz;
+            if (!getVarint(p, end, zz)) return false;
+            vals[i] = vals[i-1] + (uint64_t)unzigzag(zz);
+        }
+    } else if (enc == DCOL_FOR) {
+        uint64_t zzMin;
+        if (!getVarint(p, end, zzMin) || p == end) return false;
+        uint64_t minDelta = (uint64_t)unzigzag(zzMin);
+        uint32_t width = *(p++);
+        if (width > 64 || (uint64_t)(end - p) < ((uint64_t)(n-1)*width + 7)/8) return false;
+        uint64_t bitPos = 0;
+        for (uint32_t i = 1; i < n; i++) {
+            uint64_t d = 0;
+            for (uint32_t b = 0; b < width;) {
+                uint32_t bit = bitPos & 7;
+                uint32_t take = (width - b < 8 - bit)? width - b : 8 - bit;
+                d |= ((uint64_t)((p[bitPos/8] >> bit) & ((1u << take) - 1))) << b;
+                b += take;
+                bitPos += take;
+            }
+            vals[i] = vals[i-1] + d + minDelta;
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+};  // namespace deltastats
+
+#endif  // DELTA_STATS_H_
@@ -23,30 +23,87 @@
  * this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
-/* Simple program to dump a trace */
+/* Simple program to dump a trace, or convert it between formats */
 
 #include <queue>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string>
 
 #include "access_tracing.h"
 #include "galloc.h"
 #include "memory_hierarchy.h"  // to translate access type to strings
 
+static void usage(const char* prog) {
+    info("Prints an access trace, or converts it to another format");
+    info("Usage: %s [options] <trace>", prog);
+    info("  -r <first>:<last> only records in this range (inclusive, either side optional)");
+    info("  -o <trace>       write the records to this trace instead of printing them;");
+    info("                   the format follows the name (.h5/.hdf5: HDF5, .raw: flat, otherwise compressed)");
+    info("  -s               print a summary of the trace, then exit");
+    exit(1);
+}
+
 int main(int argc, const char* argv[]) {
     InitLog(""); //no log header
-    if (argc != 2) {
-        info("Prints an access trace");
-        info("Usage: %s <trace>", argv[0]);
-        exit(1);
+
+    uint64_t first = 0;
+    uint64_t last = (uint64_t)-1L;
+    const char* outFile = nullptr;
+    bool summary = false;
+    const char* inFile = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasVal = i + 1 < argc;
+        if (arg == "-r" && hasVal) {
+            std::string range = argv[++i];
+            size_t sep = range.find(':');
+            if (sep == std::string::npos) usage(argv[0]);
+            if (sep > 0) first = strtoul(range.substr(0, sep).c_str(), nullptr, 10);
+            if (sep + 1 < range.size()) last = strtoul(range.substr(sep + 1).c_str(), nullptr, 10);
+        } else if (arg == "-o" && hasVal) {
+            outFile = argv[++i];
+        } else if (arg == "-s") {
+            summary = true;
+        } else if (arg[0] != '-' && !inFile) {
+            inFile = argv[i];
+        } else {
+            usage(argv[0]);
+        }
     }
+    if (!inFile) usage(argv[0]);
 
     gm_init(32<<20 /*32 MB, should be enough*/);
-    AccessTraceReader tr(argv[1]);
+    AccessTraceReader tr(inFile, true /*prefetch*/);
+
+    if (summary) {
+        const char* formatNames[] = {"HDF5", "compressed", "flat"};
+        info("%s: %s format, %d children, %ld records", inFile, formatNames[tr.getFormat()], tr.getNumChildren(), tr.getNumRecords());
+        return 0;
+    }
+
+    uint64_t numRecords = tr.getNumRecords();
+    if (first > numRecords) first = numRecords;
+    if (last >= numRecords) last = numRecords - 1;
+    tr.seek(first);
+    uint64_t left = (numRecords && last >= first)? last - first + 1 : 0;
+
+    if (outFile) {
+        AccessTraceWriter* tw = new AccessTraceWriter(outFile, tr.getNumChildren());
+        for (uint64_t i = 0; i < left; i++) {
+            AccessRecord acc = tr.read();
+            tw->write(acc);
+        }
+        tw->dump(false);
+        info("Wrote %ld records to %s", left, outFile);
+        return 0;
+    }
 
     info("%12s %6s %6s %20s %10s", "Cycle", "Src", "Type", "LineAddr", "Latency");
-    while(!tr.empty()) {
-        AccessRecord acc = tr.read();
-        info("%12ld %6d   %s %20p %10d", acc.reqCycle, acc.childId, AccessTypeName(acc.type), (uint64_t*)acc.lineAddr, acc.latency);
+    for (uint64_t i = 0; i < left; i++) {
+        const PackedAccessRecord* acc = tr.readPacked();
+        info("%12ld %6d   %s %20p %10d", acc->reqCycle, acc->childId, AccessTypeName((AccessType)acc->type), (uint64_t*)acc->lineAddr, acc->latency);
     }
 
     return 0;
@@ -0,0 +1,189 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "event_queue.h"
+#include <errno.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "bithacks.h"
+#include "log.h"
+
+EventQueue::EventQueue() : asyncSeq(0), asyncInFlight(0), numAsyncThreads(0), asyncPid(0), terminate(false) {
+    futex_init(&qLock);
+    futex_init(&asyncLock);
+}
+
+void EventQueue::initStats(AggregateStat* parentStat) {
+    AggregateStat* objStat = new AggregateStat();
+    objStat->init("evq", "Event queue stats");
+    profBarrierEvents.init("barrierEvs", "Events run inside the end-of-phase barrier");
+    profAsyncEvents.init("asyncEvs", "Events handed to async helper threads");
+    profTickTime.init("tickTime", "Time spent ticking the queue inside the barrier");
+    objStat->append(&profBarrierEvents);
+    objStat->append(&profAsyncEvents);
+    objStat->append(&profTickTime);
+    parentStat->append(objStat);
+}
+
+void EventQueue::setAsyncThreads(uint32_t numThreads) {
+    assert(!numAsyncThreads);
+    numAsyncThreads = numThreads;
+    asyncPid = getpid();
+}
+
+bool EventQueue::helpersAlive() const {
+    return numAsyncThreads && (kill(asyncPid, 0) == 0 || errno != ESRCH);
+}
+
+void EventQueue::tick() {
+    bool useHelpers = helpersAlive();
+    if (numAsyncThreads && !useHelpers) runOrphanedAsync(); //periodic ones are requeued for later phases
+    futex_lock(&qLock);
+    profTickTime.start();
+    uint64_t curPhase = zinfo->numPhases;
+    g_multimap<uint64_t, Event*>::iterator it = evMap.begin();
+    while (it != evMap.end() && it->first <= curPhase) {
+        if (unlikely(it->first != curPhase)) panic("First event should have ticked on phase %ld, this is %ld", it->first, curPhase);
+        //if (it->first != curPhase) warn("First event should have ticked on phase %ld, this is %ld", it->first, curPhase);
+        Event* ev = it->second;
+        evMap.erase(it);
+        if (ev->getAffinity() == EV_ASYNC && useHelpers) {
+            profAsyncEvents.inc();
+            dispatchAsync(ev, curPhase); //requeued by the helper thread once it runs
+        } else {
+            profBarrierEvents.inc();
+            ev->callback(); //NOTE: Callback cannot call insert(), will deadlock (could use recursive locks if needed)
+            if (ev->getPeriod()) {
+                evMap.insert(std::pair<uint64_t, Event*>(curPhase + ev->getPeriod(), ev));
+            } else {
+                delete ev;
+            }
+        }
+        it = evMap.begin();
+    }
+    profTickTime.end();
+    futex_unlock(&qLock);
+}
+
+void EventQueue::dispatchAsync(Event* ev, uint64_t phase) {
+    __sync_fetch_and_add(&asyncInFlight, 1);
+    futex_lock(&asyncLock);
+    asyncQueue.push_back(std::make_pair(phase, ev));
+    __sync_fetch_and_add(&asyncSeq, 1);
+    futex_unlock(&asyncLock);
+    syscall(SYS_futex, &asyncSeq, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+void EventQueue::async(Event* ev) {
+    assert(ev->getAffinity() == EV_ASYNC && !ev->getPeriod());
+    if (helpersAlive()) {
+        dispatchAsync(ev, zinfo->numPhases);
+    } else {
+        ev->callback();
+        delete ev;
+    }
+}
+
+/* An async event may finish phases after it ticked, so it can't always be
+ * requeued at tickPhase + period. numPhases is only bumped after tick() returns,
+ * so curPhase + 1 is the earliest phase that is guaranteed not to have ticked.
+ */
+void EventQueue::requeue(Event* ev, uint64_t nextPhase) {
+    futex_lock(&qLock);
+    uint64_t minPhase = zinfo->numPhases + 1;
+    evMap.insert(std::pair<uint64_t, Event*>(MAX(nextPhase, minPhase), ev));
+    futex_unlock(&qLock);
+}
+
+void EventQueue::asyncThreadLoop() {
+    while (true) {
+        futex_lock(&asyncLock);
+        while (asyncQueue.empty() && !terminate) {
+            uint32_t seq = asyncSeq;
+            futex_unlock(&asyncLock);
+            syscall(SYS_futex, &asyncSeq, FUTEX_WAIT, seq, nullptr, nullptr, 0);
+            futex_lock(&asyncLock);
+        }
+        if (asyncQueue.empty()) { //terminating, and nothing left to run
+            futex_unlock(&asyncLock);
+            break;
+        }
+        std::pair<uint64_t, Event*> p = asyncQueue.front();
+        asyncQueue.pop_front();
+        futex_unlock(&asyncLock);
+
+        Event* ev = p.second;
+        ev->callback();
+        if (ev->getPeriod()) requeue(ev, p.first + ev->getPeriod());
+        else delete ev;
+        __sync_fetch_and_sub(&asyncInFlight, 1);
+    }
+}
+
+void EventQueue::AsyncThreadTrampoline(void* arg) {
+    static_cast<EventQueue*>(arg)->asyncThreadLoop();
+}
+
+void EventQueue::drainAsync() {
+    while (asyncInFlight) {
+        if (!helpersAlive()) {
+            runOrphanedAsync();
+            break;
+        }
+        usleep(100);
+    }
+}
+
+/* The helpers' process is gone: runs the events it left queued here, and
+ * forgets the ones its helpers were running, which died with them.
+ */
+void EventQueue::runOrphanedAsync() {
+    futex_lock(&asyncLock);
+    g_list<std::pair<uint64_t, Event*> > orphans;
+    orphans.swap(asyncQueue);
+    uint32_t lost = asyncInFlight - orphans.size();
+    asyncInFlight = 0;
+    futex_unlock(&asyncLock);
+    if (orphans.empty() && !lost) return;
+
+    warn("Async event helper threads' process %d is gone, running %ld queued async events inline (%d lost)", asyncPid, orphans.size(), lost);
+    for (std::pair<uint64_t, Event*>& p : orphans) {
+        Event* ev = p.second;
+        ev->callback();
+        if (ev->getPeriod()) requeue(ev, p.first + ev->getPeriod());
+        else delete ev;
+    }
+}
+
+void EventQueue::finish() {
+    drainAsync(); //also runs leftover events if the helpers are gone
+    futex_lock(&asyncLock);
+    terminate = true;
+    __sync_fetch_and_add(&asyncSeq, 1);
+    futex_unlock(&asyncLock);
+    syscall(SYS_futex, &asyncSeq, FUTEX_WAKE, numAsyncThreads, nullptr, nullptr, 0);
+}
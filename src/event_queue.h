@@ -27,17 +27,33 @@
 #define EVENT_QUEUE_H_
 
 #include <stdint.h>
+#include <sys/types.h>
+#include "g_std/g_list.h"
 #include "g_std/g_multimap.h"
 #include "galloc.h"
+#include "locks.h"
+#include "profile_stats.h"
+#include "stats.h"
 #include "zsim.h"
 
+/* Where an event's callback runs. Barrier events run inside the end-of-phase
+ * barrier, with all simulated threads stopped, and can touch any simulator
+ * state. Async events are handed to the event queue's helper threads and run
+ * concurrently with the following bound phase, so they must only touch state
+ * they own (e.g., a snapshot taken by a barrier event), and can't insert()
+ * from their callback any more than barrier events can.
+ */
+enum EventAffinity {EV_BARRIER, EV_ASYNC};
+
 class Event : public GlobAlloc {
     protected:
         uint64_t period;
+        EventAffinity affinity;
 
     public:
-        explicit Event(uint64_t _period) : period(_period) {} //period == 0 events are one-shot
+        explicit Event(uint64_t _period, EventAffinity _affinity = EV_BARRIER) : period(_period), affinity(_affinity) {} //period == 0 events are one-shot
         uint64_t getPeriod() const {return period;}
+        EventAffinity getAffinity() const {return affinity;}
         virtual void callback()=0;
 };
 
@@ -86,28 +102,31 @@ class EventQueue : public GlobAlloc {
         g_multimap<uint64_t, Event*> evMap;
         lock_t qLock;
 
+        //Async events waiting for a helper thread, with the phase they ticked on
+        g_list<std::pair<uint64_t, Event*> > asyncQueue;
+        lock_t asyncLock;
+        volatile uint32_t asyncSeq; //futex word helpers sleep on; bumped on every dispatch
+        volatile uint32_t asyncInFlight; //dispatched but not yet finished (or requeued)
+        uint32_t numAsyncThreads; //0 runs async events at the barrier too
+        pid_t asyncPid; //process the helper threads live in
+        volatile bool terminate;
+
+        Counter profBarrierEvents;
+        Counter profAsyncEvents;
+        ClockStat profTickTime;
+
     public:
-        EventQueue() { futex_init(&qLock); }
+        EventQueue();
 
-        void tick() {
-            futex_lock(&qLock);
-            uint64_t curPhase = zinfo->numPhases;
-            g_multimap<uint64_t, Event*>::iterator it = evMap.begin();
-            while (it != evMap.end() && it->first <= curPhase) {
-                if (unlikely(it->first != curPhase)) panic("First event should have ticked on phase %ld, this is %ld", it->first, curPhase);
-                //if (it->first != curPhase) warn("First event should have ticked on phase %ld, this is %ld", it->first, curPhase);
-                Event* ev = it->second;
-                evMap.erase(it);
-                ev->callback(); //NOTE: Callback cannot call insert(), will deadlock (could use recursive locks if needed)
-                if (ev->getPeriod()) {
-                    evMap.insert(std::pair<uint64_t, Event*>(curPhase + ev->getPeriod(), ev));
-                } else {
-                    delete ev;
-                }
-                it = evMap.begin();
-            }
-            futex_unlock(&qLock);
-        }
+        void initStats(AggregateStat* parentStat);
+
+        //Sets how many helper threads run async events. The caller must then start numThreads threads that
+        //run AsyncThreadTrampoline in this process, so that the queue does not depend on a threading library.
+        //If this process dies, other processes go back to running async events at the barrier.
+        void setAsyncThreads(uint32_t numThreads);
+        static void AsyncThreadTrampoline(void* arg);
+
+        void tick();
 
         void insert(Event* ev, int64_t startDelay = -1) {
             futex_lock(&qLock);
@@ -117,6 +136,23 @@ class EventQueue : public GlobAlloc {
             evMap.insert(std::pair<uint64_t, Event*>(eventPhase, ev));
             futex_unlock(&qLock);
         }
+
+        //Runs a one-shot async event as soon as a helper thread is free (inline if there are no helpers).
+        //Unlike insert(), this can be called from an event's callback.
+        void async(Event* ev);
+
+        //Waits until all dispatched async events have run. Must not be called from an event's callback.
+        void drainAsync();
+
+        //Drains and stops the helper threads
+        void finish();
+
+    private:
+        bool helpersAlive() const;
+        void runOrphanedAsync();
+        void dispatchAsync(Event* ev, uint64_t phase);
+        void requeue(Event* ev, uint64_t nextPhase);
+        void asyncThreadLoop();
 };
 
 #endif  // EVENT_QUEUE_H_
@@ -56,6 +56,7 @@ class EventRecorder : public GlobAlloc {
         TimingRecord tr;
         CrossingStack crossingStack;
         uint32_t srcId;
+        uint64_t numCrossings; //crossing events recorded, read by the phase length controller
 
         volatile uint64_t lastGapCycles;
         PAD();
@@ -63,7 +64,7 @@ class EventRecorder : public GlobAlloc {
         PAD();
 
     public:
-        EventRecorder() {
+        EventRecorder() : numCrossings(0) {
             tr.clear();
         }
 
@@ -78,6 +79,15 @@ class EventRecorder : public GlobAlloc {
             return slabAlloc.alloc(sz);
         }
 
+        //Called once per phase by the core's recorder
+        void samplePhase() {
+            slabAlloc.samplePhase();
+        }
+
+        void initStats(AggregateStat* parentStat) {
+            slabAlloc.initStats(parentStat);
+        }
+
         //Event recording interface
 
         void pushRecord(const TimingRecord& rec) {
@@ -124,6 +134,9 @@ class EventRecorder : public GlobAlloc {
         inline CrossingStack& getCrossingStack() {
             return crossingStack;
         }
+
+        inline void countCrossing() {numCrossings++;}
+        uint64_t getNumCrossings() const {return numCrossings;}
 };
 
 #endif  // EVENT_RECORDER_H_
@@ -54,6 +54,7 @@ struct gm_segment {
     volatile void* base_regp; //common data structure, accessible with glob_ptr; threads poll on gm_isready to determine when everything has been initialized
     volatile void* secondary_regp; //secondary data structure, used to exchange information between harness and initializing process
     mspace mspace_ptr;
+    size_t size;
 
     PAD();
     lock_t lock;
@@ -101,6 +102,7 @@ int gm_init(size_t segmentSize) {
     char* alloc_start = reinterpret_cast<char*>(GM) + 1024;
     size_t alloc_size = segmentSize - 1 - 1024;
     GM->base_regp = nullptr;
+    GM->size = segmentSize;
 
     GM->mspace_ptr = create_mspace_with_base(alloc_start, alloc_size, 1 /*locked*/);
     futex_init(&GM->lock);
@@ -193,6 +195,21 @@ void* gm_get_secondary_ptr() {
     return const_cast<void*>(GM->secondary_regp);  // devolatilize
 }
 
+void gm_get_segment(void** base, size_t* size) {
+    assert(GM);
+    *base = GM;
+    *size = GM->size;
+}
+
+void* gm_top() {
+    assert(GM);
+    assert(GM->mspace_ptr);
+    futex_lock(&GM->lock);
+    void* top = ((mstate)GM->mspace_ptr)->top;
+    futex_unlock(&GM->lock);
+    return top;
+}
+
 void gm_stats() {
     assert(GM);
     mspace_malloc_stats(GM->mspace_ptr);
@@ -61,6 +61,12 @@ void* gm_get_secondary_ptr();
 
 void gm_stats();
 
+// Segment bounds and current top of the heap. Since the heap does not mmap, fresh
+// allocations come from the top chunk, so comparing gm_top() before and after a
+// batch of initialization-time allocations brackets (most of) their memory.
+void gm_get_segment(void** base, size_t* size);
+void* gm_top();
+
 bool gm_isready();
 void gm_detach();
 
@@ -25,18 +25,99 @@
 
 #include <fstream>
 #include <hdf5.h>
-#include <hdf5_hl.h>
 #include <iostream>
+#include <errno.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
 #include <vector>
+#include "compiled_stats.h"
+#include "g_std/g_vector.h"
 #include "galloc.h"
 #include "log.h"
+#include "pin.H"
 #include "stats.h"
 #include "zsim.h"
 
-/** Implements the HDF5 backend. Creates one big table in the file, and writes one row per dump.
- * NOTE: Because dump may be called from multiple processes, we close and open the HDF5 file every dump.
- * This is inefficient, but dumps are not that common anyhow, and we get the ability to read hdf5 files mid-simulation.
- * (alternatively, we could have an extra thread exclusively dedicated to writing stats).
+/* Stats writer thread. Dumps, which may happen in any process, only snapshot
+ * the stats into one of their backend's two buffers, and hand full buffers to
+ * this thread. It opens the backends' files in its own process and keeps them
+ * open, appends records as they come, and flushes the files every flushSecs (so
+ * they can still be read mid-simulation) and on unbuffered dumps. It lives in
+ * process 0, which stops it (closing the files) before its termination dump. If
+ * that process dies first, dumps from other processes notice and go back to
+ * writing their records synchronously.
+ */
+class HDF5BackendImpl;
+
+class HDF5Writer : public GlobAlloc {
+    private:
+        g_vector<HDF5BackendImpl*> backends;
+        volatile uint32_t wakeSeq; //futex word the thread sleeps on; bumped on every handoff
+        volatile bool running;
+        volatile bool stopReq;
+        pid_t pid; //of the process the thread lives in
+        uint64_t flushNs;
+
+    public:
+        HDF5Writer() : wakeSeq(0), running(false), stopReq(false), pid(0), flushNs(0) {}
+
+        void add(HDF5BackendImpl* backend) {
+            assert(!running);
+            backends.push_back(backend);
+        }
+
+        // False before start(), after stop(), or if the thread's process is gone
+        bool isRunning() const {
+            return running && (kill(pid, 0) == 0 || errno != ESRCH);
+        }
+
+        void start(uint32_t flushSecs) {
+            assert(!running && flushSecs);
+            flushNs = flushSecs*1000000000ul;
+            pid = getpid();
+            running = true;
+            __sync_synchronize();
+            PIN_SpawnInternalThread(Trampoline, this, 64*1024, nullptr);
+        }
+
+        // Writes out pending buffers, closes the files, and ends the thread; must be called from its process
+        void stop() {
+            if (!running) return;
+            assert(pid == getpid());
+            stopReq = true;
+            wake();
+            while (running) usleep(100);
+        }
+
+        void wake() {
+            __sync_fetch_and_add(&wakeSeq, 1);
+            syscall(SYS_futex, &wakeSeq, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+        }
+
+    private:
+        static uint64_t getNs() {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return ts.tv_sec*1000000000ul + ts.tv_nsec;
+        }
+
+        void loop();
+
+        static void Trampoline(void* arg) {
+            static_cast<HDF5Writer*>(arg)->loop();
+        }
+};
+
+/** Implements the HDF5 backend. Creates one big dataset in the file, and writes one row per dump.
+ * The dataset is chunked in recordsPerWrite records and shuffle+deflate filtered. Shuffling a chunk of
+ * records puts the bytes of each counter across dumps next to each other, which compresses much better.
+ * NOTE: Because dump may be called from multiple processes, and HDF5 handles are only valid in the process
+ * that opened them, dumps that write records themselves (while HDF5Writer is not running) open and close the
+ * file every time. While HDF5Writer runs, only its thread touches the file, and keeps it open; dumps just fill
+ * dataBuf and hand it over.
  */
 class HDF5BackendImpl : public GlobAlloc {
     private:
@@ -44,54 +125,33 @@ class HDF5BackendImpl : public GlobAlloc {
         AggregateStat* rootStat;
         bool skipVectors;
         bool sumRegularAggregates;
+        CompiledStats* flatStats; //what each dump copies out, in walk order
 
-        uint64_t* dataBuf; //buffered record data
+        uint64_t* dataBufs[2];
+        uint64_t* dataBuf; //buffered record data, one of dataBufs
         uint64_t* curPtr; //points to next element to write in dump
         uint64_t recordSize; // in bytes
         uint32_t recordsPerWrite; //how many records to buffer; determines chunk size as well
 
         uint32_t bufferedRecords; //number of records buffered (dumped w/o being written), <= recordsPerWrite
 
+        //Handoff to the writer thread
+        uint64_t* volatile pendingBuf; //full buffer the writer has not written yet, or nullptr
+        volatile uint32_t pendingRecords;
+        volatile bool flushReq; //flush the file after writing pendingBuf
+
+        //Open file state, valid only in the process that opened it (-1 if closed)
+        hid_t fileID;
+        hid_t datasetID;
+        hid_t memType; //dataset type, used to write records
+        uint64_t writtenRecords;
+        bool dirty; //appended since the last flush
+
         // Always have a single function to determine when to skip a stat to avoid inconsistencies in the code
         bool skipStat(Stat* s) {
             return skipVectors && dynamic_cast<VectorStat*>(s);
         }
 
-        // Dump the stats, inorder walk
-        void dumpWalk(Stat* s) {
-            if (skipStat(s)) return;
-            if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
-                if (as->isRegular() && sumRegularAggregates) {
-                    //Dump first record
-                    uint64_t* startPtr = curPtr;
-                    dumpWalk(as->get(0));
-                    uint64_t* tmpPtr = curPtr;
-                    uint32_t sz = tmpPtr - startPtr;
-                    //Dump others below, and add them up
-                    for (uint32_t i = 1; i < as->size(); i++) {
-                        dumpWalk(as->get(i));
-                        //Add record with previous ones
-                        assert(curPtr == tmpPtr + sz);
-                        for (uint32_t j = 0; j < sz; j++) startPtr[j] += tmpPtr[j];
-                        //Rewind
-                        curPtr = tmpPtr;
-                    }
-                } else {
-                    for (uint32_t i = 0; i < as->size(); i++) {
-                        dumpWalk(as->get(i));
-                    }
-                }
-            } else if (ScalarStat* ss = dynamic_cast<ScalarStat*>(s)) {
-                *(curPtr++) = ss->get();
-            } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
-                for (uint32_t i = 0; i < vs->size(); i++) {
-                    *(curPtr++) = vs->count(i);
-                }
-            } else {
-                panic("Unrecognized stat type");
-            }
-        }
-
         //Note this is a local vector, b/c it's only used at initialization.
         std::vector<hid_t> uniqueTypes;
 
@@ -193,61 +253,203 @@ class HDF5BackendImpl : public GlobAlloc {
         {
             // Create stats file
             info("HDF5 backend: Opening %s", filename);
-            hid_t fileID = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+            hid_t createdFileID = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
 
             hid_t rootType = getH5Type(rootStat);
-
-            //TODO: Use of table interface is vestigial at this point. Just create the dataset...
-            size_t fieldOffsets[] = {0};
-            hid_t fieldTypes[] = {rootType};
-            const char* fieldNames[] = {rootStat->name()};
             recordSize = H5Tget_size(rootType);
 
             recordsPerWrite = _bytesPerWrite/recordSize + 1;
 
-            herr_t hErrVal = H5TBmake_table("stats", fileID, "stats",
-                    1 /*# fields*/, 0 /*# records*/,
-                    recordSize, fieldNames, fieldOffsets, fieldTypes,
-                    recordsPerWrite /*chunk size, in records, might as well be our aggregation degree*/,
-                    nullptr, 9 /*compression*/, nullptr);
-            assert(hErrVal == 0);
+            // A single-field compound (named as the root stat), so files read the same as the tables we used to write
+            hid_t recType = H5Tcreate(H5T_COMPOUND, recordSize);
+            H5Tinsert(recType, rootStat->name(), 0, rootType);
+            rootType = recType;
+
+            hsize_t dims[] = {0};
+            hsize_t maxDims[] = {H5S_UNLIMITED};
+            hsize_t chunkDims[] = {recordsPerWrite}; //chunk size, in records, might as well be our aggregation degree
+            hid_t space = H5Screate_simple(1, dims, maxDims);
+            hid_t props = H5Pcreate(H5P_DATASET_CREATE);
+            H5Pset_chunk(props, 1, chunkDims);
+            H5Pset_shuffle(props);
+            H5Pset_deflate(props, 6);
+            hid_t createdDatasetID = H5Dcreate2(createdFileID, "stats", rootType, space, H5P_DEFAULT, props, H5P_DEFAULT);
+            assert(createdDatasetID >= 0);
+            H5Pclose(props);
+            H5Sclose(space);
+            H5Tclose(recType);
+            H5Dclose(createdDatasetID);
+            H5Fclose(createdFileID);
+            fileID = -1;
+            datasetID = -1;
+            memType = -1;
+            writtenRecords = 0;
+            dirty = false;
+
+            flatStats = new CompiledStats(rootStat, skipVectors, sumRegularAggregates);
+            assert_msg(flatStats->size()*sizeof(uint64_t) == recordSize, "HDF5 (%s): compiled record has %d counters, type is %ld bytes", filename, flatStats->size(), recordSize);
 
             size_t bufSize = recordsPerWrite*recordSize;
-            if (sumRegularAggregates) bufSize += recordSize; //conservatively add space for a record. See dumpWalk(), we bleed into the buffer a bit when dumping a regular aggregate.
-            dataBuf = static_cast<uint64_t*>(gm_malloc(bufSize));
+            dataBufs[0] = static_cast<uint64_t*>(gm_malloc(bufSize));
+            dataBufs[1] = static_cast<uint64_t*>(gm_malloc(bufSize));
+            dataBuf = dataBufs[0];
             curPtr = dataBuf;
 
             bufferedRecords = 0;
+            pendingBuf = nullptr;
+            pendingRecords = 0;
+            flushReq = false;
+
+            if (!zinfo->statsWriter) zinfo->statsWriter = new HDF5Writer();
+            zinfo->statsWriter->add(this);
 
-            info("HDF5 backend: Created table, %ld bytes/record, %d records/write", recordSize, recordsPerWrite);
-            H5Fclose(fileID);
+            info("HDF5 backend: Created dataset, %ld bytes/record, %d records/write, %d ops/dump", recordSize, recordsPerWrite, flatStats->numOps());
         }
 
         ~HDF5BackendImpl() {}
 
         void dump(bool buffered) {
             // Copy stats to data buffer
-            dumpWalk(rootStat);
+            flatStats->dump(curPtr);
+            curPtr += flatStats->size();
             bufferedRecords++;
 
             assert_msg(dataBuf + bufferedRecords*recordSize/sizeof(uint64_t) == curPtr, "HDF5 (%s): %p + %d * %ld / %ld != %p", filename, dataBuf, bufferedRecords, recordSize, sizeof(uint64_t), curPtr);
 
             // Write to table if needed
             if (bufferedRecords == recordsPerWrite || !buffered) {
-                hid_t fileID = H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT);
-
-                size_t fieldOffsets[] = {0};
-                size_t fieldSizes[] = {recordSize};
-                H5TBappend_records(fileID, "stats", bufferedRecords, recordSize, fieldOffsets, fieldSizes, dataBuf);
-                H5Fclose(fileID);
+                HDF5Writer* writer = zinfo->statsWriter;
+                if (waitForWriter(writer)) { //writer done with the other buffer
+                    pendingRecords = bufferedRecords;
+                    flushReq = !buffered;
+                    __sync_synchronize();
+                    pendingBuf = dataBuf;
+                    writer->wake();
+                    if (!buffered) waitForWriter(writer); //unbuffered dumps return once their records are on disk
+                    dataBuf = (dataBuf == dataBufs[0])? dataBufs[1] : dataBufs[0];
+                } else {
+                    // We may not be in the process that opened the file (or anyone has), so open it just for this write
+                    open();
+                    append(dataBuf, bufferedRecords);
+                    close();
+                }
 
                 //Rewind
                 bufferedRecords = 0;
                 curPtr = dataBuf;
             }
         }
+
+        // Writer thread only: writes the handed-off buffer, if any
+        bool writePending() {
+            uint64_t* buf = pendingBuf;
+            if (!buf) return false;
+            if (fileID < 0) open(); //first write from the writer thread's process; keep the file open from now on
+            append(buf, pendingRecords);
+            if (flushReq) {
+                flush();
+                flushReq = false;
+            }
+            __sync_synchronize();
+            pendingBuf = nullptr;
+            return true;
+        }
+
+        // Writer thread only, when stopping
+        void closeFile() {
+            if (fileID >= 0) close();
+        }
+
+        void flush() {
+            if (!dirty || fileID < 0) return;
+            H5Fflush(fileID, H5F_SCOPE_LOCAL);
+            dirty = false;
+        }
+
+    private:
+        /* Waits until the writer has taken the handed-off buffer, and returns whether it still runs. If the
+         * writer's process is gone, writes out the buffer it left behind and returns false.
+         */
+        bool waitForWriter(HDF5Writer* writer) {
+            while (pendingBuf) {
+                if (!writer->isRunning()) {
+                    open();
+                    append(pendingBuf, pendingRecords);
+                    close();
+                    flushReq = false;
+                    pendingBuf = nullptr;
+                    return false;
+                }
+                usleep(100);
+            }
+            return writer->isRunning();
+        }
+
+        void open() {
+            //Any handles left are from a writer thread whose process is gone (and with it, the handles)
+            fileID = H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT);
+            assert_msg(fileID >= 0, "HDF5 (%s): could not open file", filename);
+            datasetID = H5Dopen2(fileID, "stats", H5P_DEFAULT);
+            assert(datasetID >= 0);
+            memType = H5Dget_type(datasetID); //same layout as the record we build, since we created it with native types
+        }
+
+        void close() {
+            H5Tclose(memType);
+            H5Dclose(datasetID);
+            H5Fclose(fileID); //writes out everything appended
+            fileID = -1;
+            datasetID = -1;
+            memType = -1;
+            dirty = false;
+        }
+
+        void append(uint64_t* buf, uint32_t records) {
+            hsize_t newDims[] = {writtenRecords + records};
+            H5Dset_extent(datasetID, newDims);
+            hid_t fileSpace = H5Dget_space(datasetID);
+            hsize_t start[] = {writtenRecords};
+            hsize_t count[] = {records};
+            H5Sselect_hyperslab(fileSpace, H5S_SELECT_SET, start, nullptr, count, nullptr);
+            hid_t memSpace = H5Screate_simple(1, count, nullptr);
+            herr_t hErrVal = H5Dwrite(datasetID, memType, memSpace, fileSpace, H5P_DEFAULT, buf);
+            assert(hErrVal >= 0);
+            H5Sclose(memSpace);
+            H5Sclose(fileSpace);
+            writtenRecords += records;
+            dirty = true;
+        }
 };
 
+void HDF5Writer::loop() {
+    info("Started HDF5 stats writer thread");
+    uint64_t lastFlush = getNs();
+    while (true) {
+        uint32_t seq = wakeSeq;
+        for (HDF5BackendImpl* backend : backends) backend->writePending();
+
+        if (stopReq) {
+            for (HDF5BackendImpl* backend : backends) backend->closeFile();
+            __sync_synchronize();
+            running = false;
+            info("Stopped HDF5 stats writer thread");
+            return;
+        }
+
+        uint64_t now = getNs();
+        if (now - lastFlush >= flushNs) {
+            for (HDF5BackendImpl* backend : backends) backend->flush();
+            lastFlush = now;
+        }
+
+        uint64_t waitNs = flushNs - (now - lastFlush);
+        struct timespec timeout;
+        timeout.tv_sec = waitNs/1000000000ul;
+        timeout.tv_nsec = waitNs % 1000000000ul;
+        syscall(SYS_futex, &wakeSeq, FUTEX_WAIT, seq, &timeout, nullptr, 0);
+    }
+}
+
 
 HDF5Backend::HDF5Backend(const char* filename, AggregateStat* rootStat, size_t bytesPerWrite, bool skipVectors, bool sumRegularAggregates) {
     backend = new HDF5BackendImpl(filename, rootStat, bytesPerWrite, skipVectors, sumRegularAggregates);
@@ -257,3 +459,13 @@ void HDF5Backend::dump(bool buffered) {
     backend->dump(buffered);
 }
 
+void HDF5Backend::startWriter(uint32_t flushSecs) {
+    if (!zinfo->statsWriter) return; //no HDF5 backends
+    zinfo->statsWriter->start(flushSecs);
+}
+
+void HDF5Backend::stopWriter() {
+    if (!zinfo->statsWriter) return;
+    zinfo->statsWriter->stop();
+}
+
@@ -0,0 +1,266 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "host_placement.h"
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <fstream>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+#include "log.h"
+
+#define PAGE_BYTES 4096
+#define MAX_HOST_NODES 1024  // size of the nodemasks we pass to mbind
+
+// Parses a cpulist ("0-3,8,10-11")
+static std::vector<uint32_t> parseCpuList(const std::string& str) {
+    std::vector<uint32_t> cpus;
+    size_t pos = 0;
+    while (pos < str.size()) {
+        size_t end = str.find(',', pos);
+        if (end == std::string::npos) end = str.size();
+        std::string range = str.substr(pos, end - pos);
+        if (!range.empty() && range[0] >= '0' && range[0] <= '9') {
+            size_t dash = range.find('-');
+            uint32_t first = strtoul(range.c_str(), nullptr, 10);
+            uint32_t last = (dash == std::string::npos)? first : strtoul(range.c_str() + dash + 1, nullptr, 10);
+            for (uint32_t c = first; c <= last; c++) cpus.push_back(c);
+        }
+        pos = end + 1;
+    }
+    return cpus;
+}
+
+HostPlacement::HostPlacement(PinMode _pinMode, MemPolicy _memPolicy, uint32_t _numCores, uint32_t _numDomains)
+    : pinMode(_pinMode), memPolicy(_memPolicy), numCores(_numCores), numDomains(_numDomains)
+{
+    //Only use cpus we're allowed to run on (e.g., under taskset or cgroups)
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        warn("HostPlacement: sched_getaffinity failed (%d), assuming all cpus are usable", errno);
+        for (uint32_t c = 0; c < CPU_SETSIZE; c++) CPU_SET(c, &allowed);
+    }
+
+    //Nodes with allowed cpus, in host node id order
+    DIR* dir = opendir("/sys/devices/system/node");
+    std::vector<uint32_t> hostNodes;
+    if (dir) {
+        struct dirent* de;
+        while ((de = readdir(dir))) {
+            if (strncmp(de->d_name, "node", 4) == 0 && de->d_name[4] >= '0' && de->d_name[4] <= '9') {
+                hostNodes.push_back(strtoul(de->d_name + 4, nullptr, 10));
+            }
+        }
+        closedir(dir);
+    }
+    std::sort(hostNodes.begin(), hostNodes.end());
+
+    for (uint32_t n : hostNodes) {
+        std::ifstream f(("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist").c_str());
+        std::string str;
+        if (!std::getline(f, str)) continue;
+        g_vector<uint32_t> cpus;
+        for (uint32_t c : parseCpuList(str)) if (c < CPU_SETSIZE && CPU_ISSET(c, &allowed)) cpus.push_back(c);
+        if (cpus.empty() || n >= MAX_HOST_NODES) continue; //memory-only or disallowed node
+        nodeIds.push_back(n);
+        nodeCpus.push_back(cpus);
+    }
+
+    if (nodeIds.empty()) {
+        //No usable node info, treat the machine as a single node
+        g_vector<uint32_t> cpus;
+        for (uint32_t c = 0; c < CPU_SETSIZE; c++) if (CPU_ISSET(c, &allowed)) cpus.push_back(c);
+        nodeIds.push_back(0);
+        nodeCpus.push_back(cpus);
+    }
+    numNodes = nodeIds.size();
+    for (const g_vector<uint32_t>& cpus : nodeCpus) allCpus.insert(allCpus.end(), cpus.begin(), cpus.end());
+
+    if (numNodes == 1 && memPolicy != MEM_DEFAULT) {
+        info("HostPlacement: single host node, skipping memory placement");
+        memPolicy = MEM_DEFAULT;
+    }
+
+    coreNodes = gm_calloc<uint32_t>(numCores);
+    coreCpus = gm_calloc<uint32_t>(numCores);
+    nodeAssignedCores = gm_calloc<uint32_t>(numNodes);
+
+    for (uint32_t n = 0; n < numNodes; n++) info("HostPlacement: node %d (host node %d), %ld cpus", n, nodeIds[n], nodeCpus[n].size());
+}
+
+HostPlacement::PinMode HostPlacement::parsePinMode(const char* str) {
+    std::string s(str);
+    if (s == "none") return PIN_NONE;
+    else if (s == "node") return PIN_NODE;
+    else if (s == "cpu") return PIN_CPU;
+    panic("Invalid sim.hostPinning %s (valid values: none, node, cpu)", str);
+}
+
+HostPlacement::MemPolicy HostPlacement::parseMemPolicy(const char* str) {
+    std::string s(str);
+    if (s == "default") return MEM_DEFAULT;
+    else if (s == "interleave") return MEM_INTERLEAVE;
+    else if (s == "bank") return MEM_BANK;
+    panic("Invalid sim.hostMemPolicy %s (valid values: default, interleave, bank)", str);
+}
+
+void HostPlacement::initStats(AggregateStat* parentStat) {
+    AggregateStat* hpStats = new AggregateStat();
+    hpStats->init("host", "Host placement stats");
+
+    auto nodesStat = makeLambdaStat([this]() { return (uint64_t)numNodes; });
+    nodesStat->init("nodes", "Host NUMA nodes used");
+    profPins.init("pins", "Thread pinnings");
+    profPinFailures.init("pinFailures", "Failed thread pinnings");
+    profBoundBytes.init("boundBytes", "Cache bank memory bound to each node", numNodes);
+    profGmPages.init("gmPages", "Resident pages of the used gm segment on each node (sampled at termination)", numNodes);
+
+    hpStats->append(nodesStat);
+    hpStats->append(&profPins);
+    hpStats->append(&profPinFailures);
+    hpStats->append(&profBoundBytes);
+    hpStats->append(&profGmPages);
+    parentStat->append(hpStats);
+}
+
+void HostPlacement::addCore(uint32_t cid, uint32_t domain) {
+    assert(cid < numCores);
+    uint32_t node = nodeOfDomain(domain);
+    coreNodes[cid] = node;
+    coreCpus[cid] = nodeCpus[node][nodeAssignedCores[node]++ % nodeCpus[node].size()];
+}
+
+void HostPlacement::pinTo(const uint32_t* cpus, uint32_t n) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    for (uint32_t i = 0; i < n; i++) CPU_SET(cpus[i], &cpuset);
+    int r = sched_setaffinity(0 /*calling thread*/, sizeof(cpuset), &cpuset);
+    if (r == 0) {
+        profPins.atomicInc();
+    } else {
+        if (profPinFailures.get() == 0) warn("HostPlacement: sched_setaffinity failed (%d), threads will not be pinned", errno);
+        profPinFailures.atomicInc();
+    }
+}
+
+void HostPlacement::pinCoreThread(uint32_t cid) {
+    assert(cid < numCores);
+    if (pinMode == PIN_CPU) {
+        pinTo(&coreCpus[cid], 1);
+    } else if (pinMode == PIN_NODE) {
+        const g_vector<uint32_t>& cpus = nodeCpus[coreNodes[cid]];
+        pinTo(&cpus[0], cpus.size());
+    }
+}
+
+void HostPlacement::pinWeaveThread(uint32_t thid, uint32_t firstDomain, bool anyDomain) {
+    const g_vector<uint32_t>& cpus = anyDomain? allCpus : nodeCpus[nodeOfDomain(firstDomain)];
+    if (pinMode == PIN_CPU) {
+        //Weave and bound threads never run at the same time, so sharing cpus is fine
+        pinTo(&cpus[thid % cpus.size()], 1);
+    } else if (pinMode == PIN_NODE) {
+        pinTo(&cpus[0], cpus.size());
+    }
+}
+
+void HostPlacement::applySegmentPolicy() {
+    if (memPolicy == MEM_DEFAULT) return;
+    void* base;
+    size_t size;
+    gm_get_segment(&base, &size);
+
+    unsigned long mask[MAX_HOST_NODES/(8*sizeof(unsigned long))];
+    memset(mask, 0, sizeof(mask));
+    for (uint32_t n : nodeIds) mask[n/(8*sizeof(unsigned long))] |= 1ul << (n % (8*sizeof(unsigned long)));
+
+    //MPOL_MF_MOVE migrates the pages we have already touched
+    long r = syscall(SYS_mbind, base, size & ~((size_t)PAGE_BYTES - 1), MPOL_INTERLEAVE, mask, MAX_HOST_NODES + 1, MPOL_MF_MOVE);
+    if (r != 0) {
+        warn("HostPlacement: interleaving the gm segment failed (%d)", errno);
+    } else {
+        info("HostPlacement: interleaved the gm segment (%ld MB) across %d nodes", size >> 20, numNodes);
+    }
+}
+
+void HostPlacement::bindBankMemory(void* start, void* end, uint32_t domain) {
+    if (memPolicy != MEM_BANK) return;
+    //Only bind whole pages, so that we don't move memory of neighboring objects
+    uintptr_t s = ((uintptr_t)start + PAGE_BYTES - 1) & ~((uintptr_t)PAGE_BYTES - 1);
+    uintptr_t e = ((uintptr_t)end) & ~((uintptr_t)PAGE_BYTES - 1);
+    if (e <= s) return;
+
+    uint32_t node = nodeOfDomain(domain);
+    uint32_t hostNode = nodeIds[node];
+    unsigned long mask[MAX_HOST_NODES/(8*sizeof(unsigned long))];
+    memset(mask, 0, sizeof(mask));
+    mask[hostNode/(8*sizeof(unsigned long))] = 1ul << (hostNode % (8*sizeof(unsigned long)));
+
+    //Preferred rather than bind, so we fall back to other nodes instead of failing when the node is full
+    long r = syscall(SYS_mbind, (void*)s, e - s, MPOL_PREFERRED, mask, MAX_HOST_NODES + 1, MPOL_MF_MOVE);
+    if (r != 0) {
+        warn("HostPlacement: binding %ld bytes to node %d failed (%d)", e - s, hostNode, errno);
+    } else {
+        profBoundBytes.inc(node, e - s);
+    }
+}
+
+void HostPlacement::sampleSegmentPages() {
+    if (numNodes == 1) return; //don't bother
+    void* base;
+    size_t size;
+    gm_get_segment(&base, &size);
+    uintptr_t end = (uintptr_t)gm_top();
+
+    //Query page locations in chunks; non-resident pages report a negative status
+    const uint32_t CHUNK = 1024;
+    void* pages[CHUNK];
+    int status[CHUNK];
+    std::vector<uint64_t> counts(numNodes, 0);
+    for (uintptr_t p = (uintptr_t)base; p < end;) {
+        uint32_t n = 0;
+        for (; n < CHUNK && p < end; n++, p += PAGE_BYTES) pages[n] = (void*)p;
+        if (syscall(SYS_move_pages, 0, n, pages, nullptr, status, 0) != 0) {
+            warn("HostPlacement: move_pages failed (%d), not sampling gm pages", errno);
+            return;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            for (uint32_t node = 0; node < numNodes; node++) {
+                if (status[i] == (int)nodeIds[node]) {
+                    counts[node]++;
+                    break;
+                }
+            }
+        }
+    }
+    for (uint32_t node = 0; node < numNodes; node++) profGmPages.inc(node, counts[node] - profGmPages.count(node)); //overwrite the last sample
+}
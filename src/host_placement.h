@@ -0,0 +1,113 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOST_PLACEMENT_H_
+#define HOST_PLACEMENT_H_
+
+/* Host thread and memory placement
+ *
+ * By default, zsim leaves thread placement to the host OS, and the global
+ * heap (gm) segment lands wherever it is first touched, typically on the
+ * socket of the process that initialized the simulator. On multi-socket
+ * hosts, cache and directory state then ping-pongs across sockets.
+ *
+ * HostPlacement maps each simulated domain to a host NUMA node
+ * (domain*numNodes/numDomains), and, depending on the sim block config:
+ *  - Pins bound-phase threads to the node (or a single cpu of the node) of
+ *    the core they run on, and weave threads to the node of their domains
+ *    (or to all nodes, if weave threads steal domains).
+ *  - Interleaves the gm segment across nodes, and optionally binds the
+ *    memory of each cache bank to the node of the bank's domain.
+ *  - Flags which parents of each cache are on a different node, so that
+ *    caches count their cross-node requests (remGETs).
+ * On single-node hosts, or if /sys has no node info, everything is treated
+ * as one node: pinning still works, and memory policies are skipped.
+ */
+
+#include <stdint.h>
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "stats.h"
+
+class HostPlacement : public GlobAlloc {
+    public:
+        enum PinMode {PIN_NONE, PIN_NODE, PIN_CPU};
+        enum MemPolicy {MEM_DEFAULT, MEM_INTERLEAVE, MEM_BANK};
+
+    private:
+        const PinMode pinMode;
+        MemPolicy memPolicy;
+        const uint32_t numCores;
+        const uint32_t numDomains;
+
+        uint32_t numNodes;
+        g_vector<uint32_t> nodeIds; //host node id of each node we use
+        g_vector< g_vector<uint32_t> > nodeCpus; //allowed host cpus of each node
+        g_vector<uint32_t> allCpus; //of all nodes
+
+        uint32_t* coreNodes; //per simulated core
+        uint32_t* coreCpus;
+        uint32_t* nodeAssignedCores; //to spread cores over the cpus of each node
+
+        Counter profPins, profPinFailures;
+        VectorCounter profBoundBytes;
+        VectorCounter profGmPages; //only updated by sampleSegmentPages()
+
+    public:
+        HostPlacement(PinMode _pinMode, MemPolicy _memPolicy, uint32_t _numCores, uint32_t _numDomains);
+
+        static PinMode parsePinMode(const char* str);
+        static MemPolicy parseMemPolicy(const char* str);
+
+        void initStats(AggregateStat* parentStat);
+
+        uint32_t getNumNodes() const {return numNodes;}
+        uint32_t nodeOfDomain(uint32_t domain) const {return domain*numNodes/numDomains;}
+        bool pinsThreads() const {return pinMode != PIN_NONE;}
+        bool bindsBanks() const {return memPolicy == MEM_BANK;}
+
+        void addCore(uint32_t cid, uint32_t domain);
+
+        // Bound-phase threads: the slot identifies the host cpu set of core cid, so
+        // threads only need to re-pin when they move to a core with a different slot
+        uint32_t getCoreSlot(uint32_t cid) const {return (pinMode == PIN_CPU)? coreCpus[cid] : coreNodes[cid];}
+        void pinCoreThread(uint32_t cid);
+
+        // Pins to the node of firstDomain, or to all nodes if the thread may simulate any domain (work stealing)
+        void pinWeaveThread(uint32_t thid, uint32_t firstDomain, bool anyDomain);
+
+        // Memory policies; both are best-effort and warn on failure
+        void applySegmentPolicy();
+        void bindBankMemory(void* start, void* end, uint32_t domain);
+
+        // Counts the resident pages of the used gm segment on each node (the gmPages stat). This scans the
+        // whole segment, so call it at termination or on demand, not on every dump.
+        void sampleSegmentPages();
+
+    private:
+        void pinTo(const uint32_t* cpus, uint32_t n);
+};
+
+#endif  // HOST_PLACEMENT_H_
@@ -0,0 +1,169 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "core.h"
+#include "galloc.h"
+#include "live_stats.h"
+#include "log.h"
+#include "profile_stats.h"
+#include "stats.h"
+#include "zsim.h"
+
+using namespace livestats;
+
+/* Process-local mapping of the live stats object. Dumps may run in any
+ * process (e.g., async events run at the barrier if there are no helper
+ * threads), so each process maps the object on first use. There is at most
+ * one live backend per simulation.
+ */
+static ShmHeader* localHdr = nullptr;
+
+class LiveStatsBackendImpl : public GlobAlloc {
+    private:
+        const char* shmName;
+        size_t bytes;
+        uint32_t numCores;
+        g_vector<ScalarStat*> llcMissStats;
+        g_vector<ScalarStat*> ftmStats;
+        uint64_t records;
+
+        static void findScalars(AggregateStat* agg, const char* const* names, uint32_t numNames, g_vector<ScalarStat*>& res) {
+            for (uint32_t i = 0; i < agg->size(); i++) {
+                Stat* s = agg->get(i);
+                AggregateStat* as = dynamic_cast<AggregateStat*>(s);
+                ScalarStat* ss = dynamic_cast<ScalarStat*>(s);
+                if (as) {
+                    findScalars(as, names, numNames, res);
+                } else if (ss) {
+                    for (uint32_t n = 0; n < numNames; n++) {
+                        if (strcmp(ss->name(), names[n]) == 0) res.push_back(ss);
+                    }
+                }
+            }
+        }
+
+        static uint64_t sum(const g_vector<ScalarStat*>& stats) {
+            uint64_t res = 0;
+            for (ScalarStat* s : stats) res += s->get();
+            return res;
+        }
+
+        ShmHeader* getHeader() {
+            if (!localHdr) {
+                int fd = shm_open(shmName, O_RDWR, 0);
+                if (fd < 0) panic("Could not open live stats object %s: %s", shmName, strerror(errno));
+                void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (p == MAP_FAILED) panic("Could not map live stats object %s: %s", shmName, strerror(errno));
+                close(fd);
+                localHdr = static_cast<ShmHeader*>(p);
+            }
+            return localHdr;
+        }
+
+    public:
+        LiveStatsBackendImpl(const char* _shmName, AggregateStat* rootStat, const char* llcName, uint32_t numSlots) :
+            shmName(_shmName), numCores(zinfo->numCores), records(0)
+        {
+            assert(numSlots);
+            bytes = shmBytes(numCores, numSlots);
+
+            // LLC misses: all GETS/GETX misses under the LLC group; FTM misses: all caches
+            for (uint32_t i = 0; i < rootStat->size(); i++) {
+                AggregateStat* as = dynamic_cast<AggregateStat*>(rootStat->get(i));
+                if (as && strcmp(as->name(), llcName) == 0) {
+                    const char* missNames[] = {"mGETS", "mGETXIM", "mGETXSM"};
+                    findScalars(as, missNames, 3, llcMissStats);
+                }
+            }
+            if (llcMissStats.empty()) warn("Live stats: no miss counters found for LLC %s, LLC MPKI will be 0", llcName);
+            const char* ftmNames[] = {"firstTimeMiss"};
+            findScalars(rootStat, ftmNames, 1, ftmStats);
+
+            shm_unlink(shmName); //stale object from a previous run with the same name
+            int fd = shm_open(shmName, O_RDWR | O_CREAT | O_EXCL, 0644);
+            if (fd < 0) panic("Could not create live stats object %s: %s", shmName, strerror(errno));
+            if (ftruncate(fd, bytes) != 0) panic("Could not size live stats object %s: %s", shmName, strerror(errno));
+            close(fd);
+
+            ShmHeader* hdr = getHeader(); //zero-filled by ftruncate
+            hdr->version = SCHEMA_VERSION;
+            hdr->headerBytes = livestats::headerBytes();
+            hdr->slotBytes = slotBytes(numCores);
+            hdr->numSlots = numSlots;
+            hdr->numCores = numCores;
+            hdr->pid = zinfo->harnessPid;
+            hdr->startNs = getNs();
+            hdr->published = 0;
+            hdr->state = SIM_RUNNING;
+            strncpy(hdr->outputDir, zinfo->outputDir, sizeof(hdr->outputDir) - 1);
+            __sync_synchronize();
+            memcpy(hdr->magic, SHM_MAGIC, sizeof(SHM_MAGIC)); //readers ignore the object until this is set
+            info("Publishing live stats to %s (%d slots, %ld bytes)", shmName, numSlots, bytes);
+        }
+
+        void publish(bool final) {
+            ShmHeader* hdr = getHeader();
+            uint64_t rec = records++;
+            RecordHeader* r = slot(hdr, rec);
+
+            r->seq = 2*rec + 1;
+            __sync_synchronize();
+            r->phase = zinfo->numPhases;
+            r->wallNs = getNs();
+            r->boundNs = zinfo->profSimTime->count(PROF_BOUND);
+            r->weaveNs = zinfo->profSimTime->count(PROF_WEAVE);
+            r->llcMisses = sum(llcMissStats);
+            r->ftmMisses = sum(ftmStats);
+            uint64_t* cycles = slotCycles(r);
+            uint64_t* instrs = slotInstrs(r, numCores);
+            for (uint32_t c = 0; c < numCores; c++) {
+                cycles[c] = zinfo->cores[c]->getCycles();
+                instrs[c] = zinfo->cores[c]->getInstrs();
+            }
+            __sync_synchronize();
+            r->seq = 2*rec + 2;
+            hdr->published = rec + 1;
+
+            if (final) {
+                hdr->state = SIM_FINISHED;
+                __sync_synchronize();
+                shm_unlink(shmName); //monitors that have it mapped still see the final record
+            }
+        }
+};
+
+LiveStatsBackend::LiveStatsBackend(const char* shmName, AggregateStat* rootStat, const char* llcName, uint32_t numSlots) {
+    backend = new LiveStatsBackendImpl(shmName, rootStat, llcName, numSlots);
+}
+
+void LiveStatsBackend::dump(bool buffered) {
+    backend->publish(!buffered);
+}
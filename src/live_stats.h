@@ -0,0 +1,121 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIVE_STATS_H_
+#define LIVE_STATS_H_
+
+/* Live stats ring, written by LiveStatsBackend and read by zsimtop.
+ *
+ * The simulator publishes a few key aggregates (per-core cycles and instrs,
+ * LLC misses, FTM misses, bound/weave time) into a POSIX shared-memory
+ * object, so that monitors can watch running simulations without touching
+ * their output files.
+ *
+ * Layout: ShmHeader, then numSlots slots of slotBytes each. Record i goes to
+ * slot i % numSlots, and is a RecordHeader followed by uint64_t
+ * cycles[numCores], then uint64_t instrs[numCores].
+ *
+ * Each slot is a seqlock: the writer sets seq to 2*i+1 before writing record
+ * i and to 2*i+2 after. A reader that wants record i copies the slot, and the
+ * copy is valid iff seq was 2*i+2 both before and after the copy. Readers
+ * never write to the object.
+ *
+ * Readers must check magic and version; any layout change bumps the version.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+namespace livestats {
+
+static const char SHM_MAGIC[8] = {'Z', 'S', 'L', 'I', 'V', 'E', '0', '1'};
+static const uint32_t SCHEMA_VERSION = 1;
+static const char SHM_PREFIX[] = "/zsimlive."; //default object name is SHM_PREFIX + harness pid
+
+enum SimState {SIM_RUNNING = 0, SIM_FINISHED = 1};
+
+struct ShmHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerBytes; //offset of slot 0
+    uint32_t slotBytes;
+    uint32_t numSlots;
+    uint32_t numCores;
+    uint32_t pid; //harness pid
+    uint64_t startNs; //CLOCK_REALTIME, at init
+    volatile uint64_t published; //records published so far; the latest is published-1
+    volatile uint32_t state; //SimState
+    uint32_t pad;
+    char outputDir[256];
+};
+
+struct RecordHeader {
+    volatile uint64_t seq;
+    uint64_t phase;
+    uint64_t wallNs; //CLOCK_REALTIME, at publish time
+    uint64_t boundNs; //host time spent in the bound and weave phases
+    uint64_t weaveNs;
+    uint64_t llcMisses; //GETS + GETX misses, all LLC banks
+    uint64_t ftmMisses; //first-time misses, all caches
+};
+
+static inline uint32_t slotBytes(uint32_t numCores) {
+    uint32_t sz = sizeof(RecordHeader) + 2*numCores*sizeof(uint64_t);
+    return (sz + 63) & ~63u;
+}
+
+static inline uint32_t headerBytes() {
+    return (sizeof(ShmHeader) + 63) & ~63u;
+}
+
+static inline size_t shmBytes(uint32_t numCores, uint32_t numSlots) {
+    return headerBytes() + ((size_t)numSlots)*slotBytes(numCores);
+}
+
+static inline RecordHeader* slot(const ShmHeader* hdr, uint64_t rec) {
+    return (RecordHeader*)(((char*)hdr) + hdr->headerBytes + (rec % hdr->numSlots)*hdr->slotBytes);
+}
+
+static inline uint64_t* slotCycles(RecordHeader* r) {return (uint64_t*)(r + 1);}
+static inline uint64_t* slotInstrs(RecordHeader* r, uint32_t numCores) {return slotCycles(r) + numCores;}
+
+static inline bool validHeader(const ShmHeader* hdr) {
+    return memcmp(hdr->magic, SHM_MAGIC, sizeof(SHM_MAGIC)) == 0 && hdr->version == SCHEMA_VERSION;
+}
+
+// Copies record rec into buf (slotBytes long); returns false if it was not published yet or has been overwritten
+static inline bool readRecord(const ShmHeader* hdr, uint64_t rec, void* buf) {
+    RecordHeader* r = slot(hdr, rec);
+    uint64_t seq = r->seq;
+    if (seq != 2*rec + 2) return false;
+    __sync_synchronize();
+    memcpy(buf, (const void*)r, hdr->slotBytes);
+    __sync_synchronize();
+    return r->seq == seq;
+}
+
+}  // namespace livestats
+
+#endif  // LIVE_STATS_H_
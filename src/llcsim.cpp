@@ -0,0 +1,181 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Standalone trace-driven LLC simulator. Replays sim.traceFile through the
+ * caches and memory in sys.caches and sys.mem, as zsim does with
+ * sim.traceDriven = true, but without Pin, cores or the weave phase, so it
+ * runs natively on any Linux machine. Writes llcsim.out (text stats) and
+ * out.cfg to the output directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "access_tracing.h"
+#include "bithacks.h"
+#include "cache_builder.h"
+#include "config.h"
+#include "constants.h"
+#include "contention_sim.h"
+#include "event_queue.h"
+#include "galloc.h"
+#include "log.h"
+#include "stats.h"
+#include "trace_driver.h"
+#include "zsim.h"
+
+// Globals that libzsim.so defines in zsim.cpp
+GlobSimInfo* zinfo;
+uint32_t procIdx;
+uint32_t lineBits;
+Address procMask;
+uint32_t proc_partition;
+
+/* The weave phase needs the contention simulator, which is part of the
+ * pintool. Timing caches and event-driven memory controllers are rejected
+ * below, before the hierarchy is built, so these never run.
+ */
+void ContentionSim::enqueue(TimingEvent* ev, uint64_t cycle) {
+    panic("llcsim has no weave phase");
+}
+
+void ContentionSim::enqueueSynced(TimingEvent* ev, uint64_t cycle) {
+    panic("llcsim has no weave phase");
+}
+
+void ContentionSim::enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t srcId, uint32_t srcDomain, uint32_t dstDomain, EventRecorder* evRec) {
+    panic("llcsim has no weave phase");
+}
+
+static void CheckNoWeaveModels(Config& config) {
+    std::vector<const char*> groups;
+    config.subgroups("sys.caches", groups);
+    for (const char* grp : groups) {
+        std::string type = config.get<const char*>(std::string("sys.caches.") + grp + ".type", "Simple");
+        if (type == "Timing") panic("sys.caches.%s: Timing caches need the weave phase, use zsim or type = \"Simple\"", grp);
+    }
+
+    std::string memType = config.get<const char*>("sys.mem.type", "Simple");
+    if (memType != "Simple" && memType != "MD1") {
+        panic("sys.mem.type = %s needs the weave phase, use zsim or a Simple or MD1 memory", memType.c_str());
+    }
+}
+
+static void usage(const char* prog) {
+    info("Replays an access trace through the memory hierarchy of a zsim config, without Pin");
+    info("Usage: %s <config> [output dir (default: .)]", prog);
+    exit(1);
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog("[L] ");
+    if (argc < 2 || argc > 3) usage(argv[0]);
+    const char* configFile = argv[1];
+    const char* outputDir = (argc == 3)? argv[2] : ".";
+
+    Config config(configFile);
+    uint32_t gmMBytes = config.get<uint32_t>("sim.gmMBytes", (1 << 10));
+    gm_init(((size_t)gmMBytes) << 20);
+
+    // Same defaults as SimInit, restricted to what the memory hierarchy and the trace driver use
+    zinfo = gm_calloc<GlobSimInfo>();
+    zinfo->outputDir = gm_strdup(outputDir);
+    zinfo->statsBackends = new g_vector<StatsBackend*>();
+    zinfo->rootStat = new AggregateStat();
+    zinfo->rootStat->init("root", "Stats");
+
+    if (!config.get<bool>("sim.traceDriven", true)) panic("llcsim needs a trace-driven config (sim.traceDriven = true)");
+    zinfo->traceDriven = true;
+    zinfo->numCores = 0;
+    zinfo->numProcs = 1;
+    zinfo->numDomains = 1;
+    zinfo->eventRecorders = gm_calloc<EventRecorder*>(MAX_CACHE_CHILDREN); //the trace driver uses child ids as source ids
+    zinfo->traceWriters = new g_vector<AccessTraceWriter*>();
+
+    zinfo->numPhases = 0;
+    zinfo->phaseLength = config.get<uint32_t>("sim.phaseLength", 10000);
+    zinfo->nextPhaseLength = zinfo->phaseLength;
+    zinfo->maxPhaseLength = zinfo->phaseLength;
+    zinfo->freqMHz = config.get<uint32_t>("sys.frequency", 2000);
+    zinfo->maxPhases = config.get<uint64_t>("sim.maxPhases", 0);
+
+    zinfo->ftmEnable = config.get<bool>("sim.ftmEnable", false);
+    zinfo->ftmTypeFlag = config.get<uint32_t>("sim.ftmTypeFlag", 0);
+    zinfo->scatterCache = config.get<bool>("sim.scatterCache", false);
+    zinfo->setPartition = config.get<bool>("sim.setPartition", false);
+    zinfo->wayPartition = config.get<bool>("sim.wayPartition", false);
+
+    zinfo->eventQueue = new EventQueue(); //partitioners schedule their ticks here
+
+    zinfo->lineSize = config.get<uint32_t>("sys.lineSize", 64);
+    assert(zinfo->lineSize > 0);
+    lineBits = ilog2(zinfo->lineSize);
+    procMask = 0; //single process (procIdx 0)
+    zinfo->refreshRate = (float)config.get<uint32_t>("sys.refreshRate", 10);
+
+    ProxyStat* phaseStat = new ProxyStat();
+    phaseStat->init("phase", "Simulated phases", &zinfo->numPhases);
+    zinfo->rootStat->append(phaseStat);
+
+    CheckNoWeaveModels(config);
+    CacheHierarchy* hierarchy = BuildCacheHierarchy(config);
+    TraceDriver* driver = BuildTraceDriver(config, *hierarchy);
+    zinfo->traceDriver = driver;
+    driver->initStats(zinfo->rootStat);
+    InitCacheHierarchyStats(*hierarchy, zinfo->rootStat);
+    delete hierarchy;
+
+    zinfo->eventQueue->initStats(zinfo->rootStat);
+    zinfo->rootStat->makeImmutable();
+    std::string statsFile = std::string(outputDir) + "/llcsim.out";
+    zinfo->statsBackends->push_back(new TextBackend(gm_strdup(statsFile.c_str()), zinfo->rootStat));
+
+    // Configs are shared with zsim, so settings that only zsim reads are expected
+    config.writeAndClose((std::string(outputDir) + "/out.cfg").c_str(), false);
+    info("Initialization complete");
+
+    // Replay threads block on the driver between phases and never return, so they are not joined
+    for (uint32_t i = 0; i < driver->getNumThreads(); i++) {
+        std::thread(TraceDriver::ReplayThreadTrampoline, driver).detach();
+    }
+
+    while (driver->executePhase()) {
+        zinfo->eventQueue->tick();
+        zinfo->numPhases++;
+        zinfo->globPhaseCycles += zinfo->phaseLength;
+        if (zinfo->maxPhases && zinfo->numPhases >= zinfo->maxPhases) {
+            info("Max phases reached (%ld)", zinfo->numPhases);
+            break;
+        }
+    }
+    info("Finished trace-driven simulation, %ld phases", zinfo->numPhases);
+
+    for (StatsBackend* backend : *(zinfo->statsBackends)) backend->dump(false);
+    for (AccessTraceWriter* t : *(zinfo->traceWriters)) t->dump(false);
+    return 0;
+}
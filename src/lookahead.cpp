@@ -162,3 +162,140 @@ void LookaheadPartitioner::partition() {
     repl->setPartitionSizes(curAllocs);
     repl->getMonitor()->reset();
 }
+
+// IncrementalLookaheadPartitioner
+
+IncrementalLookaheadPartitioner::IncrementalLookaheadPartitioner(PartReplPolicy* _repl, uint32_t _numPartitions, uint32_t _buckets,
+                                                                 uint32_t _minAlloc, double _allocPortion, bool* _forbidden)
+        : Partitioner(_minAlloc, _allocPortion, _forbidden)
+        , repl(_repl)
+        , numPartitions(_numPartitions)
+        , buckets(_buckets)
+        , hulls(_numPartitions)
+        , hullVersions(_numPartitions, (uint64_t)-1L)
+        , hullPos(_numPartitions, 0) {
+    assert_msg(buckets > 0, "Must have non-zero buckets to avoid divide-by-zero exception.");
+
+    curAllocs = gm_calloc<uint32_t>(numPartitions);
+    gainHeap.reserve(numPartitions);
+    scanParts.reserve(numPartitions);
+
+    info("IncrementalLookaheadPartitioner: %d part buckets", buckets);
+}
+
+// Builds the lower convex hull of points (a, misses[a]), a in [minAlloc, maxAlloc].
+// Collinear points are kept, so the next vertex is always the *smallest*
+// allocation achieving the max marginal utility, which is what lookahead picks.
+void IncrementalLookaheadPartitioner::updateHull(uint32_t part, uint32_t minAlloc, uint32_t maxAlloc, const PartitionMonitor& monitor) {
+    g_vector<uint32_t>& hull = hulls[part];
+    hull.clear();
+    for (uint32_t a = minAlloc; a <= maxAlloc; a++) {
+        int64_t m = monitor.get(part, a);
+        while (hull.size() >= 2) {
+            uint32_t a1 = hull[hull.size()-2];
+            uint32_t a2 = hull[hull.size()-1];
+            int64_t m1 = monitor.get(part, a1);
+            int64_t m2 = monitor.get(part, a2);
+            // a2 is above the a1->a line (strictly) => not on the lower hull
+            int64_t cross = (m2 - m1)*(int64_t)(a - a1) - (m - m1)*(int64_t)(a2 - a1);
+            if (cross > 0) hull.pop_back();
+            else break;
+        }
+        hull.push_back(a);
+    }
+}
+
+void IncrementalLookaheadPartitioner::pushNextSegment(uint32_t part, const PartitionMonitor& monitor) {
+    const g_vector<uint32_t>& hull = hulls[part];
+    uint32_t pos = hullPos[part];
+    if (pos + 1 >= hull.size()) return;  // at the end of the curve, nothing left to gain
+    uint32_t partAlloc = hull[pos];
+    uint32_t extra = hull[pos+1] - partAlloc;
+    // Same arithmetic as lookahead::getMaxMarginalUtility, so ties break identically
+    uint64_t extraHits = monitor.get(part, partAlloc) - monitor.get(part, partAlloc + extra);
+    HullGain g = {((double)extraHits)/((double)extra), part, extra};
+    gainHeap.push_back(g);
+    std::push_heap(gainHeap.begin(), gainHeap.end());
+}
+
+void IncrementalLookaheadPartitioner::computeBestPartitioning(uint32_t totalBuckets, uint32_t minAlloc, uint32_t* allocs, const PartitionMonitor& monitor) {
+    uint32_t balance = totalBuckets - minAlloc;
+
+    gainHeap.clear();
+    scanParts.clear();
+    for (uint32_t p = 0; p < numPartitions; p++) {
+        allocs[p] = minAlloc;
+        if (forbidden && forbidden[p]) continue;
+
+        // Allocations never exceed totalBuckets (see lookahead), so that's the hull range
+        uint64_t version = monitor.getVersion(p);
+        if (version != hullVersions[p] || hulls[p].empty() || hulls[p][0] != minAlloc || hulls[p].back() != totalBuckets) {
+            updateHull(p, minAlloc, totalBuckets, monitor);
+            hullVersions[p] = version;
+        }
+        hullPos[p] = 0;
+        pushNextSegment(p, monitor);
+    }
+
+    while (balance > 0) {
+        // Segments that no longer fit leave the hull; from then on, the
+        // balance-capped lookahead scan gives the exact utility (the balance
+        // only shrinks, so this is rare and over few buckets)
+        while (!gainHeap.empty() && gainHeap[0].alloc > balance) {
+            scanParts.push_back(gainHeap[0].part);
+            std::pop_heap(gainHeap.begin(), gainHeap.end());
+            gainHeap.pop_back();
+        }
+
+        double maxMu = -1.0;
+        uint32_t maxMuPart = numPartitions;  // illegal
+        uint32_t maxMuAlloc = 0;
+        bool fromHeap = false;
+        if (!gainHeap.empty()) {
+            maxMu = gainHeap[0].mu;
+            maxMuPart = gainHeap[0].part;
+            maxMuAlloc = gainHeap[0].alloc;
+            fromHeap = true;
+        }
+
+        for (uint32_t p : scanParts) {
+            uint32_t muAlloc;
+            double mu;
+            tie(mu, muAlloc) = lookahead::getMaxMarginalUtility(numPartitions, p, allocs[p], balance, monitor);
+            if (mu > maxMu || (mu == maxMu && p < maxMuPart)) {
+                maxMu = mu;
+                maxMuPart = p;
+                maxMuAlloc = muAlloc;
+                fromHeap = false;
+            }
+        }
+
+        assert(maxMuPart < numPartitions);
+        allocs[maxMuPart] += maxMuAlloc;
+        balance -= maxMuAlloc;
+
+        if (fromHeap) {
+            std::pop_heap(gainHeap.begin(), gainHeap.end());
+            gainHeap.pop_back();
+            hullPos[maxMuPart]++;
+            pushNextSegment(maxMuPart, monitor);
+        }
+    }
+}
+
+void IncrementalLookaheadPartitioner::partition() {
+    auto& monitor = *repl->getMonitor();
+
+    uint32_t bestAllocs[numPartitions];
+    // NOTE: Same (odd) minAlloc scaling as LookaheadPartitioner, to produce identical allocations
+    computeBestPartitioning(allocPortion*buckets, minAlloc*numPartitions, bestAllocs, monitor);
+    std::copy(bestAllocs, bestAllocs+numPartitions, curAllocs);
+
+#if UMON_INFO
+    info("IncrementalLookaheadPartitioner: Partitioning done,");
+    for (uint32_t i = 0; i < numPartitions; i++) info("buckets[%d] = %d", i, curAllocs[i]);
+#endif
+
+    repl->setPartitionSizes(curAllocs);
+    repl->getMonitor()->reset();
+}
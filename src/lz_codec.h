@@ -0,0 +1,133 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LZ_CODEC_H_
+#define LZ_CODEC_H_
+
+/* Small LZ77 codec for on-disk blocks, in the spirit of LZ4: a single-probe
+ * hash table finds 4-byte matches up to 64KB back, and the output is a series
+ * of sequences:
+ *
+ *   varint literalLen, literalLen bytes, varint matchCode [, varint offset]
+ *
+ * matchCode == 0 means no match follows (only used by the last sequence);
+ * otherwise the match is (matchCode + LZ_MIN_MATCH - 1) bytes, copied from
+ * offset bytes back. Matches may overlap the output, which gives cheap RLE.
+ *
+ * This trades some ratio for speed and no external dependencies; it works
+ * best on inputs that have already been delta/varint-coded.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "varint.h"
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 14
+
+static inline uint32_t lzRead32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t lzHash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Appends the compressed form of in[0..n) to out
+static inline void lzCompress(const uint8_t* in, size_t n, std::vector<uint8_t>& out) {
+    std::vector<uint32_t> table(1 << LZ_HASH_BITS, 0); // position+1, 0 == empty
+    size_t anchor = 0;
+    size_t i = 0;
+    uint32_t misses = 0;
+    while (n >= LZ_MIN_MATCH && i <= n - LZ_MIN_MATCH) {
+        uint32_t seq = lzRead32(&in[i]);
+        uint32_t h = lzHash(seq);
+        size_t ref = table[h];
+        table[h] = i + 1;
+        if (!ref || i - (ref - 1) > LZ_MAX_OFFSET || lzRead32(&in[ref - 1]) != seq) {
+            // Skip faster over incompressible data
+            i += 1 + (misses++ >> 5);
+            continue;
+        }
+        ref--;
+        misses = 0;
+
+        size_t len = LZ_MIN_MATCH;
+        while (i + len < n && in[ref + len] == in[i + len]) len++;
+
+        putVarint(i - anchor, out);
+        out.insert(out.end(), &in[anchor], &in[i]);
+        putVarint(len - LZ_MIN_MATCH + 1, out);
+        putVarint(i - ref, out);
+
+        // Seed the table inside the match so the next ones can chain off it
+        for (size_t j = i + 1; j + LZ_MIN_MATCH <= n && j < i + len; j += 2) {
+            table[lzHash(lzRead32(&in[j]))] = j + 1;
+        }
+        i += len;
+        anchor = i;
+    }
+
+    putVarint(n - anchor, out);
+    out.insert(out.end(), in + anchor, in + n);
+    putVarint(0, out);
+}
+
+// Decompresses [p, end) into out[0..n). Returns false unless the input is
+// well-formed and decompresses to exactly n bytes.
+static inline bool lzDecompress(const uint8_t* p, const uint8_t* end, uint8_t* out, size_t n) {
+    size_t o = 0;
+    while (true) {
+        uint64_t litLen, matchCode;
+        if (!getVarint(p, end, litLen)) return false;
+        if (litLen > (uint64_t)(end - p) || litLen > n - o) return false;
+        memcpy(&out[o], p, litLen);
+        p += litLen;
+        o += litLen;
+
+        if (!getVarint(p, end, matchCode)) return false;
+        if (!matchCode) break;
+
+        uint64_t offset;
+        if (!getVarint(p, end, offset)) return false;
+        uint64_t len = matchCode + LZ_MIN_MATCH - 1;
+        if (!offset || offset > o || len > n - o) return false;
+        const uint8_t* src = &out[o - offset];
+        uint8_t* dst = &out[o];
+        if (offset >= len) {
+            memcpy(dst, src, len);
+        } else {
+            for (uint64_t j = 0; j < len; j++) dst[j] = src[j];
+        }
+        o += len;
+    }
+    return o == n && p == end;
+}
+
+#endif  // LZ_CODEC_H_
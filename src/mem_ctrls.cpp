@@ -64,6 +64,7 @@ MD1Memory::MD1Memory(uint32_t requestSize, uint32_t megacyclesPerSecond, uint32_
     : zeroLoadLatency(_zeroLoadLatency), name(_name)
 {
     lastPhase = 0;
+    lastPhaseCycles = 0;
 
     double bytesPerCycle = ((double)megabytesPerSecond)/((double)megacyclesPerSecond);
     maxRequestsPerCycle = bytesPerCycle/requestSize;
@@ -79,7 +80,7 @@ MD1Memory::MD1Memory(uint32_t requestSize, uint32_t megacyclesPerSecond, uint32_
 }
 
 void MD1Memory::updateLatency() {
-    uint32_t phaseCycles = (zinfo->numPhases - lastPhase)*(zinfo->phaseLength);
+    uint64_t phaseCycles = zinfo->globPhaseCycles - lastPhaseCycles;
     if (phaseCycles < 10000) return; //Skip with short phases
 
     smoothedPhaseAccesses =  (curPhaseAccesses*0.5) + (smoothedPhaseAccesses*0.5);
@@ -104,6 +105,7 @@ void MD1Memory::updateLatency() {
     curPhaseAccesses = 0;
     __sync_synchronize();
     lastPhase = zinfo->numPhases;
+    lastPhaseCycles = zinfo->globPhaseCycles;
 }
 
 uint64_t MD1Memory::access(MemReq& req) {
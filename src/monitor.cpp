@@ -25,23 +25,22 @@
 
 #include "partitioner.h"
 
-// UMon
+// UtilityPartitionMonitor
 
-UMonMonitor::UMonMonitor(uint32_t _numLines, uint32_t _umonLines, uint32_t _umonBuckets, uint32_t _numPartitions, uint32_t _buckets)
+template <class M>
+UtilityPartitionMonitor<M>::UtilityPartitionMonitor(uint32_t _numPartitions, uint32_t _buckets)
         : PartitionMonitor(_buckets)
+        , monitors(_numPartitions, nullptr)
         , missCache(nullptr)
-        , missCacheValid(false)
-        , monitors(_numPartitions, nullptr) {
+        , missCacheValid(_numPartitions, false)
+        , versions(_numPartitions, 0) {
     assert(_numPartitions > 0);
 
-    missCache = gm_calloc<uint32_t>(_buckets * _numPartitions);
-
-    for (auto& monitor : monitors) {
-        monitor = new UMon(_numLines, _umonLines, _umonBuckets);
-    }
+    missCache = gm_calloc<uint32_t>((_buckets + 1) * _numPartitions);
 }
 
-UMonMonitor::~UMonMonitor() {
+template <class M>
+UtilityPartitionMonitor<M>::~UtilityPartitionMonitor() {
     for (auto monitor : monitors) {
         delete monitor;
     }
@@ -49,41 +48,47 @@ UMonMonitor::~UMonMonitor() {
     monitors.clear();
 }
 
-void UMonMonitor::access(uint32_t partition, Address lineAddr) {
+template <class M>
+void UtilityPartitionMonitor<M>::access(uint32_t partition, Address lineAddr) {
     assert(partition < monitors.size());
     monitors[partition]->access(lineAddr);
 
     // check optimization assumption -- we shouldn't cache all misses
     // if they are getting accessed while they are updated! -nzb
-    assert(!missCacheValid);
-    missCacheValid = false;
+    assert(!missCacheValid[partition]);
+    versions[partition]++;
 }
 
-uint32_t UMonMonitor::getNumAccesses(uint32_t partition) const {
+template <class M>
+uint32_t UtilityPartitionMonitor<M>::getNumAccesses(uint32_t partition) const {
     assert(partition < monitors.size());
 
     auto monitor = monitors[partition];
     return monitor->getNumAccesses();
 }
 
-uint32_t UMonMonitor::get(uint32_t partition, uint32_t bucket) const {
+template <class M>
+uint32_t UtilityPartitionMonitor<M>::get(uint32_t partition, uint32_t bucket) const {
     assert(partition < monitors.size());
 
-    if (!missCacheValid) {
-        getMissCurves();
-        missCacheValid = true;
+    assert(bucket <= buckets);
+
+    if (!missCacheValid[partition]) {
+        getMissCurve(&missCache[partition*(buckets+1)], partition);
+        missCacheValid[partition] = true;
     }
 
-    return missCache[partition*buckets+bucket];
+    return missCache[partition*(buckets+1)+bucket];
 }
 
-void UMonMonitor::getMissCurves() const {
-    for (uint32_t partition = 0; partition < getNumPartitions(); partition++) {
-        getMissCurve(&missCache[partition*buckets], partition);
-    }
+template <class M>
+uint64_t UtilityPartitionMonitor<M>::getVersion(uint32_t partition) const {
+    assert(partition < monitors.size());
+    return versions[partition];
 }
 
-void UMonMonitor::getMissCurve(uint32_t* misses, uint32_t partition) const {
+template <class M>
+void UtilityPartitionMonitor<M>::getMissCurve(uint32_t* misses, uint32_t partition) const {
     assert(partition < monitors.size());
 
     auto monitor = monitors[partition];
@@ -127,9 +132,34 @@ void UMonMonitor::getMissCurve(uint32_t* misses, uint32_t partition) const {
       */
 }
 
-void UMonMonitor::reset() {
-    for (auto monitor : monitors) {
-        monitor->startNextInterval();
+template <class M>
+void UtilityPartitionMonitor<M>::reset() {
+    for (uint32_t p = 0; p < this->getNumPartitions(); p++) {
+        // an idle partition keeps its (all-zero) curve and version
+        if (monitors[p]->getNumAccesses()) versions[p]++;
+        monitors[p]->startNextInterval();
+        missCacheValid[p] = false;
+    }
+}
+
+template class UtilityPartitionMonitor<UMon>;
+template class UtilityPartitionMonitor<DuelingUMon>;
+
+// UMonMonitor
+
+UMonMonitor::UMonMonitor(uint32_t _numLines, uint32_t _umonLines, uint32_t _umonBuckets, uint32_t _numPartitions, uint32_t _buckets)
+        : UtilityPartitionMonitor<UMon>(_numPartitions, _buckets) {
+    for (auto& monitor : monitors) {
+        monitor = new UMon(_numLines, _umonLines, _umonBuckets);
+    }
+}
+
+// DuelingUMonMonitor
+
+DuelingUMonMonitor::DuelingUMonMonitor(uint32_t _numLines, uint32_t _umonLines, uint32_t _umonBuckets, uint32_t _numPartitions, uint32_t _buckets,
+                                       uint32_t _points, uint32_t _maxSamplingShift, uint64_t _targetSamples)
+        : UtilityPartitionMonitor<DuelingUMon>(_numPartitions, _buckets) {
+    for (auto& monitor : monitors) {
+        monitor = new DuelingUMon(_numLines, _umonLines, _umonBuckets, _points, _maxSamplingShift, _targetSamples);
     }
-    missCacheValid = false;
 }
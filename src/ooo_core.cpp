@@ -120,11 +120,13 @@ void OOOCore::initStats(AggregateStat* parentStat) {
     profIssueStalls.init("issueStalls",  "Issue stalls");  coreStat->append(&profIssueStalls);
 #endif
 
+    cRec.getEventRecorder()->initStats(coreStat);
+
     parentStat->append(coreStat);
 }
 
 uint64_t OOOCore::getInstrs() const {return instrs;}
-uint64_t OOOCore::getPhaseCycles() const {return curCycle % zinfo->phaseLength;}
+uint64_t OOOCore::getPhaseCycles() const {return (curCycle > zinfo->globPhaseCycles)? curCycle - zinfo->globPhaseCycles : 0;}
 
 void OOOCore::contextSwitch(int32_t gid) {
     if (gid == -1) {
@@ -622,8 +624,6 @@ void OOOCore::BblFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
     core->bbl(bblAddr, bblInfo);
 
     while (core->curCycle > core->phaseEndCycle) {
-        core->phaseEndCycle += zinfo->phaseLength;
-
         uint32_t cid = getCid(tid);
         // NOTE: TakeBarrier may take ownership of the core, and so it will be used by some other thread. If TakeBarrier context-switches us,
         // the *only* safe option is to return inmmediately after we detect this, or we can race and corrupt core state. However, the information
@@ -634,6 +634,7 @@ void OOOCore::BblFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
         // This is fine, since the loop looks at core values directly and there are no locals involved,
         // so we should just advance as needed and move on.
         if (newCid != cid) break;  /*context-switch, we do not own this context anymore*/
+        core->phaseEndCycle = zinfo->globPhaseCycles + zinfo->phaseLength; //set after the barrier, the phase length may have changed
     }
 }
 
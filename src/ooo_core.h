@@ -454,6 +454,7 @@ class OOOCore : public Core {
         inline EventRecorder* getEventRecorder() {return cRec.getEventRecorder();}
         void cSimStart();
         void cSimEnd();
+        uint64_t getContentionCycles() const {return cRec.getContentionCycles();}
 
     private:
         inline void load(Address addr);
@@ -274,6 +274,7 @@ void OOOCoreRecorder::recordAccess(uint64_t curCycle, uint64_t dispatchCycle, ui
 
 
 uint64_t OOOCoreRecorder::cSimStart(uint64_t curCycle) {
+    eventRecorder.samplePhase();
     if (state == HALTED) return curCycle; //nothing to do
 
     DEBUG_MSG("[%s] Cycle %ld cSimStart %d", name.c_str(), curCycle, state);
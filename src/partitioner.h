@@ -34,6 +34,7 @@
 #include "utility_monitor.h"
 
 class PartReplPolicy;
+class PartitionMonitor;
 
 // allocates space in a cache between multiple partitions
 class Partitioner : public GlobAlloc {
@@ -76,6 +77,46 @@ class LookaheadPartitioner : public Partitioner {
         uint32_t* curAllocs;
 };
 
+// Produces the same allocations as LookaheadPartitioner, but works on the
+// lower convex hull of each miss curve (the "peekahead" observation: from a
+// hull vertex, the max marginal utility is always the next hull segment). Hulls
+// are cached and only rebuilt for partitions whose curves changed, and the
+// best gains are kept in a heap, so each partitioning is
+// O(parts*buckets + buckets*log(parts)) instead of O(parts*buckets^2).
+class IncrementalLookaheadPartitioner : public Partitioner {
+    public:
+        IncrementalLookaheadPartitioner(PartReplPolicy* _repl, uint32_t _numPartitions, uint32_t _buckets,
+                                        uint32_t _minAlloc = 1, double _allocPortion = 1.0, bool* _forbidden = nullptr);
+        void partition();
+
+    private:
+        struct HullGain {
+            double mu;
+            uint32_t part;
+            uint32_t alloc;  // extra buckets if the segment is taken
+
+            // max-heap on mu; ties go to the lower partition, like lookahead
+            bool operator<(const HullGain& other) const {
+                return (mu < other.mu) || (mu == other.mu && part > other.part);
+            }
+        };
+
+        void updateHull(uint32_t part, uint32_t minAlloc, uint32_t maxAlloc, const PartitionMonitor& monitor);
+        void pushNextSegment(uint32_t part, const PartitionMonitor& monitor);
+        void computeBestPartitioning(uint32_t totalBuckets, uint32_t minAlloc, uint32_t* allocs, const PartitionMonitor& monitor);
+
+        PartReplPolicy* repl;
+        uint32_t numPartitions;
+        uint32_t buckets;
+        uint32_t* curAllocs;
+
+        g_vector< g_vector<uint32_t> > hulls;  // per partition, allocs of the hull vertices
+        g_vector<uint64_t> hullVersions;        // monitor version each hull was built from
+        g_vector<uint32_t> hullPos;             // current vertex of each partition during a pass
+        g_vector<HullGain> gainHeap;
+        g_vector<uint32_t> scanParts;           // partitions whose next segment exceeds the balance
+};
+
 // *********************************************************************
 
 // monitors the usage of partitions in a cache and generates miss curves
@@ -93,6 +134,10 @@ class PartitionMonitor : public GlobAlloc {
 
         virtual uint32_t getNumAccesses(uint32_t partition) const = 0;
 
+        // changes whenever the miss curve of a partition may have changed;
+        // lets partitioners cache work derived from unchanged curves
+        virtual uint64_t getVersion(uint32_t partition) const = 0;
+
         // called by Partitioner each interval to reset miss counters
         virtual void reset() = 0;
 
@@ -102,26 +147,45 @@ class PartitionMonitor : public GlobAlloc {
         uint32_t buckets;
 };
 
-// Maintains UMONs for each partition as in (Qureshi and Patt, ISCA 2006).
+// Maintains a utility monitor (UMon or DuelingUMon) for each partition, as in
+// (Qureshi and Patt, ISCA 2006), and resamples their curves to buckets.
 // Stupid name...but what do you call it? -nzb
-class UMonMonitor : public PartitionMonitor {
+template <class M>
+class UtilityPartitionMonitor : public PartitionMonitor {
     public:
-        UMonMonitor(uint32_t _numLines, uint32_t _umonLines, uint32_t _umonBuckets, uint32_t _numPartitions, uint32_t _buckets);
-        ~UMonMonitor();
+        ~UtilityPartitionMonitor();
 
         uint32_t getNumPartitions() const { return monitors.size(); }
         void access(uint32_t partition, Address lineAddr);
         uint32_t get(uint32_t partition, uint32_t bucket) const;
         uint32_t getNumAccesses(uint32_t partition) const;
+        uint64_t getVersion(uint32_t partition) const;
         void reset();
 
+    protected:
+        // subclasses populate monitors
+        UtilityPartitionMonitor(uint32_t _numPartitions, uint32_t _buckets);
+
+        g_vector<M*> monitors;          // individual monitors per partition
+
     private:
-        void getMissCurves() const;
         void getMissCurve(uint32_t* misses, uint32_t partition) const;
 
-        mutable uint32_t* missCache;
-        mutable bool missCacheValid;
-        g_vector<UMon*> monitors;       // individual monitors per partition
+        mutable uint32_t* missCache;    // (buckets+1) entries per partition
+        mutable g_vector<bool> missCacheValid;  // per partition, so a query only rebuilds curves that changed
+        g_vector<uint64_t> versions;
+};
+
+class UMonMonitor : public UtilityPartitionMonitor<UMon> {
+    public:
+        UMonMonitor(uint32_t _numLines, uint32_t _umonLines, uint32_t _umonBuckets, uint32_t _numPartitions, uint32_t _buckets);
+};
+
+// Set-dueling monitors with adaptive sampling, see DuelingUMon
+class DuelingUMonMonitor : public UtilityPartitionMonitor<DuelingUMon> {
+    public:
+        DuelingUMonMonitor(uint32_t _numLines, uint32_t _umonLines, uint32_t _umonBuckets, uint32_t _numPartitions, uint32_t _buckets,
+                           uint32_t _points, uint32_t _maxSamplingShift, uint64_t _targetSamples);
 };
 
 #endif  // PARTITIONER_H_
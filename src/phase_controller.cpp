@@ -0,0 +1,127 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "phase_controller.h"
+#include "bithacks.h"
+#include "cache.h"
+#include "core.h"
+#include "event_recorder.h"
+#include "log.h"
+#include "zsim.h"
+
+PhaseController::PhaseController(uint32_t _minLength, uint32_t _maxLength, double _growThreshold, double _shrinkThreshold, uint32_t _growWindow)
+    : minLength(_minLength), maxLength(_maxLength), growThreshold(_growThreshold), shrinkThreshold(_shrinkThreshold), growWindow(_growWindow)
+{
+    if (minLength == 0) panic("Adaptive phase length needs a non-zero minimum phase length");
+    if (maxLength < minLength) panic("sim.maxPhaseLength (%d) must be >= sim.phaseLength (%d)", maxLength, minLength);
+    if (growThreshold > shrinkThreshold) panic("Phase grow threshold (%f) must be <= shrink threshold (%f)", growThreshold, shrinkThreshold);
+    if (growWindow == 0) panic("Phase grow window must be > 0");
+    numLengths = ilog2(maxLength/minLength) + 1;
+    lastCohEvents = 0;
+    lastLLCFills = 0;
+    lastCoreCrossings = nullptr; //cores do not exist yet
+    lastCoreInstrs = nullptr;
+    quietPhases = 0;
+}
+
+void PhaseController::initStats(AggregateStat* parentStat) {
+    AggregateStat* pcStats = new AggregateStat();
+    pcStats->init("phaseCtl", "Adaptive phase length controller stats");
+
+    auto lenStat = makeLambdaStat([]() { return (uint64_t)zinfo->phaseLength; });
+    lenStat->init("length", "Current phase length (cycles)");
+    auto cyclesStat = makeLambdaStat([]() { return zinfo->globPhaseCycles; });
+    cyclesStat->init("cycles", "Cycles at the start of the current phase");
+    profGrows.init("grows", "Phase length increases");
+    profShrinks.init("shrinks", "Phase length resets to the minimum");
+    profCohEvents.init("cohEvents", "Invalidations, downgrades and forwards received below the LLC");
+    profLLCFills.init("llcFills", "LLC fills");
+    profCrossings.init("crossings", "Recorded crossing events");
+    profLengthHist.init("lengthHist", "Phases per length (bucket i is minLength*2^i)", numLengths);
+
+    pcStats->append(lenStat);
+    pcStats->append(cyclesStat);
+    pcStats->append(&profGrows);
+    pcStats->append(&profShrinks);
+    pcStats->append(&profCohEvents);
+    pcStats->append(&profLLCFills);
+    pcStats->append(&profCrossings);
+    pcStats->append(&profLengthHist);
+    parentStat->append(pcStats);
+}
+
+uint32_t PhaseController::endPhase(uint32_t curLength) {
+    profLengthHist.inc(MIN(ilog2(curLength/minLength), numLengths - 1));
+
+    uint64_t cohEvents = 0;
+    for (Cache* c : privCaches) cohEvents += c->getCoherenceEvents();
+    uint64_t llcFills = 0;
+    for (Cache* c : llcBanks) llcFills += c->getFills();
+    uint64_t dCoh = cohEvents - lastCohEvents;
+    uint64_t dFills = llcFills - lastLLCFills;
+    lastCohEvents = cohEvents;
+    lastLLCFills = llcFills;
+
+    if (!lastCoreInstrs) {
+        lastCoreCrossings = gm_calloc<uint64_t>(zinfo->numCores);
+        lastCoreInstrs = gm_calloc<uint64_t>(zinfo->numCores);
+    }
+    uint64_t dCrossings = 0;
+    uint32_t activeCores = 0;
+    for (uint32_t i = 0; i < zinfo->numCores; i++) {
+        EventRecorder* evRec = zinfo->eventRecorders[i];
+        if (evRec) { //null while contention recording is skipped
+            uint64_t crossings = evRec->getNumCrossings();
+            dCrossings += crossings - lastCoreCrossings[i];
+            lastCoreCrossings[i] = crossings;
+        }
+
+        uint64_t instrs = zinfo->cores[i]->getInstrs();
+        if (instrs != lastCoreInstrs[i]) activeCores++;
+        lastCoreInstrs[i] = instrs;
+    }
+
+    profCohEvents.inc(dCoh);
+    profLLCFills.inc(dFills);
+    profCrossings.inc(dCrossings);
+
+    double rate = 1000.0*(dCoh + dFills + dCrossings)/((double)MAX(activeCores, 1u)*curLength);
+
+    uint32_t nextLength = curLength;
+    if (rate > shrinkThreshold) {
+        if (curLength > minLength) profShrinks.inc();
+        nextLength = minLength;
+        quietPhases = 0;
+    } else if (rate < growThreshold) {
+        if (++quietPhases >= growWindow && curLength < maxLength) {
+            nextLength = MIN(2*curLength, maxLength);
+            profGrows.inc();
+            quietPhases = 0;
+        }
+    } else {
+        quietPhases = 0;
+    }
+    return nextLength;
+}
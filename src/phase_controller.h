@@ -0,0 +1,96 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PHASE_CONTROLLER_H_
+#define PHASE_CONTROLLER_H_
+
+/* Adaptive phase length controller
+ *
+ * Short phases keep the interleaving of cores that interact (share data,
+ * conflict in the LLC, or send crossings to each other's domains) accurate,
+ * but every phase costs a barrier and a weave phase, which is pure overhead
+ * for cores that do not interact (e.g., independent single-threaded
+ * processes). At the end of each phase, the controller samples how many
+ * interaction events happened and picks the length of the next phase:
+ *  - If interactions per kilocycle per active core exceed shrinkThreshold,
+ *    the next phase is back to the minimum length.
+ *  - If they stay below growThreshold for growWindow consecutive phases, the
+ *    phase length doubles, up to maxLength.
+ * Phase lengths are always minLength*2^k (or maxLength), so phase boundaries
+ * stay aligned to minLength.
+ *
+ * Interaction events are:
+ *  - Invalidations, downgrades and forwards received by the caches right
+ *    below the LLC. This includes both sharing and inclusion victims, i.e.,
+ *    LLC set conflicts that evict lines other cores are using.
+ *  - LLC fills (in steady state, LLC replacements).
+ *  - Crossing events recorded by the cores.
+ */
+
+#include <stdint.h>
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "stats.h"
+
+class Cache;
+
+class PhaseController : public GlobAlloc {
+    private:
+        const uint32_t minLength;
+        const uint32_t maxLength;
+        const double growThreshold; //interaction events per kilocycle per active core
+        const double shrinkThreshold;
+        const uint32_t growWindow; //consecutive quiet phases needed to double the phase length
+
+        g_vector<Cache*> privCaches; //caches right below the LLC
+        g_vector<Cache*> llcBanks;
+
+        uint32_t numLengths; //entries in profLengthHist
+        uint64_t lastCohEvents;
+        uint64_t lastLLCFills;
+        uint64_t* lastCoreCrossings; //per core, since recorders disappear while contention recording is skipped
+        uint64_t* lastCoreInstrs;
+        uint32_t quietPhases;
+
+        Counter profGrows, profShrinks;
+        Counter profCohEvents, profLLCFills, profCrossings;
+        VectorCounter profLengthHist;
+
+    public:
+        PhaseController(uint32_t _minLength, uint32_t _maxLength, double _growThreshold, double _shrinkThreshold, uint32_t _growWindow);
+
+        void addPrivateCache(Cache* c) {privCaches.push_back(c);}
+        void addLLCBank(Cache* c) {llcBanks.push_back(c);}
+
+        void initStats(AggregateStat* parentStat);
+
+        // Called once per phase, after the weave phase and with all threads
+        // stopped; returns the length of the next phase
+        uint32_t endPhase(uint32_t curLength);
+
+        uint32_t getMaxLength() const {return maxLength;}
+};
+
+#endif  // PHASE_CONTROLLER_H_
@@ -26,10 +26,30 @@
 #ifndef PRIO_QUEUE_H_
 #define PRIO_QUEUE_H_
 
-#include "g_std/g_multimap.h"
+#include <stdint.h>
+#include "bithacks.h"
+#include "log.h"
 
+/* Bucketed priority queue for timing events, with one-cycle resolution.
+ *
+ * Near elements (within B*64 cycles of the current block) live in blocks[], a
+ * circular array of 64-cycle buckets. Far elements live in a hierarchical
+ * timing wheel of epochs, where an epoch spans half of the blocks window (B/2
+ * blocks). Every B/2 blocks, the window slides by an epoch and the elements of
+ * the newly covered epoch cascade from the wheel into blocks[].
+ *
+ * The wheel has FW_LEVELS levels of 64 slots. An element of epoch e is kept in
+ * the level of the most significant 6-bit digit where e differs from the
+ * current epoch, in the slot given by that digit. So insertion is O(1),
+ * elements on lower levels always come before elements on higher levels, and
+ * when the current epoch advances, only one slot needs to cascade. Lists are
+ * intrusive (through T::next), and the element's cycle is kept in
+ * T::cycle, so the queue never allocates.
+ */
 template <typename T, uint32_t B>
 class PrioQueue {
+    static_assert(B >= 2 && (B % 2) == 0, "PrioQueue needs an even number of blocks");
+
     struct PQBlock {
         T* array[64];
         uint64_t occ; // bit i is 1 if array[i] is populated
@@ -45,7 +65,7 @@ class PrioQueue {
             T* res = array[pos];
             T* next = res->next;
             array[pos] = next;
-            if (!next) occ ^= 1L << pos;
+            if (!next) occ ^= 1UL << pos;
             assert(res);
             offset = pos;
             res->next = nullptr;
@@ -53,27 +73,41 @@ class PrioQueue {
         }
 
         inline void enqueue(T* obj, uint32_t pos) {
-            occ |= 1L << pos;
+            occ |= 1UL << pos;
             assert(!obj->next);
             obj->next = array[pos];
             array[pos] = obj;
         }
     };
 
-    PQBlock blocks[B];
+    static const uint32_t EPOCH_BLOCKS = B/2;
+    static const uint32_t FW_LEVELS = 11; // 6 bits/level, covers all 64-bit epochs
 
-    typedef g_multimap<uint64_t, T*> FEMap; //far element map
-    typedef typename FEMap::iterator FEMapIterator;
+    PQBlock blocks[B];
 
-    FEMap feMap;
+    // Far-element timing wheel
+    T* farSlots[FW_LEVELS][64];
+    uint64_t farOcc[FW_LEVELS]; // bit i is 1 if farSlots[l][i] is populated
+    uint64_t farEpoch; // last epoch moved into blocks[]; all far elements have a later epoch
+    mutable uint64_t farMin; // cached cycle of the earliest far element, valid if farMinValid
+    mutable bool farMinValid;
 
     uint64_t curBlock;
     uint64_t elems;
+    uint64_t nearElems; // elements in blocks[]
 
     public:
         PrioQueue() {
+            for (uint32_t l = 0; l < FW_LEVELS; l++) {
+                for (uint32_t i = 0; i < 64; i++) farSlots[l][i] = nullptr;
+                farOcc[l] = 0;
+            }
+            farEpoch = 1; // blocks[] initially covers epochs 0 and 1
+            farMin = 0;
+            farMinValid = false;
             curBlock = 0;
             elems = 0;
+            nearElems = 0;
         }
 
         void enqueue(T* obj, uint64_t cycle) {
@@ -81,44 +115,32 @@ class PrioQueue {
             assert(absBlock >= curBlock);
 
             if (absBlock < curBlock + B) {
-                uint32_t i = absBlock % B;
-                uint32_t offset = cycle % 64;
-                blocks[i].enqueue(obj, offset);
+                nearEnqueue(obj, cycle);
             } else {
                 //info("XXX far enq() %ld", cycle);
-                feMap.insert(std::pair<uint64_t, T*>(cycle, obj));
+                assert(!obj->next);
+                obj->cycle = cycle;
+                farInsert(obj, absBlock/EPOCH_BLOCKS);
+                if (farMinValid && cycle < farMin) farMin = cycle;
             }
             elems++;
         }
 
         T* dequeue(uint64_t& deqCycle) {
             assert(elems);
+            // If blocks[] is empty, jump straight to the earliest far elements instead of walking empty blocks
+            while (!nearElems) skipToFar();
+
             while (!blocks[curBlock % B].occ) {
                 curBlock++;
-                if ((curBlock % (B/2)) == 0 && !feMap.empty()) {
-                    uint64_t topCycle = (curBlock + B)*64;
-                    //Move every element with cycle < topCycle to blocks[]
-                    FEMapIterator it = feMap.begin();
-                    while (it != feMap.end() && it->first < topCycle) {
-                        uint64_t cycle = it->first;
-                        T* obj = it->second;
-
-                        uint64_t absBlock = cycle/64;
-                        assert(absBlock >= curBlock);
-                        assert(absBlock < curBlock + B);
-                        uint32_t i = absBlock % B;
-                        uint32_t offset = cycle % 64;
-                        blocks[i].enqueue(obj, offset);
-                        it++;
-                    }
-                    feMap.erase(feMap.begin(), it);
-                }
+                if ((curBlock % EPOCH_BLOCKS) == 0) advanceFar(curBlock/EPOCH_BLOCKS + 1);
             }
 
             //We're now at the first populated block
             uint32_t offset;
             T* obj = blocks[curBlock % B].dequeue(offset);
             elems--;
+            nearElems--;
 
             deqCycle = curBlock*64 + offset;
             return obj;
@@ -130,6 +152,7 @@ class PrioQueue {
 
         inline uint64_t firstCycle() const {
             assert(elems);
+            if (!nearElems) return farMinCycle();
             for (uint32_t i = 0; i < B/2; i++) {
                 uint64_t occ = blocks[(curBlock + i) % B].occ;
                 if (occ) {
@@ -142,11 +165,88 @@ class PrioQueue {
                 if (occ) {
                     uint64_t pos = __builtin_ctzl(occ);
                     uint64_t cycle = (curBlock + i)*64 + pos;
-                    return feMap.empty()? cycle : MIN(cycle, feMap.begin()->first);
+                    return (elems == nearElems)? cycle : MIN(cycle, farMinCycle());
                 }
             }
+            panic("PrioQueue: %ld near elements, but none found in blocks", nearElems);
+        }
+
+    private:
+        inline void nearEnqueue(T* obj, uint64_t cycle) {
+            uint64_t absBlock = cycle/64;
+            assert(absBlock >= curBlock);
+            assert(absBlock < curBlock + B);
+            blocks[absBlock % B].enqueue(obj, cycle % 64);
+            nearElems++;
+        }
+
+        inline void farInsert(T* obj, uint64_t epoch) {
+            assert(epoch > farEpoch);
+            uint32_t level = (63 - __builtin_clzl(epoch ^ farEpoch))/6;
+            uint32_t slot = (epoch >> (6*level)) & 63;
+            obj->next = farSlots[level][slot];
+            farSlots[level][slot] = obj;
+            farOcc[level] |= 1UL << slot;
+        }
+
+        // Makes newEpoch the current far epoch, moving its elements to
+        // blocks[] and pushing the rest of its slot down the wheel. Requires
+        // that no far element is earlier than newEpoch, so only the slot at the
+        // most significant differing digit can hold elements to cascade.
+        void advanceFar(uint64_t newEpoch) {
+            assert(newEpoch > farEpoch);
+            uint32_t level = (63 - __builtin_clzl(newEpoch ^ farEpoch))/6;
+            uint32_t slot = (newEpoch >> (6*level)) & 63;
+            farEpoch = newEpoch;
+            if (!(farOcc[level] & (1UL << slot))) return;
+
+            T* list = farSlots[level][slot];
+            farSlots[level][slot] = nullptr;
+            farOcc[level] &= ~(1UL << slot);
+            farMinValid = false;
+            while (list) {
+                T* obj = list;
+                list = obj->next;
+                obj->next = nullptr;
+                uint64_t epoch = obj->cycle/(64*EPOCH_BLOCKS);
+                assert(epoch >= newEpoch);
+                if (epoch == newEpoch) nearEnqueue(obj, obj->cycle);
+                else farInsert(obj, epoch);
+            }
+        }
+
+        // With blocks[] empty, slides the window to the first slot of the
+        // lowest non-empty wheel level, which holds the earliest far elements
+        void skipToFar() {
+            assert(!nearElems && elems);
+            uint32_t level = 0;
+            while (!farOcc[level]) {
+                level++;
+                assert(level < FW_LEVELS);
+            }
+            uint32_t slot = __builtin_ctzl(farOcc[level]);
+            uint32_t shift = 6*(level + 1);
+            uint64_t prefix = (shift < 64)? ((farEpoch >> shift) << shift) : 0;
+            uint64_t target = prefix | (((uint64_t)slot) << (6*level));
+            assert(target > farEpoch);
+            curBlock = (target - 1)*EPOCH_BLOCKS; // window covers epochs target-1 and target
+            advanceFar(target);
+        }
 
-            return feMap.begin()->first;
+        uint64_t farMinCycle() const {
+            if (!farMinValid) {
+                uint32_t level = 0;
+                while (!farOcc[level]) {
+                    level++;
+                    assert(level < FW_LEVELS);
+                }
+                uint32_t slot = __builtin_ctzl(farOcc[level]);
+                uint64_t minCycle = (uint64_t)-1L;
+                for (T* obj = farSlots[level][slot]; obj; obj = obj->next) minCycle = MIN(minCycle, obj->cycle);
+                farMin = minCycle;
+                farMinValid = true;
+            }
+            return farMin;
         }
 };
 
@@ -33,6 +33,10 @@
 #include "memory_hierarchy.h"
 #include "mtrand.h"
 
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 /* Generic replacement policy interface. A replacement policy is initialized by the cache (by calling setTop/BottomCC) and used by the cache array. Usage follows two models:
  * - On lookups, update() is called if the replacement policy is to be updated on a hit
  * - On each replacement, rank() is called with the req and a list of replacement candidates.
@@ -64,6 +68,46 @@ class ReplPolicy : public GlobAlloc {
 #define DECL_RANK_BINDING(T) uint32_t rankCands(const MemReq* req, T cands) { return rank(req, cands); }
 #define DECL_RANK_BINDINGS DECL_RANK_BINDING(SetAssocCands); DECL_RANK_BINDING(ZCands);
 
+/* Returns the index of the first minimum of vals[0..n). Used by rank() fast paths over contiguous candidates.
+ * With AVX2 (not enabled by the default -march), does 8 elements per step and a horizontal min.
+ */
+static inline uint32_t argminFirst(const uint32_t* vals, uint32_t n) {
+    assert(n > 0);
+    uint32_t i = 0;
+    uint32_t minVal = (uint32_t)-1;
+#ifdef __AVX2__
+    if (n >= 8) {
+        __m256i vmin = _mm256_loadu_si256((const __m256i*)vals);
+        for (i = 8; i + 8 <= n; i += 8) {
+            vmin = _mm256_min_epu32(vmin, _mm256_loadu_si256((const __m256i*)&vals[i]));
+        }
+        __m128i m = _mm_min_epu32(_mm256_castsi256_si128(vmin), _mm256_extracti128_si256(vmin, 1));
+        m = _mm_min_epu32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+        m = _mm_min_epu32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+        minVal = (uint32_t)_mm_cvtsi128_si32(m);
+        for (uint32_t j = i; j < n; j++) minVal = MIN(minVal, vals[j]);
+
+        // Find its first occurrence
+        __m256i vkey = _mm256_set1_epi32((int32_t)minVal);
+        for (uint32_t j = 0; j + 8 <= n; j += 8) {
+            __m256i eq = _mm256_cmpeq_epi32(vkey, _mm256_loadu_si256((const __m256i*)&vals[j]));
+            uint32_t mask = _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+            if (mask) return j + __builtin_ctz(mask);
+        }
+        for (uint32_t j = n & ~7u; j < n; j++) {
+            if (vals[j] == minVal) return j;
+        }
+        panic("argminFirst: minimum not found");
+    }
+#endif
+    uint32_t best = 0;
+    for (; i < n; i++) {
+        best = (vals[i] < minVal)? i : best;
+        minVal = MIN(vals[i], minVal);
+    }
+    return best;
+}
+
 /* Legacy support.
  * - On each replacement, the controller first calls startReplacement(), indicating the line that will be inserted;
  *   then it calls recordCandidate() for each candidate it finds; finally, it calls getBestCandidate() to get the
@@ -129,6 +173,23 @@ class LRUReplPolicy : public ReplPolicy {
             return bestCand;
         }
 
+        // Fast path for set-associative arrays, where candidates are a contiguous range of line ids:
+        // fetch the coherence state of the whole set at once and pick the first minimum score.
+        // Overload resolution picks this over the template in DECL_RANK_BINDINGS.
+        inline uint32_t rank(const MemReq* req, SetAssocCands cands) {
+            uint32_t n = cands.numCands();
+            uint32_t sharers[n];
+            uint32_t valid[n];
+            uint32_t scores[n];
+            cc->getReplState(cands.b, n, sharers, valid);
+            const uint64_t* ts = &array[cands.b];
+            for (uint32_t i = 0; i < n; i++) {
+                // NOTE: Truncated to 32 bits, exactly like the generic rank()
+                scores[i] = (uint32_t)((sharersAware? sharers[i] : 0)*timestamp + ts[i]*valid[i]);
+            }
+            return cands.b + argminFirst(scores, n);
+        }
+
         DECL_RANK_BINDINGS;
 
     private:
@@ -209,6 +209,7 @@ class Scheduler : public GlobAlloc, public Callee {
             occHist.init("occHist", "Occupancy histogram", numCores+1); schedStats->append(&occHist);
             uint32_t runQueueHistSize = ((numCores > 16)? numCores : 16) + 1;
             runQueueHist.init("rqSzHist", "Run queue size histogram", runQueueHistSize); schedStats->append(&runQueueHist);
+            bar.initStats(schedStats);
             parentStat->append(schedStats);
         }
 
@@ -437,6 +438,7 @@ class Scheduler : public GlobAlloc, public Callee {
             /* End of phase accounting */
             zinfo->numPhases++;
             zinfo->globPhaseCycles += zinfo->phaseLength;
+            zinfo->phaseLength = zinfo->nextPhaseLength;
             curPhase++;
 
             assert(curPhase == zinfo->numPhases); //check they don't skew
@@ -44,7 +44,8 @@ void SimpleCore::initStats(AggregateStat* parentStat) {
 }
 
 uint64_t SimpleCore::getPhaseCycles() const {
-    return curCycle % zinfo->phaseLength;
+    //Phase lengths may change from phase to phase, so this can't be curCycle % phaseLength
+    return (curCycle > zinfo->globPhaseCycles)? curCycle - zinfo->globPhaseCycles : 0;
 }
 
 void SimpleCore::load(Address addr) {
@@ -114,7 +115,6 @@ void SimpleCore::BblFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
 
     while (core->curCycle > core->phaseEndCycle) {
         assert(core->phaseEndCycle == zinfo->globPhaseCycles + zinfo->phaseLength);
-        core->phaseEndCycle += zinfo->phaseLength;
 
         uint32_t cid = getCid(tid);
         //NOTE: TakeBarrier may take ownership of the core, and so it will be used by some other thread. If TakeBarrier context-switches us,
@@ -122,6 +122,7 @@ void SimpleCore::BblFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
         //we're not at risk of racing, even if we were switched out and then switched in.
         uint32_t newCid = TakeBarrier(tid, cid);
         if (newCid != cid) break; /*context-switch*/
+        core->phaseEndCycle = zinfo->globPhaseCycles + zinfo->phaseLength; //set after the barrier, the phase length may have changed
     }
 }
 
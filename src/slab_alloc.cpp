@@ -0,0 +1,158 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "slab_alloc.h"
+#include <sys/mman.h>
+#include "bithacks.h"
+#include "rdtsc.h"
+#include "zsim.h"
+
+namespace slab {
+
+/* SlabDepot */
+
+SlabDepot::SlabDepot() : arenaCur(nullptr), arenaEnd(nullptr) {}
+
+void SlabDepot::initStats(AggregateStat* parentStat) {
+    AggregateStat* depotStat = new AggregateStat();
+    depotStat->init("slabDepot", "Global timing event slab depot stats");
+    profArenas.init("arenas", "Slab arenas allocated from the global heap");
+    profRefills.init("refills", "Magazines handed out to slab allocators");
+    profFlushes.init("flushes", "Full magazines returned by slab allocators");
+    depotStat->append(&profArenas);
+    depotStat->append(&profRefills);
+    depotStat->append(&profFlushes);
+    auto freeStat = makeLambdaStat([this]() -> uint64_t { return freeSlabs.size(); });
+    freeStat->init("free", "Free slabs in the depot");
+    depotStat->append(freeStat);
+    parentStat->append(depotStat);
+}
+
+void SlabDepot::refill(Slab** mag, uint32_t n) {
+    scoped_mutex sm(depotLock);
+    profRefills.inc();
+    for (uint32_t i = 0; i < n; i++) {
+        if (!freeSlabs.empty()) {
+            mag[i] = freeSlabs.back();
+            freeSlabs.pop_back();
+        } else {
+            if (arenaCur == arenaEnd) {
+                static_assert((SLAB_ARENA_SIZE % SLAB_SIZE) == 0, "Slab arenas must hold a whole number of slabs");
+                arenaCur = static_cast<char*>(__gm_memalign(SLAB_ARENA_SIZE, SLAB_ARENA_SIZE));
+                arenaEnd = arenaCur + SLAB_ARENA_SIZE;
+#ifdef MADV_HUGEPAGE
+                madvise(arenaCur, SLAB_ARENA_SIZE, MADV_HUGEPAGE);  // best-effort; only takes if shmem THP is enabled
+#endif
+                profArenas.inc();
+            }
+            mag[i] = reinterpret_cast<Slab*>(arenaCur);
+            arenaCur += SLAB_SIZE;
+        }
+    }
+}
+
+void SlabDepot::flush(Slab** mag, uint32_t n) {
+    scoped_mutex sm(depotLock);
+    profFlushes.inc();
+    for (uint32_t i = 0; i < n; i++) freeSlabs.push_back(mag[i]);
+}
+
+SlabDepot* SlabDepot::get() {
+    // Created during initialization (when the first recorder is built), which is single-threaded
+    if (unlikely(!zinfo->slabDepot)) zinfo->slabDepot = new SlabDepot();
+    return zinfo->slabDepot;
+}
+
+/* SlabAlloc */
+
+SlabAlloc::SlabAlloc() : curSlab(nullptr), magSize(0), liveSlabs(0), slabAllocs(0), maxLiveSlabs(0) {
+    for (uint32_t i = 0; i < SLAB_LIVE_BUCKETS; i++) liveSlabsHist[i] = 0;
+    for (uint32_t i = 0; i < SLAB_LAT_BUCKETS; i++) refillLatHist[i] = 0;
+    allocSlab();
+}
+
+void SlabAlloc::allocSlab() {
+    uint64_t startTsc = rdtsc();
+    scoped_mutex sm(freeLock);
+    if (!magSize) {
+        SlabDepot::get()->refill(magazine, SLAB_MAGAZINE_SIZE);
+        magSize = SLAB_MAGAZINE_SIZE;
+    }
+    curSlab = magazine[--magSize];
+    assert(curSlab);
+    assert((((uintptr_t)curSlab) & SLAB_MASK) == (uintptr_t)curSlab);
+    curSlab->init(this);  // NOTE: Slab is POD; recycled slabs may come from another allocator
+    liveSlabs++;
+    slabAllocs++;
+    if (liveSlabs > maxLiveSlabs) maxLiveSlabs = liveSlabs;
+    refillLatHist[MIN(ilog2(rdtsc() - startTsc), (uint32_t)SLAB_LAT_BUCKETS - 1)]++;
+    //info("allocated slab %p, %d live, %d in magazine", curSlab, liveSlabs, magSize);
+}
+
+void SlabAlloc::freeSlab(Slab* s) {
+    scoped_mutex sm(freeLock);
+    //info("freeing slab %p, %d live, %d in magazine", s, liveSlabs, magSize);
+    s->clear();
+#ifdef DEBUG_SLAB_ALLOC
+    memset(s->buf, -1, sizeof(s->buf));
+#endif
+    if (s != curSlab) {
+        if (magSize == SLAB_MAGAZINE_SIZE) {
+            SlabDepot::get()->flush(magazine, SLAB_MAGAZINE_SIZE);
+            magSize = 0;
+        }
+        magazine[magSize++] = s;
+        liveSlabs--;
+    }
+    assert(liveSlabs);  // at least curSlab
+}
+
+void SlabAlloc::samplePhase() {
+    uint32_t bucket = liveSlabs? ilog2(liveSlabs) + 1 : 0;
+    liveSlabsHist[MIN(bucket, (uint32_t)SLAB_LIVE_BUCKETS - 1)]++;
+}
+
+void SlabAlloc::initStats(AggregateStat* parentStat) {
+    AggregateStat* slabStat = new AggregateStat();
+    slabStat->init("slabs", "Timing event slab allocator stats");
+    ProxyStat* allocsStat = new ProxyStat();
+    allocsStat->init("allocs", "Slabs allocated", &slabAllocs);
+    ProxyStat* maxLiveStat = new ProxyStat();
+    maxLiveStat->init("maxLive", "High-water mark of live slabs", &maxLiveSlabs);
+    auto liveStat = makeLambdaStat([this]() -> uint64_t { return liveSlabs; });
+    liveStat->init("live", "Live slabs");
+    auto liveHistStat = makeLambdaVectorStat([this](uint32_t i) -> uint64_t { return liveSlabsHist[i]; }, SLAB_LIVE_BUCKETS);
+    liveHistStat->init("phaseLive", "Live slabs at the end of each phase (bucket i > 0 counts [2^(i-1), 2^i))");
+    auto latHistStat = makeLambdaVectorStat([this](uint32_t i) -> uint64_t { return refillLatHist[i]; }, SLAB_LAT_BUCKETS);
+    latHistStat->init("allocLat", "Slab allocation latency (bucket i counts [2^i, 2^(i+1)) cycles)");
+    slabStat->append(allocsStat);
+    slabStat->append(maxLiveStat);
+    slabStat->append(liveStat);
+    slabStat->append(liveHistStat);
+    slabStat->append(latHistStat);
+    parentStat->append(slabStat);
+}
+
+};  // namespace slab
@@ -33,18 +33,32 @@
  * are garbage-collected once all their events are done. To do this without space
  * overheads, slabs are carefully aligned, so that objects inside the slab can
  * derive the pointer of their slab.
+ *
+ * Free slabs are recycled through a two-level scheme: each allocator keeps a
+ * small magazine of free slabs, and exchanges whole magazines with a global
+ * depot when it runs out or fills up. This bounds lock traffic on the depot to
+ * once per SLAB_MAGAZINE_SIZE slabs, and lets slabs freed by one recorder be
+ * reused by others (before, each allocator kept its freed slabs forever). The
+ * depot carves new slabs out of 2MB-aligned arenas, so that they can be backed
+ * by huge pages.
  */
 
-#include <deque>
 #include <stddef.h>
 #include <stdint.h>
 #include "g_std/g_vector.h"
 #include "log.h"
 #include "mutex.h"
+#include "stats.h"
 
 #define SLAB_SIZE (1<<16)  // 64KB; must be a power of two
 #define SLAB_MASK (~(SLAB_SIZE - 1))
 
+#define SLAB_MAGAZINE_SIZE 16  // slabs moved between an allocator and the depot at once
+#define SLAB_ARENA_SIZE (1<<21)  // 2MB, a huge page; must be a multiple of SLAB_SIZE
+
+#define SLAB_LIVE_BUCKETS 16  // log2 buckets for live slabs per phase
+#define SLAB_LAT_BUCKETS 24  // log2 buckets for slab refill latency, in cycles
+
 // Uncomment to immediately scrub slabs (to 0) and freed elems (to -1).
 // This makes use-after-free errors obvious.
 //#define DEBUG_SLAB_ALLOC
@@ -91,17 +105,46 @@ struct Slab {  // POD type (no constructor)
     inline void freeElem();
 };
 
+// Global pool of free slabs, shared by all allocators (lives in zinfo, see get())
+class SlabDepot : public GlobAlloc {
+    private:
+        mutex depotLock;
+        g_vector<Slab*> freeSlabs;
+        char* arenaCur;  // next uncarved slab in the current arena
+        char* arenaEnd;
+
+        Counter profArenas;
+        Counter profRefills;
+        Counter profFlushes;
+
+    public:
+        SlabDepot();
+        void initStats(AggregateStat* parentStat);
+
+        // Fills mag with n free slabs (recycled or freshly carved)
+        void refill(Slab** mag, uint32_t n);
+        // Takes back the n free slabs in mag
+        void flush(Slab** mag, uint32_t n);
+
+        static SlabDepot* get();  // creates the global depot on first use
+};
+
 class SlabAlloc {
     private:
         Slab* curSlab;
-        g_vector<Slab*> freeList;
+        Slab* magazine[SLAB_MAGAZINE_SIZE];  // free slabs; refilled from/flushed to the depot
+        uint32_t magSize;
         uint32_t liveSlabs;
         mutex freeLock;  // used because slab frees may be concurrent
 
+        // Stats (plain counters, updated under freeLock or by the allocating thread)
+        uint64_t slabAllocs;
+        uint64_t maxLiveSlabs;
+        uint64_t liveSlabsHist[SLAB_LIVE_BUCKETS];
+        uint64_t refillLatHist[SLAB_LAT_BUCKETS];
+
     public:
-        SlabAlloc() : curSlab(nullptr), liveSlabs(0) {
-            allocSlab();
-        }
+        SlabAlloc();
 
         void* alloc(size_t sz) {
             assert(sz < SLAB_SIZE);
@@ -117,36 +160,14 @@ class SlabAlloc {
 
         template <typename T> T* alloc() { return (T*)alloc(sizeof(T)); }
 
-    private:
-        void allocSlab() {
-            scoped_mutex sm(freeLock);
-            if (!freeList.empty()) {
-                curSlab = freeList.back();
-                freeList.pop_back();
-                assert(curSlab);
-            } else {
-                assert(sizeof(Slab) == SLAB_SIZE);
-                curSlab = gm_memalign<Slab>(sizeof(Slab));
-                assert((((uintptr_t)curSlab) & SLAB_MASK) == (uintptr_t)curSlab);
-                curSlab->init(this);  // NOTE: Slab is POD
-            }
-            liveSlabs++;
-            //info("allocated slab %p, %d live, %ld in freeList", curSlab, liveSlabs, freeList.size());
-        }
+        // Called once per phase by the owner, records how many slabs are in flight
+        void samplePhase();
 
-        void freeSlab(Slab* s) {
-            scoped_mutex sm(freeLock);
-            //info("freeing slab %p, %d live, %ld in freeList", s, liveSlabs, freeList.size());
-            s->clear();
-#ifdef DEBUG_SLAB_ALLOC
-            memset(s->buf, -1, sizeof(s->buf));
-#endif
-            if (s != curSlab) {
-                freeList.push_back(s);
-                liveSlabs--;
-            }
-            assert(liveSlabs);  // at least curSlab
-        }
+        void initStats(AggregateStat* parentStat);
+
+    private:
+        void allocSlab();
+        void freeSlab(Slab* s);
 
         friend struct Slab;
 };
@@ -23,95 +23,413 @@
  * this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
-/* Simple program to sort a trace. It reads in the trace sequntially until it
- * has seen at least one access from every thread, then dumps the sorted trace
- * out. This may consume large amounts of memory if traces are largely
- * imbalanced. A simple way to fix this would be to dump N separate traces,
- * then join them together --- that's more I/O though.
+/* Sorts a trace by request cycle, as an external merge sort that stays within
+ * a memory budget:
+ *  1. Read the trace in batches that fill half the budget (radix sort needs as
+ *     much scratch space), sort slices of each batch in parallel, merge the
+ *     slices, and spill the batch as a sorted run.
+ *  2. While there are more runs than the budget can merge at once, merge
+ *     groups of consecutive runs into longer runs.
+ *  3. Merge the remaining runs with a loser tree, writing the sorted trace.
+ * A trace that fits in a single batch is sorted in memory and written directly.
+ *
+ * Runs are spilled back to back to a single temporary file, which is unlinked
+ * as soon as it is created, so sorting uses two file descriptors at most no
+ * matter how many runs there are, and leaves nothing behind however it exits.
+ *
+ * Each child's accesses must be replayed in the order the child issued them,
+ * so records are keyed by the largest request cycle their child has issued so
+ * far, not by their own cycle. For children whose cycles never decrease (the
+ * common case) this is the same thing. The sort is stable, so records with
+ * equal keys, including consecutive records of a child, keep their trace order.
  */
 
-#include <deque>
-#include <queue>
+#include <algorithm>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 #include "access_tracing.h"
 #include "galloc.h"
 
-using namespace std;
+using std::string;
+using std::vector;
+
+struct SortRecord {
+    uint64_t key;
+    PackedAccessRecord rec;
+};
 
-void printProgress(uint64_t read, uint64_t written, uint64_t total) {
-    printf("Read %3ld%% / Written %3ld%%\r", read*100/total, written*100/total);
+static void printProgress(const char* what, uint64_t done, uint64_t total) {
+    printf("%s %3ld%%\r", what, total? done*100/total : 100);
     fflush(stdout);
 }
 
+static const uint64_t PROGRESS_RECORDS = 1 << 20;
+static const uint64_t MIN_MERGE_RECORDS = 1024; //smallest per-run merge buffer; bounds the merge fan-in
+static const uint64_t MIN_SLICE_RECORDS = 1 << 14; //don't bother sorting smaller slices of a batch in parallel
+
+/* Stable LSD radix sort on key, 8 bits per pass. Passes over bytes that are the
+ * same in every key (e.g., the high bytes of cycle counts) are skipped, so runs
+ * typically take 3-5 passes. tmp must hold n records.
+ */
+static void radixSort(SortRecord* recs, SortRecord* tmp, size_t n) {
+    if (n < 2) return;
+    vector<uint64_t> counts(8*256, 0);
+    for (size_t i = 0; i < n; i++) {
+        uint64_t key = recs[i].key;
+        for (uint32_t d = 0; d < 8; d++) counts[d*256 + ((key >> (8*d)) & 0xff)]++;
+    }
+
+    SortRecord* src = recs;
+    SortRecord* dst = tmp;
+    for (uint32_t d = 0; d < 8; d++) {
+        uint64_t* cnt = &counts[d*256];
+        if (cnt[(src[0].key >> (8*d)) & 0xff] == n) continue; //all keys share this byte
+        uint64_t offsets[256];
+        uint64_t sum = 0;
+        for (uint32_t b = 0; b < 256; b++) {
+            offsets[b] = sum;
+            sum += cnt[b];
+        }
+        for (size_t i = 0; i < n; i++) dst[offsets[(src[i].key >> (8*d)) & 0xff]++] = src[i];
+        std::swap(src, dst);
+    }
+    if (src != recs) memcpy(recs, src, n*sizeof(SortRecord));
+}
+
+// Sorted runs, spilled back to back to an unlinked temporary file
+class RunFile {
+    private:
+        FILE* f;
+        vector<uint64_t> starts; //first record of each run; each run ends where the next one starts
+        uint64_t records;
+
+    public:
+        explicit RunFile(const string& prefix) : records(0) {
+            string file = prefix + "XXXXXX";
+            int fd = mkstemp(&file[0]);
+            if (fd == -1) panic("Could not create temporary file %s", file.c_str());
+            unlink(file.c_str()); //goes away when closed, even if we die
+            f = fdopen(fd, "w+b");
+            assert(f);
+        }
+
+        ~RunFile() {fclose(f);}
+
+        void startRun() {starts.push_back(records);}
+
+        void write(const SortRecord& sr) {
+            if (fwrite(&sr, sizeof(SortRecord), 1, f) != 1) panic("Could not write to temporary run file (disk full?)");
+            records++;
+        }
+
+        // Call once all runs are written, before reading them
+        void finish() {
+            if (fflush(f) != 0) panic("Could not write to temporary run file (disk full?)");
+        }
+
+        int fd() const {return fileno(f);}
+        uint32_t numRuns() const {return starts.size();}
+        uint64_t runStart(uint32_t r) const {return starts[r];}
+        uint64_t runSize(uint32_t r) const {return ((r + 1 < starts.size())? starts[r + 1] : records) - starts[r];}
+};
+
+// Buffered sequential reader of a spilled run
+class RunReader {
+    private:
+        int fd;
+        off_t offset; //of the first record not yet in buf
+        uint64_t left; //records not yet in buf
+        vector<SortRecord> buf;
+        size_t cur;
+        size_t max;
+
+    public:
+        RunReader(const RunFile& rf, uint32_t run, size_t bufRecords) : fd(rf.fd()), offset(rf.runStart(run)*sizeof(SortRecord)),
+            left(rf.runSize(run)), buf(std::min((uint64_t)bufRecords, rf.runSize(run))), cur(0), max(0)
+        {
+            fill();
+        }
+
+        bool empty() const {return cur == max;}
+        const SortRecord& head() const {return buf[cur];}
+
+        void pop() {
+            if (++cur == max) fill();
+        }
+
+    private:
+        void fill() {
+            size_t n = std::min((uint64_t)buf.size(), left);
+            char* dst = reinterpret_cast<char*>(buf.data());
+            size_t bytes = n*sizeof(SortRecord);
+            while (bytes) {
+                ssize_t r = pread(fd, dst, bytes, offset);
+                if (r <= 0) panic("Short read on temporary run file");
+                dst += r;
+                bytes -= r;
+                offset += r;
+            }
+            left -= n;
+            cur = 0;
+            max = n;
+        }
+};
+
+// A sorted slice of an in-memory batch
+class MemRun {
+    private:
+        const SortRecord* cur;
+        const SortRecord* end;
+
+    public:
+        MemRun(const SortRecord* begin, const SortRecord* _end) : cur(begin), end(_end) {}
+
+        bool empty() const {return cur == end;}
+        const SortRecord& head() const {return *cur;}
+        void pop() {cur++;}
+};
+
+/* Loser tree over k sorted runs. tree[0] holds the current winner, and each
+ * internal node the loser of the match played there, so replacing the winner
+ * takes log2(k) comparisons, all on the path from its leaf. Empty runs lose
+ * every match, and ties go to the lower run, which came earlier in the trace.
+ */
+template <typename Run>
+class LoserTree {
+    private:
+        const vector<Run*>& runs;
+        uint32_t k;
+        vector<uint32_t> tree;
+
+    public:
+        explicit LoserTree(const vector<Run*>& _runs) : runs(_runs), k(_runs.size()), tree(_runs.size()) {
+            assert(k);
+            tree[0] = build(1);
+        }
+
+        // nullptr once all runs are empty
+        Run* top() const {
+            Run* r = runs[tree[0]];
+            return r->empty()? nullptr : r;
+        }
+
+        // Call after popping the top run
+        void replay() {
+            uint32_t winner = tree[0];
+            for (uint32_t node = (winner + k)/2; node > 0; node /= 2) {
+                if (beats(tree[node], winner)) std::swap(tree[node], winner);
+            }
+            tree[0] = winner;
+        }
+
+    private:
+        bool beats(uint32_t a, uint32_t b) const {
+            if (runs[a]->empty()) return false;
+            if (runs[b]->empty()) return true;
+            uint64_t ka = runs[a]->head().key;
+            uint64_t kb = runs[b]->head().key;
+            return (ka < kb) || (ka == kb && a < b);
+        }
+
+        // Nodes are numbered as in a binary heap, with leaves k..2k-1; returns the winner below node
+        uint32_t build(uint32_t node) {
+            if (node >= k) return node - k;
+            uint32_t l = build(2*node);
+            uint32_t r = build(2*node + 1);
+            if (beats(l, r)) {
+                tree[node] = r;
+                return l;
+            } else {
+                tree[node] = l;
+                return r;
+            }
+        }
+};
+
+template <typename Run, typename Sink>
+static void merge(const vector<Run*>& runs, Sink& sink) {
+    LoserTree<Run> lt(runs);
+    while (Run* r = lt.top()) {
+        sink(r->head());
+        r->pop();
+        lt.replay();
+    }
+}
+
+// Sorts recs in up to threads slices in parallel, then merges the slices into sink. tmp must hold as many records.
+template <typename Sink>
+static void sortBatch(vector<SortRecord>& recs, vector<SortRecord>& tmp, uint32_t threads, Sink& sink) {
+    size_t n = recs.size();
+    size_t slices = std::max(std::min((size_t)threads, n/MIN_SLICE_RECORDS), (size_t)1);
+    vector<std::thread> workers;
+    vector<MemRun*> runs;
+    for (size_t s = 0; s < slices; s++) {
+        size_t begin = n*s/slices;
+        size_t end = n*(s + 1)/slices;
+        workers.push_back(std::thread(radixSort, recs.data() + begin, tmp.data() + begin, end - begin));
+        runs.push_back(new MemRun(recs.data() + begin, recs.data() + end));
+    }
+    for (std::thread& w : workers) w.join();
+    merge(runs, sink);
+    for (MemRun* r : runs) delete r;
+}
+
+// Merges runs [first, last) of rf into sink, splitting the memory budget among their read buffers
+template <typename Sink>
+static void mergeRuns(const RunFile& rf, uint32_t first, uint32_t last, uint64_t budget, Sink& sink) {
+    size_t bufRecords = std::max(budget/((last - first)*sizeof(SortRecord)), MIN_MERGE_RECORDS);
+    vector<RunReader*> runs;
+    for (uint32_t r = first; r < last; r++) runs.push_back(new RunReader(rf, r, bufRecords));
+    merge(runs, sink);
+    for (RunReader* r : runs) delete r;
+}
+
+static void writeRecord(AccessTraceWriter* tw, const SortRecord& sr) {
+    AccessRecord acc = {sr.rec.lineAddr, sr.rec.reqCycle, sr.rec.latency, sr.rec.childId, (AccessType) sr.rec.type};
+    tw->write(acc);
+}
+
+static void usage(const char* prog) {
+    info("Sorts an access trace");
+    info("Usage: %s [options] <input_trace> <output_trace>", prog);
+    info("  -m <MB>   memory budget for sorting (default 1024)");
+    info("  -j <n>    threads to sort each batch with (default: number of cores)");
+    info("  -T <dir>  directory for temporary run files (default: the output trace's directory)");
+    exit(1);
+}
+
 int main(int argc, const char* argv[]) {
     InitLog(""); //no log header
-    if (argc != 3) {
-        info("Sorts an access trace");
-        info("Usage: %s <input_trace> <output_trace>", argv[0]);
-        exit(1);
+
+    uint64_t budgetMB = 1024;
+    uint32_t threads = sysconf(_SC_NPROCESSORS_ONLN);
+    const char* tmpDir = nullptr;
+    const char* inFile = nullptr;
+    const char* outFile = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasVal = i + 1 < argc;
+        if (arg == "-m" && hasVal) {
+            budgetMB = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "-j" && hasVal) {
+            threads = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "-T" && hasVal) {
+            tmpDir = argv[++i];
+        } else if (arg[0] != '-' && !inFile) {
+            inFile = argv[i];
+        } else if (arg[0] != '-' && !outFile) {
+            outFile = argv[i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (!outFile || !budgetMB || !threads) usage(argv[0]);
+
+    string tmpPrefix;
+    if (tmpDir) {
+        tmpPrefix = tmpDir;
+    } else {
+        string out = outFile;
+        size_t sep = out.rfind('/');
+        tmpPrefix = (sep == string::npos)? "." : out.substr(0, sep);
     }
+    tmpPrefix += "/sorttrace-";
 
     gm_init(32<<20 /*32 MB --- should be enough*/);
 
-    AccessTraceReader* tr = new AccessTraceReader(argv[1]);
+    AccessTraceReader* tr = new AccessTraceReader(inFile, true /*prefetch*/);
     uint32_t numChildren = tr->getNumChildren();
-    AccessTraceWriter* tw = new AccessTraceWriter(argv[2], numChildren);
-
-    deque<AccessRecord>* accs[numChildren];  // null if the child has no accesses
-    for (uint32_t i = 0; i < numChildren; i++) accs[i] = nullptr;
-    priority_queue< pair<int64_t, uint32_t> > heads; //(negative cycle, child); we use negative cycles because priority_queue sorts from largest to smallest
-    uint64_t readRecords  = 0;
-    uint64_t writtenRecords  = 0;
-    uint64_t totalRecords  = tr->getNumRecords();
-    info("Sorting %ld records", totalRecords);
-
-    while (!tr->empty() || heads.size() > 0) {
-        if (!tr->empty() && heads.size() < numChildren) { //Read trace until all heads are filled
-            for (uint32_t i = 0; i < 1024; i++) { //For performance, read at least a few accesses
-                AccessRecord acc = tr->read();
-                readRecords++;
-                if ((readRecords % 1024) == 0) printProgress(readRecords, writtenRecords, totalRecords);
-                if (!accs[acc.childId]) {
-                    accs[acc.childId] = new deque<AccessRecord>();
-                    heads.push(make_pair(-acc.reqCycle, acc.childId));
-                }
-                accs[acc.childId]->push_back(acc);
-                if (tr->empty()) break;
-            }
+    uint64_t totalRecords = tr->getNumRecords();
+    AccessTraceWriter* tw = new AccessTraceWriter(outFile, numChildren);
+
+    // A batch being sorted needs its records plus as many for radix sort scratch
+    uint64_t budget = budgetMB << 20;
+    uint64_t batchRecords = budget/(2*sizeof(SortRecord));
+    uint32_t maxFanIn = std::max(budget/(MIN_MERGE_RECORDS*sizeof(SortRecord)), (uint64_t)2);
+    info("Sorting %ld records, %ld-record runs, %d threads, merging up to %d runs at once", totalRecords, batchRecords, threads, maxFanIn);
+
+    vector<uint64_t> childCycles(numChildren, 0); //largest cycle issued so far
+    auto readBatch = [&](vector<SortRecord>& recs) {
+        recs.clear();
+        recs.reserve(std::min(batchRecords, totalRecords));
+        while (recs.size() < batchRecords && !tr->empty()) {
+            const PackedAccessRecord* pr = tr->readPacked();
+            assert(pr->childId < numChildren);
+            uint64_t& cc = childCycles[pr->childId];
+            if (pr->reqCycle > cc) cc = pr->reqCycle;
+            SortRecord sr = {cc, *pr};
+            recs.push_back(sr);
         }
+    };
 
-        assert(heads.size() <= numChildren);
-
-        while (heads.size() == numChildren || (tr->empty() && heads.size() > 0)) {
-            pair<int64_t, uint32_t> next = heads.top();
-            //info("pre %ld %d %ld", heads.size(), next.second, next.first);
-            heads.pop();
-            //info("post %ld %d %ld", heads.size(), heads.top().second, heads.top().first);
-            uint32_t child = next.second;
-            assert(!accs[child]->empty());
-            AccessRecord acc = accs[child]->front();
-            accs[child]->pop_front();
-            tw->write(acc);
-            writtenRecords++;
-            if ((writtenRecords % 1024) == 0) printProgress(readRecords, writtenRecords, totalRecords);
-            if (accs[child]->empty()) {
-                delete accs[child];
-                accs[child] = nullptr;
-            } else {
-                AccessRecord acc = accs[child]->front();
-                heads.push(make_pair(-acc.reqCycle, acc.childId));
+    uint64_t writtenRecords = 0;
+    auto output = [&](const SortRecord& sr) {
+        writeRecord(tw, sr);
+        if ((++writtenRecords % PROGRESS_RECORDS) == 0) printProgress("Written", writtenRecords, totalRecords);
+    };
+
+    if (totalRecords <= batchRecords) {
+        // Fits in a single batch, no need to spill
+        vector<SortRecord> recs;
+        readBatch(recs);
+        vector<SortRecord> tmp(recs.size());
+        sortBatch(recs, tmp, threads, output);
+    } else {
+        // Sort and spill one run per batch
+        RunFile* runs = new RunFile(tmpPrefix);
+        uint64_t readRecords = 0;
+        auto spill = [&](const SortRecord& sr) {runs->write(sr);};
+        {
+            vector<SortRecord> recs;
+            vector<SortRecord> tmp;
+            while (!tr->empty()) {
+                readBatch(recs);
+                readRecords += recs.size();
+                tmp.resize(recs.size());
+                runs->startRun();
+                sortBatch(recs, tmp, threads, spill);
+                printProgress("Sorted runs", readRecords, totalRecords);
             }
+        } //releases the batch buffers before merging
+        printf("\n");
+        assert(readRecords == totalRecords);
+        runs->finish();
+
+        // Merge groups of consecutive runs (so ties still go to the earlier record) until one pass can merge them all
+        for (uint32_t pass = 1; runs->numRuns() > maxFanIn; pass++) {
+            uint32_t numRuns = runs->numRuns();
+            info("Merge pass %d: %d runs into %d", pass, numRuns, (numRuns + maxFanIn - 1)/maxFanIn);
+            RunFile* merged = new RunFile(tmpPrefix);
+            auto spillMerged = [&](const SortRecord& sr) {merged->write(sr);};
+            for (uint32_t first = 0; first < numRuns; first += maxFanIn) {
+                uint32_t last = std::min(first + maxFanIn, numRuns);
+                merged->startRun();
+                mergeRuns(*runs, first, last, budget, spillMerged);
+                printProgress("Merged runs", last, numRuns);
+            }
+            printf("\n");
+            merged->finish();
+            delete runs;
+            runs = merged;
         }
+
+        info("Merging %d runs", runs->numRuns());
+        mergeRuns(*runs, 0, runs->numRuns(), budget, output);
+        delete runs;
     }
-    printProgress(readRecords, writtenRecords, totalRecords);
+    printProgress("Written", writtenRecords, totalRecords);
     printf("\n");
-    assert(readRecords == writtenRecords);
-    assert(readRecords == totalRecords);
+    assert(writtenRecords == totalRecords);
 
     delete tr;
     tw->dump(false); //flushes it
     delete tw;
     return 0;
 }
-
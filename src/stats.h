@@ -29,6 +29,8 @@
  *
  * There are four basic types of stats:
  * - Counter: A plain single counter.
+ * - ShardedCounter: A counter split in per-requester, line-padded slots, for
+ *   objects updated by many simulation threads. Reads sum all slots.
  * - VectorCounter: A fixed-size vector of logically related counters. Each
  *   vector element may be unnamed or named (useful when enum-indexed vectors).
  * - Histogram: A GEMS-style histogram, intended to profile a distribution.
@@ -77,7 +79,9 @@
 #include <stdint.h>
 #include <string>
 #include "g_std/g_vector.h"
+#include "galloc.h"
 #include "log.h"
+#include "pad.h"
 
 class Stat : public GlobAlloc {
     protected:
@@ -215,6 +219,7 @@ class VectorStat : public Stat {
 class Counter : public ScalarStat {
     private:
         uint64_t _count;
+        friend class CompiledStats; //reads _count directly
 
     public:
         Counter() : ScalarStat(), _count(0) {}
@@ -249,9 +254,58 @@ class Counter : public ScalarStat {
         }
 };
 
+/* Counter for objects updated concurrently by many simulation threads (e.g.,
+ * shared cache banks). Each shard (normally the requesting core, srcId) gets
+ * its own cache line, so increments neither race nor bounce lines; get() sums
+ * the shards lazily, so backends see a plain scalar. Shard ids are masked to
+ * the (power-of-2) number of slots, so callers may pass any id.
+ */
+class ShardedCounter : public ScalarStat {
+    private:
+        struct Slot {
+            uint64_t count;
+            PAD_SZ(sizeof(uint64_t));
+        };
+
+        Slot* _slots;
+        uint32_t _mask;
+
+    public:
+        ShardedCounter() : ScalarStat(), _slots(nullptr), _mask(0) {}
+
+        void init(const char* name, const char* desc) {
+            init(name, desc, 1);
+        }
+
+        void init(const char* name, const char* desc, uint32_t shards) {
+            initStat(name, desc);
+            uint32_t numSlots = 1;
+            while (numSlots < shards) numSlots <<= 1;
+            _slots = gm_memalign<Slot>(CACHE_LINE_BYTES, numSlots);
+            for (uint32_t i = 0; i < numSlots; i++) _slots[i].count = 0;
+            _mask = numSlots - 1;
+        }
+
+        inline void inc(uint32_t shard, uint64_t delta) {
+            _slots[shard & _mask].count += delta;
+        }
+
+        inline void inc(uint32_t shard) {
+            _slots[shard & _mask].count++;
+        }
+
+        uint64_t get() const {
+            if (!_slots) return 0;
+            uint64_t sum = 0;
+            for (uint32_t i = 0; i <= _mask; i++) sum += _slots[i].count;
+            return sum;
+        }
+};
+
 class VectorCounter : public VectorStat {
     private:
         g_vector<uint64_t> _counters;
+        friend class CompiledStats; //copies _counters directly
 
     public:
         VectorCounter() : VectorStat() {}
@@ -306,6 +360,7 @@ class Histogram : public Stat {
 class ProxyStat : public ScalarStat {
     private:
         uint64_t* _statPtr;
+        friend class CompiledStats; //reads *_statPtr directly
 
     public:
         ProxyStat() : ScalarStat(), _statPtr(nullptr) {}
@@ -412,6 +467,42 @@ class HDF5Backend : public StatsBackend {
     public:
         HDF5Backend(const char* filename, AggregateStat* rootStat, size_t bytesPerWrite, bool skipVectors, bool sumRegularAggregates);
         virtual void dump(bool buffered);
+
+        /* Starts the thread that writes out the records of all HDF5 backends, and
+         * flushes their files every flushSecs. Call after creating all backends.
+         * Until then, and after stopWriter(), dumps write their records
+         * synchronously; they also do so if the writer's process dies.
+         */
+        static void startWriter(uint32_t flushSecs);
+
+        // Writes out pending records and closes the files; call from startWriter()'s process before it exits
+        static void stopWriter();
+};
+
+
+class DeltaBackendImpl;
+
+// Stores per-counter deltas in indexed column blocks; read with statsreader (see delta_stats.h)
+class DeltaBackend : public StatsBackend {
+    private:
+        DeltaBackendImpl* backend;
+
+    public:
+        DeltaBackend(const char* filename, AggregateStat* rootStat, uint32_t blockRecords, bool skipVectors);
+        virtual void dump(bool buffered);
+};
+
+
+class LiveStatsBackendImpl;
+
+// Publishes a few key aggregates to a shared-memory ring for zsimtop (see live_stats.h)
+class LiveStatsBackend : public StatsBackend {
+    private:
+        LiveStatsBackendImpl* backend;
+
+    public:
+        LiveStatsBackend(const char* shmName, AggregateStat* rootStat, const char* llcName, uint32_t numSlots);
+        virtual void dump(bool buffered);
 };
 
 #endif  // STATS_H_
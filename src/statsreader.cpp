@@ -0,0 +1,416 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Reads delta-encoded stats (see delta_stats.h) and exports the selected
+ * columns, optionally over a phase range, to CSV or HDF5. Blocks are decoded
+ * in parallel, a batch at a time, so memory use does not grow with the file.
+ */
+
+#include <fcntl.h>
+#include <hdf5.h>
+#include <regex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "delta_stats.h"
+#include "log.h"
+
+using namespace deltastats;
+
+class DeltaStatsFile {
+    private:
+        int fd;
+        uint64_t fileBytes;
+
+    public:
+        std::string filename;
+        uint32_t numCols;
+        uint32_t blockRecords;
+        std::vector<std::string> names;
+        std::vector<IndexEntry> index;
+
+        explicit DeltaStatsFile(const char* _filename) : filename(_filename) {
+            fd = open(_filename, O_RDONLY);
+            if (fd < 0) panic("Could not open %s", _filename);
+            struct stat st;
+            fstat(fd, &st);
+            fileBytes = st.st_size;
+
+            FileHeader fh;
+            uint64_t pos = 0;
+            readAt(pos, &fh, sizeof(fh));
+            if (memcmp(fh.magic, FILE_MAGIC, sizeof(fh.magic)) != 0) panic("%s is not a delta stats file", _filename);
+            numCols = fh.numCols;
+            blockRecords = fh.blockRecords;
+            pos += sizeof(fh);
+            for (uint32_t c = 0; c < numCols; c++) {
+                uint16_t len;
+                readAt(pos, &len, sizeof(len));
+                std::string name(len, ' ');
+                readAt(pos + sizeof(len), &name[0], len);
+                names.push_back(name);
+                pos += sizeof(len) + len;
+            }
+            loadIndex(pos);
+        }
+
+        ~DeltaStatsFile() {close(fd);}
+
+        void readAt(uint64_t pos, void* buf, size_t bytes) const {
+            ssize_t res = pread(fd, buf, bytes, pos);
+            if (res < 0 || (size_t)res != bytes) panic("%s: short read at offset %ld (truncated file?)", filename.c_str(), pos);
+        }
+
+        // Decodes the selected columns of block b into out (row-major, numRecords x cols.size())
+        void decodeBlock(uint32_t b, const std::vector<uint32_t>& cols, std::vector<uint64_t>& out) const {
+            char err[256];
+            if (!tryDecodeBlock(b, cols, out, err, sizeof(err))) panic("%s: %s", filename.c_str(), err);
+        }
+
+    private:
+        // Like decodeBlock, but returns false and describes the problem in err if the block is corrupt
+        bool tryDecodeBlock(uint32_t b, const std::vector<uint32_t>& cols, std::vector<uint64_t>& out, char* err, size_t errSize) const {
+            const IndexEntry& ie = index[b];
+            uint32_t n = ie.numRecords;
+            BlockHeader bh;
+            readAt(ie.offset, &bh, sizeof(bh));
+            if (bh.magic != BLOCK_MAGIC) {
+                snprintf(err, errSize, "bad block header at offset %ld", ie.offset);
+                return false;
+            }
+            std::vector<uint32_t> offsets(numCols + 1);
+            uint64_t payloadStart = ie.offset + sizeof(BlockHeader) + offsets.size()*sizeof(uint32_t);
+            readAt(ie.offset + sizeof(BlockHeader), &offsets[0], offsets.size()*sizeof(uint32_t));
+
+            // Column offsets index into the payload; check them before trusting them
+            for (uint32_t c = 0; c < numCols; c++) {
+                if (offsets[c] > offsets[c+1]) {
+                    snprintf(err, errSize, "corrupt block %d, column %d ends at %d, before it starts at %d", b, c, offsets[c+1], offsets[c]);
+                    return false;
+                }
+            }
+            if (offsets[numCols] > bh.payloadBytes) {
+                snprintf(err, errSize, "corrupt block %d, columns take %d bytes, but the payload only has %ld", b, offsets[numCols], bh.payloadBytes);
+                return false;
+            }
+
+            // With few columns selected, read just those; otherwise, read the whole payload at once
+            bool sparse = cols.size()*8 < numCols;
+            std::vector<uint8_t> payload;
+            if (!sparse) {
+                payload.resize(offsets[numCols]);
+                readAt(payloadStart, &payload[0], payload.size());
+            }
+
+            out.resize((uint64_t)n*cols.size());
+            std::vector<uint8_t> colBuf;
+            std::vector<uint64_t> vals(n);
+            for (uint32_t i = 0; i < cols.size(); i++) {
+                uint32_t c = cols[i];
+                const uint8_t* start;
+                const uint8_t* end;
+                if (sparse) {
+                    colBuf.resize(offsets[c+1] - offsets[c]);
+                    readAt(payloadStart + offsets[c], &colBuf[0], colBuf.size());
+                    start = &colBuf[0];
+                    end = start + colBuf.size();
+                } else {
+                    start = &payload[offsets[c]];
+                    end = &payload[0] + offsets[c+1];
+                }
+                if (!decodeColumn(start, end, n, &vals[0])) {
+                    snprintf(err, errSize, "corrupt column %d in block %d", c, b);
+                    return false;
+                }
+                for (uint32_t r = 0; r < n; r++) out[(uint64_t)r*cols.size() + i] = vals[r];
+            }
+            return true;
+        }
+
+        // Uses the .idx file if it covers the whole file, otherwise rebuilds the index by walking the blocks
+        void loadIndex(uint64_t dataStart) {
+            std::string idxName = filename + ".idx";
+            FILE* f = fopen(idxName.c_str(), "rb");
+            if (f) {
+                IndexEntry ie;
+                while (fread(&ie, sizeof(ie), 1, f) == 1) index.push_back(ie);
+                fclose(f);
+                uint64_t expected = dataStart;
+                bool ok = true;
+                for (const IndexEntry& e : index) {
+                    if (e.offset != expected) {
+                        ok = false;
+                        break;
+                    }
+                    BlockHeader bh;
+                    readAt(e.offset, &bh, sizeof(bh));
+                    expected += sizeof(bh) + (numCols + 1)*sizeof(uint32_t) + bh.payloadBytes;
+                }
+                if (ok && expected == fileBytes) return;
+                warn("%s does not match %s, rebuilding the index", idxName.c_str(), filename.c_str());
+                index.clear();
+            }
+
+            uint64_t pos = dataStart;
+            uint64_t records = 0;
+            std::vector<uint64_t> phases;
+            std::vector<uint32_t> phaseCol(1, 0);
+            while (pos + sizeof(BlockHeader) <= fileBytes) {
+                BlockHeader bh;
+                readAt(pos, &bh, sizeof(bh));
+                uint64_t blockBytes = sizeof(bh) + (numCols + 1)*sizeof(uint32_t) + bh.payloadBytes;
+                if (bh.magic != BLOCK_MAGIC || pos + blockBytes > fileBytes) {
+                    warn("%s: ignoring truncated block at offset %ld", filename.c_str(), pos);
+                    break;
+                }
+                IndexEntry ie = {0, 0, pos, records, bh.numRecords, 0};
+                index.push_back(ie);
+                char err[256];
+                if (!bh.numRecords || !tryDecodeBlock(index.size() - 1, phaseCol, phases, err, sizeof(err))) {
+                    //Typically a block half-written when the simulation died; everything before it is fine
+                    warn("%s: ignoring blocks from offset %ld on (%s)", filename.c_str(), pos, bh.numRecords? err : "empty block");
+                    index.pop_back();
+                    break;
+                }
+                index.back().firstPhase = phases.front();
+                index.back().lastPhase = phases.back();
+                records += bh.numRecords;
+                pos += blockBytes;
+            }
+        }
+};
+
+class Exporter {
+    public:
+        virtual ~Exporter() {}
+        virtual void write(const std::vector<uint64_t>& rows, uint64_t numRows) = 0;
+};
+
+class CSVExporter : public Exporter {
+    private:
+        FILE* out;
+        uint32_t numCols;
+
+    public:
+        CSVExporter(const char* filename, const std::vector<std::string>& colNames) : numCols(colNames.size()) {
+            out = filename? fopen(filename, "w") : stdout;
+            if (!out) panic("Could not open %s", filename);
+            for (uint32_t i = 0; i < numCols; i++) fprintf(out, "%s%s", i? "," : "", colNames[i].c_str());
+            fprintf(out, "\n");
+        }
+
+        ~CSVExporter() {
+            if (out != stdout) fclose(out);
+        }
+
+        void write(const std::vector<uint64_t>& rows, uint64_t numRows) {
+            for (uint64_t r = 0; r < numRows; r++) {
+                for (uint32_t i = 0; i < numCols; i++) fprintf(out, "%s%lu", i? "," : "", rows[r*numCols + i]);
+                fprintf(out, "\n");
+            }
+        }
+};
+
+// Writes a "columns" dataset with the names and a numRows x numCols "stats" dataset
+class HDF5Exporter : public Exporter {
+    private:
+        hid_t fileID;
+        hid_t datasetID;
+        uint32_t numCols;
+        uint64_t writtenRows;
+
+    public:
+        HDF5Exporter(const char* filename, const std::vector<std::string>& colNames) : numCols(colNames.size()), writtenRows(0) {
+            fileID = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+            if (fileID < 0) panic("Could not create %s", filename);
+
+            size_t maxLen = 1;
+            for (const std::string& n : colNames) maxLen = std::max(maxLen, n.size());
+            std::vector<char> nameBuf(maxLen*numCols, 0);
+            for (uint32_t i = 0; i < numCols; i++) memcpy(&nameBuf[i*maxLen], colNames[i].c_str(), colNames[i].size());
+            hid_t strType = H5Tcopy(H5T_C_S1);
+            H5Tset_size(strType, maxLen);
+            hsize_t nameDims[] = {numCols};
+            hid_t nameSpace = H5Screate_simple(1, nameDims, nullptr);
+            hid_t namesID = H5Dcreate2(fileID, "columns", strType, nameSpace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+            H5Dwrite(namesID, strType, H5S_ALL, H5S_ALL, H5P_DEFAULT, &nameBuf[0]);
+            H5Dclose(namesID);
+            H5Sclose(nameSpace);
+            H5Tclose(strType);
+
+            hsize_t dims[] = {0, numCols};
+            hsize_t maxDims[] = {H5S_UNLIMITED, numCols};
+            hsize_t chunkDims[] = {1024, numCols};
+            hid_t space = H5Screate_simple(2, dims, maxDims);
+            hid_t props = H5Pcreate(H5P_DATASET_CREATE);
+            H5Pset_chunk(props, 2, chunkDims);
+            H5Pset_shuffle(props);
+            H5Pset_deflate(props, 6);
+            datasetID = H5Dcreate2(fileID, "stats", H5T_NATIVE_ULONG, space, H5P_DEFAULT, props, H5P_DEFAULT);
+            H5Pclose(props);
+            H5Sclose(space);
+        }
+
+        ~HDF5Exporter() {
+            H5Dclose(datasetID);
+            H5Fclose(fileID);
+        }
+
+        void write(const std::vector<uint64_t>& rows, uint64_t numRows) {
+            if (!numRows) return;
+            hsize_t newDims[] = {writtenRows + numRows, numCols};
+            H5Dset_extent(datasetID, newDims);
+            hid_t fileSpace = H5Dget_space(datasetID);
+            hsize_t start[] = {writtenRows, 0};
+            hsize_t count[] = {numRows, numCols};
+            H5Sselect_hyperslab(fileSpace, H5S_SELECT_SET, start, nullptr, count, nullptr);
+            hid_t memSpace = H5Screate_simple(2, count, nullptr);
+            H5Dwrite(datasetID, H5T_NATIVE_ULONG, memSpace, fileSpace, H5P_DEFAULT, &rows[0]);
+            H5Sclose(memSpace);
+            H5Sclose(fileSpace);
+            writtenRows += numRows;
+        }
+};
+
+static void usage(const char* prog) {
+    info("Exports delta-encoded zsim stats");
+    info("Usage: %s [options] <stats file>", prog);
+    info("  -l               list columns and blocks, then exit");
+    info("  -c <regex>       select columns whose name matches (can be repeated; default: all)");
+    info("  -p <first>:<last> only records dumped in this phase range (inclusive, either side optional)");
+    info("  -f csv|hdf5      output format (default: csv)");
+    info("  -o <file>        output file (default: stdout, csv only)");
+    info("  -j <threads>     decoding threads (default: number of cores)");
+    exit(1);
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog(""); //no log header
+
+    bool list = false;
+    std::vector<std::regex> colRegexes;
+    uint64_t firstPhase = 0;
+    uint64_t lastPhase = (uint64_t)-1L;
+    bool hdf5 = false;
+    const char* outFile = nullptr;
+    uint32_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+    const char* inFile = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasVal = i + 1 < argc;
+        if (arg == "-l") {
+            list = true;
+        } else if (arg == "-c" && hasVal) {
+            colRegexes.push_back(std::regex(argv[++i]));
+        } else if (arg == "-p" && hasVal) {
+            std::string range = argv[++i];
+            size_t sep = range.find(':');
+            if (sep == std::string::npos) usage(argv[0]);
+            if (sep > 0) firstPhase = strtoul(range.substr(0, sep).c_str(), nullptr, 10);
+            if (sep + 1 < range.size()) lastPhase = strtoul(range.substr(sep + 1).c_str(), nullptr, 10);
+        } else if (arg == "-f" && hasVal) {
+            std::string fmt = argv[++i];
+            if (fmt == "hdf5") hdf5 = true;
+            else if (fmt != "csv") usage(argv[0]);
+        } else if (arg == "-o" && hasVal) {
+            outFile = argv[++i];
+        } else if (arg == "-j" && hasVal) {
+            numThreads = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        } else if (arg[0] != '-' && !inFile) {
+            inFile = argv[i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (!inFile) usage(argv[0]);
+    if (hdf5 && !outFile) panic("HDF5 output needs an output file (-o)");
+
+    DeltaStatsFile df(inFile);
+
+    if (list) {
+        uint64_t records = 0;
+        for (const IndexEntry& ie : df.index) records += ie.numRecords;
+        info("%s: %d columns, %ld blocks, %ld records", inFile, df.numCols, df.index.size(), records);
+        for (const std::string& n : df.names) printf("%s\n", n.c_str());
+        return 0;
+    }
+
+    std::vector<uint32_t> cols;
+    cols.push_back(0); //phase always goes first
+    for (uint32_t c = 1; c < df.numCols; c++) {
+        bool match = colRegexes.empty();
+        for (const std::regex& re : colRegexes) match = match || std::regex_search(df.names[c], re);
+        if (match) cols.push_back(c);
+    }
+    if (cols.size() == 1) panic("No columns match");
+    std::vector<std::string> colNames;
+    for (uint32_t c : cols) colNames.push_back(df.names[c]);
+
+    std::vector<uint32_t> blocks;
+    for (uint32_t b = 0; b < df.index.size(); b++) {
+        if (df.index[b].lastPhase >= firstPhase && df.index[b].firstPhase <= lastPhase) blocks.push_back(b);
+    }
+
+    Exporter* exp = hdf5? (Exporter*) new HDF5Exporter(outFile, colNames) : (Exporter*) new CSVExporter(outFile, colNames);
+
+    // Decode a batch of blocks in parallel, then write it out in order
+    uint32_t batchBlocks = numThreads*8;
+    std::vector<std::vector<uint64_t> > decoded(batchBlocks);
+    std::vector<uint64_t> rows;
+    uint64_t totalRows = 0;
+    for (uint32_t first = 0; first < blocks.size(); first += batchBlocks) {
+        uint32_t batch = std::min(batchBlocks, (uint32_t)blocks.size() - first);
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < std::min(numThreads, batch); t++) {
+            threads.push_back(std::thread([&, t]() {
+                for (uint32_t i = t; i < batch; i += numThreads) df.decodeBlock(blocks[first + i], cols, decoded[i]);
+            }));
+        }
+        for (std::thread& th : threads) th.join();
+
+        rows.clear();
+        uint64_t numRows = 0;
+        for (uint32_t i = 0; i < batch; i++) {
+            const std::vector<uint64_t>& d = decoded[i];
+            for (uint64_t r = 0; r < d.size(); r += cols.size()) {
+                uint64_t phase = d[r];
+                if (phase < firstPhase || phase > lastPhase) continue;
+                rows.insert(rows.end(), d.begin() + r, d.begin() + r + cols.size());
+                numRows++;
+            }
+        }
+        exp->write(rows, numRows);
+        totalRows += numRows;
+    }
+    delete exp;
+
+    if (outFile) info("Wrote %ld records x %ld columns to %s", totalRows, cols.size(), outFile);
+    return 0;
+}
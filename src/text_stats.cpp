@@ -25,37 +25,56 @@
 
 #include <fstream>
 #include <iostream>
+#include "compiled_stats.h"
+#include "g_std/g_string.h"
+#include "g_std/g_vector.h"
 #include "galloc.h"
 #include "log.h"
 #include "stats.h"
+#include "str.h"
 #include "zsim.h"
 
 using std::endl;
 
+/* Stats are laid out once, at construction: each output line is a fixed
+ * head (indentation, name) and tail (description), plus, for counters, the
+ * index of their value in the compiled record. Dumps just fill the record
+ * and stitch the lines.
+ */
 class TextBackendImpl : public GlobAlloc {
     private:
+        struct Line {
+            g_string head;
+            int64_t valIdx; //-1 if the line has no value
+            g_string tail;
+        };
+
         const char* filename;
         AggregateStat* rootStat;
+        CompiledStats* flatStats;
+        uint64_t* record;
+        g_vector<Line> lines;
+
+        void addLine(const g_string& head, int64_t valIdx, const g_string& tail) {
+            Line l = {head, valIdx, tail};
+            lines.push_back(l);
+        }
 
-        void dumpStat(Stat* s, uint32_t level, std::ofstream* out) {
-            for (uint32_t i = 0; i < level; i++) *out << " ";
-            *out << s->name() << ": ";
+        void layoutStat(Stat* s, uint32_t level, uint32_t& valIdx) {
+            g_string indent(level, ' ');
+            g_string head = indent + s->name() + ": ";
             if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
-                *out << "# " << as->desc() << endl;
+                addLine(head + "# " + as->desc(), -1, "");
                 for (uint32_t i = 0; i < as->size(); i++) {
-                    dumpStat(as->get(i), level+1, out);
+                    layoutStat(as->get(i), level+1, valIdx);
                 }
             } else if (ScalarStat* ss = dynamic_cast<ScalarStat*>(s)) {
-                *out << ss->get() << " # " << ss->desc() << endl;
+                addLine(head, valIdx++, g_string(" # ") + ss->desc());
             } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
-                *out << "# " << vs->desc() << endl;
+                addLine(head + "# " + vs->desc(), -1, "");
                 for (uint32_t i = 0; i < vs->size(); i++) {
-                    for (uint32_t j = 0; j < level+1; j++) *out << " ";
-                    if (vs->hasCounterNames()) {
-                        *out << vs->counterName(i) << ": " << vs->count(i) << endl;
-                    } else {
-                        *out << i << ": " << vs->count(i) << endl;
-                    }
+                    g_string elemName = vs->hasCounterNames()? g_string(vs->counterName(i)) : g_string(Str(i).c_str());
+                    addLine(indent + " " + elemName + ": ", valIdx++, "");
                 }
             } else {
                 panic("Unrecognized stat type");
@@ -66,14 +85,25 @@ class TextBackendImpl : public GlobAlloc {
         TextBackendImpl(const char* _filename, AggregateStat* _rootStat) :
             filename(_filename), rootStat(_rootStat)
         {
+            flatStats = new CompiledStats(rootStat, false, false);
+            record = gm_calloc<uint64_t>(flatStats->size());
+            uint32_t valIdx = 0;
+            layoutStat(rootStat, 0, valIdx);
+            assert(valIdx == flatStats->size());
+
             std::ofstream out(filename, std::ios_base::out);
             out << "# zsim stats" << endl;
             out << "===" << endl;
         }
 
         void dump(bool buffered) {
+            flatStats->dump(record);
             std::ofstream out(filename, std::ios_base::app);
-            dumpStat(rootStat, 0, &out);
+            for (const Line& l : lines) {
+                out << l.head;
+                if (l.valIdx >= 0) out << record[l.valIdx];
+                out << l.tail << '\n';
+            }
             out << "===" << endl;
         }
 };
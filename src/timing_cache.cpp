@@ -24,6 +24,7 @@
  */
 
 #include "timing_cache.h"
+#include "contention_sim.h"
 #include "event_recorder.h"
 #include "timing_event.h"
 #include "zsim.h"
@@ -113,6 +114,8 @@ void TimingCache::initStats(AggregateStat* parentStat) {
 // TODO(dsm): This is copied verbatim from Cache. We should split Cache into different methods, then call those.
 uint64_t TimingCache::access(MemReq& req) {
     EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
+    //Recording may be off during low-contention phases (see ContentionSim::adaptContention()); do a plain bound-phase access
+    if (!evRec && zinfo->contentionSim->isSkippingRecording()) return Cache::access(req);
     assert_msg(evRec, "TimingCache is not connected to TimingCore");
 
     TimingRecord writebackRecord, accessRecord;
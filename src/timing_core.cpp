@@ -34,7 +34,8 @@ TimingCore::TimingCore(FilterCache* _l1i, FilterCache* _l1d, uint32_t _domain, g
     : Core(_name), l1i(_l1i), l1d(_l1d), instrs(0), curCycle(0), cRec(_domain, _name) {}
 
 uint64_t TimingCore::getPhaseCycles() const {
-    return curCycle % zinfo->phaseLength;
+    //Phase lengths may change from phase to phase, so this can't be curCycle % phaseLength
+    return (curCycle > zinfo->globPhaseCycles)? curCycle - zinfo->globPhaseCycles : 0;
 }
 
 void TimingCore::initStats(AggregateStat* parentStat) {
@@ -55,6 +56,8 @@ void TimingCore::initStats(AggregateStat* parentStat) {
     instrsStat->init("instrs", "Simulated instructions", &instrs);
     coreStat->append(instrsStat);
 
+    cRec.getEventRecorder()->initStats(coreStat);
+
     parentStat->append(coreStat);
 }
 
@@ -119,10 +122,10 @@ void TimingCore::BblAndRecordFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInf
     core->bblAndRecord(bblAddr, bblInfo);
 
     while (core->curCycle > core->phaseEndCycle) {
-        core->phaseEndCycle += zinfo->phaseLength;
         uint32_t cid = getCid(tid);
         uint32_t newCid = TakeBarrier(tid, cid);
         if (newCid != cid) break; /*context-switch*/
+        core->phaseEndCycle = zinfo->globPhaseCycles + zinfo->phaseLength; //set after the barrier, the phase length may have changed
     }
 }
 
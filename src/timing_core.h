@@ -64,6 +64,7 @@ class TimingCore : public Core {
         inline EventRecorder* getEventRecorder() {return cRec.getEventRecorder();}
         void cSimStart() {curCycle = cRec.cSimStart(curCycle);}
         void cSimEnd() {curCycle = cRec.cSimEnd(curCycle);}
+        uint64_t getContentionCycles() const {return cRec.getContentionCycles();}
 
     private:
         inline void loadAndRecord(Address addr);
@@ -91,6 +91,7 @@ CrossingEvent::CrossingEvent(TimingEvent* parent, TimingEvent* child, uint64_t _
     assert(parent->domain != child->domain);
     parentEv = parent;
     evRec = _evRec;
+    evRec->countCrossing();
     srcDomain = parent->domain;
     assert(srcDomain >= 0);
     simCount = 0;
@@ -151,9 +152,7 @@ void CrossingEvent::simulate(uint64_t simCycle) {
         if (!called) { //have to check again, AFTER reading the cycles! Otherwise, we have a race
             zinfo->contentionSim->setPrio(domain, (nextCycle == simCycle)? 1 : 2);
 
-#if PROFILE_CROSSINGS
             simCount++;
-#endif
             numParents = 0; //HACK
             requeue(nextCycle);
             return;
@@ -164,9 +163,7 @@ void CrossingEvent::simulate(uint64_t simCycle) {
     //assert_msg(simCycle <= doneCycle+preSlack+postSlack+1, "simCycle %ld doneCycle %ld, preSlack %d postSlack %d simCount %ld child %s", simCycle, doneCycle, preSlack, postSlack, simCount, typeid(*child).name());
     zinfo->contentionSim->setPrio(domain, 0);
 
-#if PROFILE_CROSSINGS
     zinfo->contentionSim->profileCrossing(srcDomain, domain, simCount);
-#endif
 
     uint64_t dCycle = MAX(simCycle, doneCycle);
     //info("Crossing %d->%d done %ld", srcDomain, domain, dCycle);
@@ -60,37 +60,48 @@ struct TimingEventBlock {
         void* operator new (size_t);
 };
 
-enum EventState {EV_INVALID, EV_NONE, EV_QUEUED, EV_RUNNING, EV_HELD, EV_DONE};
+enum EventState : uint8_t {EV_INVALID, EV_NONE, EV_QUEUED, EV_RUNNING, EV_HELD, EV_DONE};
 
 class CrossingEvent;
 
+/* The base event is laid out to fit a 64-byte cache line (with the vtable
+ * pointer): small fields are packed into 16 bytes, and the first two children
+ * are stored inline, so only events with 3+ children allocate
+ * TimingEventBlocks.
+ */
 class TimingEvent {
-    private:
-        uint64_t privCycle; //only touched by ContentionSim
-
     public:
         TimingEvent* next; //used by PrioQueue --- PRIVATE
 
     private:
-        EventState state;
+        // Until the event is queued, the latest done cycle of its parents;
+        // once queued, the cycle it is queued for (set by ContentionSim, read by PrioQueue)
         uint64_t cycle;
 
         uint64_t minStartCycle;
+
+        TimingEvent* child; //first child
         union {
-            TimingEvent* child;
-            TimingEventBlock* children;
+            TimingEvent* child2; //second child, if numChildren == 2
+            TimingEventBlock* children; //children 2..numChildren, if numChildren > 2
         };
-        int32_t domain; //-1 if none; if none, it acquires it from the parent. Cannot be a starting event (no parents at enqueue time) and get -1 as domain
-        uint32_t numChildren;
-        uint32_t numParents;
+
+        EventState state;
+        int16_t domain; //-1 if none; if none, it acquires it from the parent. Cannot be a starting event (no parents at enqueue time) and get -1 as domain
+        uint16_t numChildren;
+        uint16_t numParents;
         uint32_t preDelay;
         uint32_t postDelay; //we could get by with one delay, but pre/post makes it easier to code
 
     public:
-        TimingEvent(uint32_t _preDelay, uint32_t _postDelay, int32_t _domain = -1) : next(nullptr), state(EV_NONE), cycle(0), minStartCycle(-1L), child(nullptr),
-                    domain(_domain), numChildren(0), numParents(0), preDelay(_preDelay), postDelay(_postDelay) {}
-        explicit TimingEvent(int32_t _domain = -1) : next(nullptr), state(EV_NONE), minStartCycle(-1L), child(nullptr),
-                    domain(_domain), numChildren(0), numParents(0), preDelay(0), postDelay(0) {} //no delegating constructors until gcc 4.7...
+        TimingEvent(uint32_t _preDelay, uint32_t _postDelay, int32_t _domain = -1) : next(nullptr), cycle(0), minStartCycle(-1L), child(nullptr), child2(nullptr),
+                    state(EV_NONE), domain(_domain), numChildren(0), numParents(0), preDelay(_preDelay), postDelay(_postDelay) {
+            assert(_domain == domain);
+        }
+        explicit TimingEvent(int32_t _domain = -1) : next(nullptr), cycle(0), minStartCycle(-1L), child(nullptr), child2(nullptr),
+                    state(EV_NONE), domain(_domain), numChildren(0), numParents(0), preDelay(0), postDelay(0) { //no delegating constructors until gcc 4.7...
+            assert(_domain == domain);
+        }
 
         inline uint32_t getDomain() const {return domain;}
         inline uint32_t getNumChildren() const {return numChildren;}
@@ -108,26 +119,27 @@ class TimingEvent {
             assert(childEv->state == EV_NONE);
 
             TimingEvent* res = childEv;
+            assert(numChildren < UINT16_MAX && childEv->numParents < UINT16_MAX);
 
             if (numChildren == 0) {
-                numChildren = 1;
                 child = childEv;
             } else if (numChildren == 1) {
-                TimingEvent* firstChild = child;
+                child2 = childEv;
+            } else if (numChildren == 2) {
+                TimingEvent* secondChild = child2;
                 children = new (evRec) TimingEventBlock();
-                children->events[0] = firstChild;
+                children->events[0] = secondChild;
                 children->events[1] = childEv;
-                numChildren = 2;
             } else {
-                uint32_t idx = numChildren % TIMING_BLOCK_EVENTS;
+                uint32_t idx = (numChildren - 1) % TIMING_BLOCK_EVENTS;
                 if (idx == 0) {
                     TimingEventBlock* tmp = children;
                     children = new (evRec) TimingEventBlock();
                     children->next = tmp;
                 }
                 children->events[idx] = childEv;
-                numChildren++;
             }
+            numChildren++;
 
             if (domain != -1 && childEv->domain == -1) {
                 childEv->propagateDomain(domain);
@@ -229,11 +241,12 @@ class TimingEvent {
         inline void visitChildren(F f) {
             if (numChildren == 0) return;
             //info("visit %p nc %d", this, numChildren);
-            if (numChildren == 1) {
-                f(&child);
-            } else {
+            f(&child);
+            if (numChildren == 2) {
+                f(&child2);
+            } else if (numChildren > 2) {
                 TimingEventBlock* curBlock = children;
-                uint32_t visitedChildren = 0;
+                uint32_t visitedChildren = 1;
                 while (curBlock) {
                     for (uint32_t i = 0; i < TIMING_BLOCK_EVENTS; i++) {
                         //info("visit %p i %d %p", this, i, curBlock->events[i]);
@@ -255,7 +268,7 @@ class TimingEvent {
 
         void freeEvent() {
             // Free timing event blocks and ourselves
-            if (numChildren > 1) {
+            if (numChildren > 2) {
                 TimingEventBlock* teb = children;
                 while (teb) {
                     TimingEventBlock* next = teb->next;
@@ -280,6 +293,7 @@ class TimingEvent {
 
 
     friend class ContentionSim;
+    template <typename T, uint32_t B> friend class PrioQueue;
     friend class DelayEvent; //DelayEvent is, for now, the only child of TimingEvent that should do anything other than implement simulate
     friend class CrossingEvent;
 };
@@ -25,15 +25,75 @@
 
 #include <sstream>
 #include "trace_driver.h"
+#include "bithacks.h"
 #include "zsim.h"
 
-TraceDriver::TraceDriver(std::string filename, std::string retraceFilename, std::vector<TraceDriverProxyCache*>& proxies, bool _useSkews, bool _playPuts, bool _playAllGets)
-    : tr(filename), numChildren(proxies.size()), useSkews(_useSkews), playPuts(_playPuts), playAllGets(_playAllGets)
+//Children that run faster than traced have negative skews; don't let those wrap around cycle 0
+static inline uint64_t skewedCycle(uint64_t cycle, int64_t skew) {
+    return (skew < 0 && (uint64_t)(-skew) > cycle)? 0 : cycle + skew;
+}
+
+LineStateTable::LineStateTable(uint32_t initialSize) : used(0) {
+    assert(isPow2(initialSize));
+    Entry empty = {EMPTY, I};
+    entries.resize(initialSize, empty);
+}
+
+MESIState* LineStateTable::insert(Address lineAddr) {
+    assert(lineAddr != EMPTY);
+    while (true) {
+        for (uint32_t i = slot(lineAddr);; i = (i + 1) & (entries.size() - 1)) {
+            Entry& e = entries[i];
+            if (e.lineAddr == lineAddr) return &e.state;
+            if (e.lineAddr == EMPTY) {
+                if (2*(used + 1) > entries.size()) break; //keep the load factor at or below 1/2
+                e.lineAddr = lineAddr;
+                e.state = I;
+                used++;
+                return &e.state;
+            }
+        }
+        grow();
+    }
+}
+
+void LineStateTable::grow() {
+    std::vector<Entry> old;
+    old.swap(entries);
+    uint32_t live = 0;
+    for (const Entry& e : old) if (e.lineAddr != EMPTY && e.state != I) live++;
+
+    //Size for the live lines only; if most entries were I, we may not need to grow at all
+    uint32_t size = old.size();
+    while (size > 1024 && 8*live < size) size /= 2;
+    while (4*(live + 1) > size) size *= 2;
+
+    Entry empty = {EMPTY, I};
+    entries.resize(size, empty);
+    used = 0;
+    for (const Entry& e : old) {
+        if (e.lineAddr == EMPTY || e.state == I) continue;
+        uint32_t i = slot(e.lineAddr);
+        while (entries[i].lineAddr != EMPTY) i = (i + 1) & (entries.size() - 1);
+        entries[i] = e;
+        used++;
+    }
+}
+
+TraceDriver::TraceDriver(std::string filename, std::string retraceFilename, std::vector<TraceDriverProxyCache*>& proxies, bool _useSkews, bool _playPuts, bool _playAllGets, uint32_t _numThreads)
+    : tr(filename), numChildren(proxies.size()), useSkews(_useSkews), playPuts(_playPuts), playAllGets(_playAllGets), numThreads(_numThreads)
 {
     assert(numChildren > 0);
-    assert(!useSkews || numChildren == 1);
+    if (useSkews && numChildren > 1 && !numThreads) panic("Trace driver: useSkews with multiple children needs per-child replay (traceThreads > 0)");
     if (tr.getNumChildren() != numChildren) panic("Number of proxy caches (%d) does not match with streams in the trace file (%d)", numChildren, tr.getNumChildren());
     children = new ChildInfo[numChildren];
+    for (uint32_t c = 0; c < numChildren; c++) {
+        futex_init(&children[c].lock);
+        children[c].skew = 0;
+        children[c].lastReqCycle = 0;
+        children[c].hasNextAcc = false;
+        children[c].done = false;
+    }
     futex_init(&lock);
     lastAcc.childId = -1;
     parent = proxies[0]->getParent();
@@ -46,6 +106,21 @@ TraceDriver::TraceDriver(std::string filename, std::string retraceFilename, std:
     } else {
         atw = nullptr;
     }
+
+    //Per-child replay threads, each with a round-robin share of the children
+    numThreads = MIN(numThreads, numChildren);
+    threads = numThreads? new ReplayThread[numThreads] : nullptr;
+    for (uint32_t t = 0; t < numThreads; t++) {
+        futex_init(&threads[t].wakeLock);
+        futex_lock(&threads[t].wakeLock); //starts locked, so first actual call to lock blocks
+    }
+    for (uint32_t c = 0; c < numChildren && numThreads; c++) threads[c % numThreads].children.push_back(c);
+    futex_init(&demuxLock);
+    futex_init(&waitLock);
+    futex_lock(&waitLock); //wait lock must also start locked
+    threadTicket = 0;
+    threadsDone = 0;
+    phaseLimit = 0;
 }
 
 void TraceDriver::initStats(AggregateStat* parentStat) {
@@ -76,26 +151,48 @@ void TraceDriver::setParent(MemObject* _parent) {
 
 uint64_t TraceDriver::invalidate(uint32_t childId, Address lineAddr, InvType type, bool* reqWriteback, uint64_t reqCycle, uint32_t srcId) {
     assert(childId < numChildren);
-    std::unordered_map<Address, MESIState>& cStore = children[childId].cStore;
-    std::unordered_map<Address, MESIState>::iterator it = cStore.find(lineAddr);
-    assert((it != cStore.end()));
-    *reqWriteback = (it->second == M);
+    ChildInfo& child = children[childId];
+    futex_lock(&child.lock);
+    MESIState* state = child.cStore.find(lineAddr);
+    assert(state);
+    *reqWriteback = (*state == M);
     if (type == INVX) {
-        it->second = S;
-        children[childId].profInvx.inc();
+        *state = S;
+        child.profInvx.inc();
     } else {
-        cStore.erase(it);
+        *state = I;
         if (srcId == childId) {
-            children[childId].profSelfInv.inc();
+            child.profSelfInv.inc();
         } else {
-            children[childId].profCrossInv.inc();
+            child.profCrossInv.inc();
         }
     }
+    futex_unlock(&child.lock);
     return 0;
 }
 
 //Returns false if done, true otherwise
 bool TraceDriver::executePhase() {
+    if (!numThreads) return executePhaseMerged();
+
+    phaseLimit = zinfo->globPhaseCycles + zinfo->phaseLength;
+    __sync_synchronize();
+
+    //Wake up replay threads
+    for (uint32_t t = 0; t < numThreads; t++) {
+        futex_unlock(&threads[t].wakeLock);
+    }
+
+    //Sleep until phase is replayed
+    futex_lock_nospin(&waitLock);
+
+    for (uint32_t c = 0; c < numChildren; c++) {
+        if (!children[c].done) return true;
+    }
+    return false;
+}
+
+bool TraceDriver::executePhaseMerged() {
     uint64_t limit = zinfo->globPhaseCycles + zinfo->phaseLength;
 
     //Load valid access
@@ -103,7 +200,7 @@ bool TraceDriver::executePhase() {
     if (lastAcc.childId == (uint32_t)-1) {
         if (tr.empty()) return false;
         acc = tr.read();
-        if (useSkews) acc.reqCycle += children[acc.childId].skew;
+        if (useSkews) acc.reqCycle = skewedCycle(acc.reqCycle, children[acc.childId].skew);
     } else {
         acc = lastAcc;
         lastAcc.childId = (uint32_t)-1;
@@ -114,69 +211,147 @@ bool TraceDriver::executePhase() {
         executeAccess(acc);
         if (tr.empty()) return false;
         acc = tr.read();
-        if (useSkews) acc.reqCycle += children[acc.childId].skew;
+        if (useSkews) acc.reqCycle = skewedCycle(acc.reqCycle, children[acc.childId].skew);
     }
 
     lastAcc = acc; //save this access for the next phase
     return true;
 }
 
+void TraceDriver::ReplayThreadTrampoline(void* arg) {
+    TraceDriver* drv = static_cast<TraceDriver*>(arg);
+    uint32_t thid = __sync_fetch_and_add(&drv->threadTicket, 1);
+    drv->replayThreadLoop(thid);
+}
+
+void TraceDriver::replayThreadLoop(uint32_t thid) {
+    assert(thid < numThreads);
+    info("Started trace replay thread %d (%ld children)", thid, threads[thid].children.size());
+    while (true) {
+        futex_lock_nospin(&threads[thid].wakeLock);
+        for (uint32_t c : threads[thid].children) replayChild(c);
+
+        uint32_t val = __sync_add_and_fetch(&threadsDone, 1);
+        if (val == numThreads) {
+            threadsDone = 0;
+            futex_unlock(&waitLock); //unblock caller
+        }
+    }
+}
+
+//Replays the child's accesses up to the end of the phase
+void TraceDriver::replayChild(uint32_t childId) {
+    ChildInfo& child = children[childId];
+    while (!child.done) {
+        if (!child.hasNextAcc) {
+            if (!nextChildRecord(childId, child.nextAcc)) break; //none this phase, or done
+            if (useSkews) child.nextAcc.reqCycle = skewedCycle(child.nextAcc.reqCycle, child.skew);
+            child.hasNextAcc = true;
+        }
+        if (child.nextAcc.reqCycle >= phaseLimit) break;
+        executeAccess(child.nextAcc);
+        child.hasNextAcc = false;
+    }
+}
+
+/* Gets the child's next access, reading the trace (and queueing other children's
+ * accesses) if needed. Returns false if there is none, setting done if the
+ * trace is over. Demuxing stops at the phase horizon: once a record of another
+ * child would start past phaseLimit with this child's skew, so would the rest
+ * of this child's records (the trace is sorted by request cycle), so this
+ * child has no more records this phase. This keeps the pending queues from
+ * pulling the rest of the trace into memory when a child ends or has a gap.
+ */
+bool TraceDriver::nextChildRecord(uint32_t childId, AccessRecord& acc) {
+    ChildInfo& child = children[childId];
+    if (child.local.empty()) {
+        futex_lock(&demuxLock);
+        if (!child.pending.empty()) {
+            child.local.swap(child.pending);
+        } else {
+            int64_t skew = useSkews? child.skew : 0;
+            while (!tr.empty()) {
+                const PackedAccessRecord* pr = tr.readPacked();
+                assert(pr->childId < numChildren);
+                if (pr->childId == childId) {
+                    child.local.push_back(*pr);
+                    break;
+                }
+                children[pr->childId].pending.push_back(*pr);
+                if (skewedCycle(pr->reqCycle, skew) >= phaseLimit) break;
+            }
+            if (child.local.empty() && tr.empty()) child.done = true;
+        }
+        futex_unlock(&demuxLock);
+        if (child.local.empty()) return false;
+    }
+
+    const PackedAccessRecord& pr = child.local.front();
+    acc = {pr.lineAddr, pr.reqCycle, pr.latency, pr.childId, (AccessType) pr.type};
+    child.local.pop_front();
+    return true;
+}
+
 void TraceDriver::executeAccess(AccessRecord acc) {
     assert(acc.childId < numChildren);
-    std::unordered_map<Address, MESIState>& cStore = children[acc.childId].cStore;
+    ChildInfo& child = children[acc.childId];
+    LineStateTable& cStore = child.cStore;
+    futex_lock(&child.lock);
 
     int64_t lat = 0;
     switch (acc.type) {
         case PUTS:
         case PUTX:
             {
-                if (!playPuts) return;
-                std::unordered_map<Address, MESIState>::iterator it = cStore.find(acc.lineAddr);
-                if (it == cStore.end()) return; //we don't currently have this line, skip
-                MemReq req = {acc.lineAddr, acc.type, acc.childId, &it->second, acc.reqCycle, nullptr, it->second, acc.childId};
+                MESIState* state = playPuts? cStore.find(acc.lineAddr) : nullptr;
+                if (!state) { //not replaying PUTs, or we don't currently have this line, skip
+                    futex_unlock(&child.lock);
+                    return;
+                }
+                MemReq req = {acc.lineAddr, acc.type, acc.childId, state, acc.reqCycle, &child.lock, *state, acc.childId};
                 lat = parent->access(req) - acc.reqCycle; //note that PUT latency does not affect driver latency
-                assert(it->second == I);
-                cStore.erase(it);
+                assert(*state == I);
             }
             break;
         case GETS:
         case GETX:
             {
-                std::unordered_map<Address, MESIState>::iterator it = cStore.find(acc.lineAddr);
-                MESIState state = I;
-                if (it != cStore.end()) {
-                    if (!((it->second == S) && (acc.type == GETX))) { //we have the line, and it's not an upgrade miss, we can't replay this access directly
+                MESIState* state = cStore.insert(acc.lineAddr); //stays valid while the parent has us unlocked
+                if (*state != I) {
+                    if (!((*state == S) && (acc.type == GETX))) { //we have the line, and it's not an upgrade miss, we can't replay this access directly
                         if (playAllGets) { //issue a PUT
-                            MemReq req = {acc.lineAddr, (it->second == M)? PUTX : PUTS, acc.childId, &it->second, acc.reqCycle, nullptr, it->second, acc.childId};
+                            MemReq req = {acc.lineAddr, (*state == M)? PUTX : PUTS, acc.childId, state, acc.reqCycle, &child.lock, *state, acc.childId};
                             parent->access(req);
-                            assert(it->second == I);
+                            assert(*state == I);
                         } else {
+                            futex_unlock(&child.lock);
                             return; //skip
                         }
-                    } else {
-                        state = it->second;
                     }
                 }
-                MemReq req = {acc.lineAddr, acc.type, acc.childId, &state, acc.reqCycle, nullptr, state, acc.childId};
+                MemReq req = {acc.lineAddr, acc.type, acc.childId, state, acc.reqCycle, &child.lock, *state, acc.childId};
                 uint64_t respCycle = parent->access(req);
                 lat = respCycle - acc.reqCycle;
-                children[acc.childId].profLat.inc(lat);
-                children[acc.childId].skew += ((int64_t)lat - acc.latency);
-                assert(state != I);
-                cStore[acc.lineAddr] = state;
+                child.profLat.inc(lat);
+                child.skew += ((int64_t)lat - acc.latency);
+                assert(*state != I);
             }
             break;
         default:
             panic("Unknown access type %d, trace is probably corrupted", acc.type);
     }
 
-    children[acc.childId].lastReqCycle = acc.reqCycle;
+    futex_unlock(&child.lock);
+
+    child.lastReqCycle = acc.reqCycle;
     if (atw) {
         AccessRecord wAcc = acc;
         // We always want the outout trace to be skewed regardless... otherwise it does not make sense to produce an output trace
-        if (!useSkews) wAcc.reqCycle += children[acc.childId].skew;
+        if (!useSkews) wAcc.reqCycle = skewedCycle(wAcc.reqCycle, child.skew);
         wAcc.latency = lat;
+        futex_lock(&lock);
         atw->write(wAcc);
+        futex_unlock(&lock);
     }
 }
 
@@ -26,20 +26,76 @@
 #ifndef __TRACE_DRIVER_H__
 #define __TRACE_DRIVER_H__
 
-#include <unordered_map>
+#include <deque>
 #include <vector>
 #include "access_tracing.h"
 #include "g_std/g_string.h"
+#include "locks.h"
 #include "stats.h"
 
-/* Basic class for trace-driven simulation. Shares the cache interface (invalidate), but it is not a cache in any sense --- it just reads in a single trace and replays it */
+/* Line states of a trace driver child. Open addressing with linear probing:
+ * lookups touch one or two cache lines instead of chasing hash-bucket lists.
+ * Removing a line just sets it to I, and entries only move when the table
+ * grows (which drops the I ones), so a MESIState* stays valid until the next
+ * insert. This lets the parent update a child's state through MemReq::state
+ * while the child is unlocked, as with real caches.
+ */
+class LineStateTable {
+    private:
+        struct Entry {
+            Address lineAddr;
+            MESIState state;
+        };
+
+        std::vector<Entry> entries;
+        uint32_t used; //entries with a line, including I ones
+
+        static const Address EMPTY = (Address)-1L;
+
+        inline uint32_t slot(Address lineAddr) const {
+            return (uint32_t)((lineAddr * 0x9E3779B97F4A7C15ull) >> 32) & (entries.size() - 1);
+        }
+
+        void grow();
+
+    public:
+        explicit LineStateTable(uint32_t initialSize = 1024);
+
+        //Returns the line's state, or nullptr if the line is not here (or is I)
+        inline MESIState* find(Address lineAddr) {
+            for (uint32_t i = slot(lineAddr);; i = (i + 1) & (entries.size() - 1)) {
+                Entry& e = entries[i];
+                if (e.lineAddr == lineAddr) return (e.state == I)? nullptr : &e.state;
+                if (e.lineAddr == EMPTY) return nullptr;
+            }
+        }
 
+        //Returns the line's state, adding the line in I if it is not here. May move other lines.
+        MESIState* insert(Address lineAddr);
+};
+
+/* Basic class for trace-driven simulation. Shares the cache interface
+ * (invalidate), but it is not a cache in any sense --- it just reads in a
+ * single trace and replays it.
+ *
+ * With numThreads == 0, the trace is replayed in its (merged) order by the
+ * caller of executePhase. Otherwise, each child replays its own stream up to
+ * the end of the phase, on one of numThreads replay threads (children are
+ * spread round-robin), just like cores in the bound phase: accesses from
+ * different children race on the parent, which serializes them with its
+ * locks. Records are split into per-child queues as threads need them, up to
+ * the end of the phase. Since each child keeps its own clock, useSkews works
+ * with multiple children in this mode. The replay threads must be started by
+ * the caller (see ReplayThreadTrampoline), so that it can use its own
+ * threading library.
+ */
 class TraceDriverProxyCache;
 
 class TraceDriver {
     private:
         struct ChildInfo {
-            std::unordered_map<Address, MESIState> cStore; //holds current sets of lines for each child. Needs to support an arbitrary set, hence the hash table
+            LineStateTable cStore; //holds current sets of lines for each child. Needs to support an arbitrary set, hence the hash table
+            lock_t lock; //protects cStore against invalidations from other replay threads
             int64_t skew;
             uint64_t lastReqCycle;
             //Counter bypassedGETS;
@@ -48,13 +104,25 @@ class TraceDriver {
             Counter profSelfInv; //invalidations in response to our own access
             Counter profCrossInv; //invalidations in response to another access
             Counter profInvx;
+
+            //Per-child replay only
+            std::deque<PackedAccessRecord> pending; //split off the trace, not yet taken by the replay thread (protected by demuxLock)
+            std::deque<PackedAccessRecord> local; //owned by the replay thread
+            AccessRecord nextAcc; //acts as a 1-elem buffer across phases
+            bool hasNextAcc;
+            bool done;
+        };
+
+        struct ReplayThread {
+            lock_t wakeLock;
+            std::vector<uint32_t> children;
         };
 
         ChildInfo* children;
-        lock_t lock; //NOTE: not needed for now
+        lock_t lock; //serializes retrace writes
         AccessTraceReader tr;
         uint32_t numChildren;
-        bool useSkews; //If false, replays the trace using its request cycles. If true, it skews the simulated child. Can only be true with a single child.
+        bool useSkews; //If false, replays the trace using its request cycles. If true, it skews the simulated child. Can only be true with a single child, unless replaying per child.
         bool playPuts; //If true, issues PUTS/PUTX requests as they appear in the trace. If false, it just issues the GETS/X requests, leaving it up to the parent to decide when to evict something (NOTE: if the parent is running OPT, it knows better!)
         bool playAllGets; //If true, if we have a get to an address that we already have, issue a put immediately before.
         MemObject* parent;
@@ -64,8 +132,17 @@ class TraceDriver {
         //Last access, childId == -1 if invalid, acts as 1-elem buffer
         AccessRecord lastAcc;
 
+        //Per-child replay
+        uint32_t numThreads;
+        ReplayThread* threads;
+        lock_t demuxLock; //serializes reading the trace and pending queues
+        lock_t waitLock; //held while a phase is replayed
+        uint64_t phaseLimit;
+        volatile uint32_t threadTicket;
+        volatile uint32_t threadsDone;
+
     public:
-        TraceDriver(std::string filename, std::string retracefile, std::vector<TraceDriverProxyCache*>& proxies, bool _useSkews, bool _playPuts, bool _playAllGets);
+        TraceDriver(std::string filename, std::string retracefile, std::vector<TraceDriverProxyCache*>& proxies, bool _useSkews, bool _playPuts, bool _playAllGets, uint32_t _numThreads);
         void initStats(AggregateStat* parentStat);
         void setParent(MemObject* _parent);
 
@@ -74,8 +151,17 @@ class TraceDriver {
         //Returns false if done, true otherwise
         bool executePhase();
 
+        //Per-child replay: the caller must start getNumThreads() threads that run this, before the first executePhase()
+        uint32_t getNumThreads() const {return numThreads;}
+        static void ReplayThreadTrampoline(void* arg);
+
     private:
         inline void executeAccess(AccessRecord acc);
+
+        bool executePhaseMerged();
+        void replayThreadLoop(uint32_t thid);
+        void replayChild(uint32_t childId);
+        bool nextChildRecord(uint32_t childId, AccessRecord& acc);
 };
 
 
@@ -0,0 +1,238 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_FORMAT_H_
+#define TRACE_FORMAT_H_
+
+/* Compressed access trace format, written by AccessTraceWriter and read by
+ * AccessTraceReader (which also reads the older HDF5 traces).
+ *
+ * Records are stored in independently decodable blocks. Within a block, each
+ * child's accesses form a separate stream, so consecutive records of a stream
+ * come from the same core and have small address and cycle deltas:
+ *
+ * File: FileHeader, then blocks, then (once finished) the block index.
+ * Block: BlockHeader, then storedBytes of payload; if BLK_LZ is set, the
+ *   payload is lzCompress'd (lz_codec.h) and decompresses to rawBytes. The raw
+ *   payload is:
+ *     varint numStreams
+ *     numStreams x (varint childId, varint numRecords, NUM_FIELDS x varint
+ *       fieldBytes)
+ *     varint numRuns, numRuns x (varint stream, varint runLength)
+ *       -- the order records are interleaved in, run-length coded
+ *     the fields of each stream, stream by stream; each field holds
+ *     numRecords varints:
+ *       FIELD_ADDR:  zigzag lineAddr delta
+ *       FIELD_CYCLE: zigzag reqCycle delta
+ *       FIELD_LAT:   latency << 2 | type
+ *     Deltas are from the stream's previous record (from 0 for its first
+ *     record). Keeping fields apart leaves long repeated runs (e.g., sequential
+ *     addresses, fixed hit latencies) for the LZ pass to find.
+ * Index: numBlocks IndexEntries at indexOffset, so readers can seek to a
+ *   record without scanning the file.
+ *
+ * Flat traces use the same FileHeader (with FLAT_MAGIC, and no blocks or
+ * index), followed by numRecords PackedAccessRecords, so they can be mapped
+ * and read in place.
+ *
+ * All integers are in host (little-endian) order.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "access_tracing.h"
+#include "varint.h"
+
+namespace tracefmt {
+
+static const char FILE_MAGIC[8] = {'Z', 'S', 'T', 'R', 'A', 'C', 'E', '1'};
+static const char FLAT_MAGIC[8] = {'Z', 'S', 'R', 'A', 'W', 'T', 'R', '1'};
+static const uint32_t BLOCK_MAGIC = 0x4b4c4254; // "TBLK"
+static const uint32_t BLOCK_RECORDS = 64*1024;
+
+enum BlockFlags {BLK_LZ = 1};
+enum Field {FIELD_ADDR = 0, FIELD_CYCLE = 1, FIELD_LAT = 2, NUM_FIELDS = 3};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t numChildren;
+    uint32_t finished;
+    uint64_t numRecords;
+    uint64_t indexOffset; //0 until finished
+    uint32_t numBlocks;
+    uint32_t blockRecords;
+};
+
+struct BlockHeader {
+    uint32_t magic;
+    uint32_t numRecords;
+    uint32_t rawBytes;
+    uint32_t storedBytes;
+    uint32_t flags;
+    uint32_t pad;
+};
+
+struct IndexEntry {
+    uint64_t offset; //of the BlockHeader
+    uint64_t firstRecord;
+    uint64_t minCycle;
+    uint64_t maxCycle;
+    uint32_t numRecords;
+    uint32_t storedBytes;
+};
+
+// Appends the raw (uncompressed) payload for recs[0..n) to out
+static inline void encodeBlock(const PackedAccessRecord* recs, uint32_t n, std::vector<uint8_t>& out) {
+    struct Stream {
+        uint32_t childId;
+        uint32_t numRecords;
+        uint64_t lastAddr;
+        uint64_t lastCycle;
+        std::vector<uint8_t> fields[NUM_FIELDS];
+    };
+    std::vector<Stream> streams;
+    std::vector<uint32_t> childToStream;
+    std::vector<uint32_t> runs; //stream, length pairs
+
+    for (uint32_t i = 0; i < n; i++) {
+        const PackedAccessRecord& r = recs[i];
+        if (r.childId >= childToStream.size()) childToStream.resize(r.childId + 1, (uint32_t)-1);
+        uint32_t s = childToStream[r.childId];
+        if (s == (uint32_t)-1) {
+            s = childToStream[r.childId] = streams.size();
+            streams.push_back(Stream());
+            streams[s].childId = r.childId;
+            streams[s].numRecords = 0;
+            streams[s].lastAddr = 0;
+            streams[s].lastCycle = 0;
+        }
+        Stream& st = streams[s];
+        putVarint(zigzag((int64_t)(r.lineAddr - st.lastAddr)), st.fields[FIELD_ADDR]);
+        putVarint(zigzag((int64_t)(r.reqCycle - st.lastCycle)), st.fields[FIELD_CYCLE]);
+        putVarint(((uint64_t)r.latency << 2) | (r.type & 0x3), st.fields[FIELD_LAT]);
+        st.lastAddr = r.lineAddr;
+        st.lastCycle = r.reqCycle;
+        st.numRecords++;
+
+        if (runs.size() && runs[runs.size() - 2] == s) {
+            runs.back()++;
+        } else {
+            runs.push_back(s);
+            runs.push_back(1);
+        }
+    }
+
+    putVarint(streams.size(), out);
+    for (const Stream& st : streams) {
+        putVarint(st.childId, out);
+        putVarint(st.numRecords, out);
+        for (uint32_t f = 0; f < NUM_FIELDS; f++) putVarint(st.fields[f].size(), out);
+    }
+    putVarint(runs.size()/2, out);
+    for (uint32_t r : runs) putVarint(r, out);
+    for (const Stream& st : streams) {
+        for (uint32_t f = 0; f < NUM_FIELDS; f++) out.insert(out.end(), st.fields[f].begin(), st.fields[f].end());
+    }
+}
+
+// Decodes a raw payload into recs[0..n). Returns false on malformed input.
+static inline bool decodeBlock(const uint8_t* p, const uint8_t* end, uint32_t n, PackedAccessRecord* recs) {
+    struct Stream {
+        uint16_t childId;
+        uint64_t left;
+        uint64_t lastAddr;
+        uint64_t lastCycle;
+        const uint8_t* cur[NUM_FIELDS];
+        const uint8_t* end[NUM_FIELDS];
+    };
+
+    uint64_t numStreams;
+    if (!getVarint(p, end, numStreams) || numStreams > n) return false;
+    std::vector<Stream> streams(numStreams);
+    std::vector<uint64_t> fieldOffsets(numStreams*NUM_FIELDS + 1);
+    uint64_t totalBytes = 0;
+    uint64_t totalRecords = 0;
+    for (uint32_t s = 0; s < numStreams; s++) {
+        Stream& st = streams[s];
+        uint64_t childId;
+        if (!getVarint(p, end, childId) || !getVarint(p, end, st.left)) return false;
+        if (childId > UINT16_MAX) return false;
+        st.childId = childId;
+        st.lastAddr = 0;
+        st.lastCycle = 0;
+        totalRecords += st.left;
+        for (uint32_t f = 0; f < NUM_FIELDS; f++) {
+            uint64_t bytes;
+            if (!getVarint(p, end, bytes)) return false;
+            fieldOffsets[s*NUM_FIELDS + f] = totalBytes;
+            totalBytes += bytes;
+        }
+    }
+    if (totalRecords != n) return false;
+
+    uint64_t numRuns;
+    if (!getVarint(p, end, numRuns) || numRuns > n) return false;
+    std::vector<uint64_t> runs(numRuns*2);
+    for (uint64_t& r : runs) {
+        if (!getVarint(p, end, r)) return false;
+    }
+    if (totalBytes != (uint64_t)(end - p)) return false;
+    fieldOffsets[numStreams*NUM_FIELDS] = totalBytes;
+    for (uint32_t s = 0; s < numStreams; s++) {
+        for (uint32_t f = 0; f < NUM_FIELDS; f++) {
+            streams[s].cur[f] = p + fieldOffsets[s*NUM_FIELDS + f];
+            streams[s].end[f] = p + fieldOffsets[s*NUM_FIELDS + f + 1];
+        }
+    }
+
+    uint32_t i = 0;
+    for (uint64_t r = 0; r < numRuns; r++) {
+        uint64_t s = runs[2*r];
+        uint64_t len = runs[2*r + 1];
+        if (s >= numStreams || len > streams[s].left || len > n - i) return false;
+        Stream& st = streams[s];
+        st.left -= len;
+        for (uint64_t j = 0; j < len; j++) {
+            uint64_t zzAddr, zzCycle, latType;
+            if (!getVarint(st.cur[FIELD_ADDR], st.end[FIELD_ADDR], zzAddr) ||
+                !getVarint(st.cur[FIELD_CYCLE], st.end[FIELD_CYCLE], zzCycle) ||
+                !getVarint(st.cur[FIELD_LAT], st.end[FIELD_LAT], latType)) return false;
+            st.lastAddr += (uint64_t)unzigzag(zzAddr);
+            st.lastCycle += (uint64_t)unzigzag(zzCycle);
+            PackedAccessRecord& pr = recs[i++];
+            pr.lineAddr = st.lastAddr;
+            pr.reqCycle = st.lastCycle;
+            pr.latency = latType >> 2;
+            pr.childId = st.childId;
+            pr.type = latType & 0x3;
+        }
+    }
+    return i == n;
+}
+
+};  // namespace tracefmt
+
+#endif  // TRACE_FORMAT_H_
@@ -24,6 +24,7 @@
  */
 
 #include "utility_monitor.h"
+#include "bithacks.h"
 #include "hash.h"
 
 #define DEBUG_UMON 0
@@ -142,3 +143,105 @@ curMisses = 0;
                 }
 }
 
+
+// DuelingUMon
+
+DuelingUMon::DuelingUMon(uint32_t _bankLines, uint32_t _umonLines, uint32_t _buckets, uint32_t _points, uint32_t _maxSamplingShift, uint64_t _targetSamples) {
+    buckets = _buckets;
+    points = MIN(_points, buckets);
+    maxSamplingShift = _maxSamplingShift;
+    targetSamples = _targetSamples;
+    samplingShift = 0;
+
+    uint32_t sets = _umonLines/buckets;
+    groupSets = sets/points;
+    assert_msg(groupSets > 0 && isPow2(groupSets), "DuelingUMon: %d umon sets can't be split in %d leader groups of power-of-2 sets", sets, points);
+    groupSetsBits = ilog2(groupSets);
+
+    uint32_t samplingFactor = _bankLines/_umonLines;
+    assert_msg(isPow2(samplingFactor), "DuelingUMon: sampling factor %d must be a power of 2", samplingFactor);
+    samplingFactorBits = ilog2(samplingFactor);
+
+    groupWays = gm_calloc<uint32_t>(points);
+    groupTags = gm_calloc<Address*>(points);
+    for (uint32_t g = 0; g < points; g++) {
+        groupWays[g] = (g+1)*buckets/points;
+        assert(groupWays[g] > 0);
+        groupTags[g] = gm_calloc<Address>(groupSets*groupWays[g]);
+    }
+    groupAccesses = gm_calloc<uint64_t>(points);
+    groupMisses = gm_calloc<uint64_t>(points);
+    curAccesses = 0;
+
+    hf = new H3HashFamily(2, 32, 0xF000BAAD);
+}
+
+void DuelingUMon::access(Address lineAddr) {
+    //1. Hash to decide if it should be sampled
+    uint64_t sampleMask = ~(((uint64_t)-1LL) << (samplingFactorBits + samplingShift));
+    if ((hf->hash(0, lineAddr) & sampleMask) != 0) return;
+
+    //2. Find leader group & set
+    uint64_t h = hf->hash(1, lineAddr);
+    uint32_t set = h & (groupSets - 1);
+    uint32_t g = (h >> groupSetsBits) % points;
+    uint32_t ways = groupWays[g];
+    Address* tags = &groupTags[g][set*ways];
+
+    //3. Hit or miss? Either way, move to MRU
+    uint32_t pos = ways - 1;
+    for (uint32_t w = 0; w < ways; w++) {
+        if (tags[w] == lineAddr) {
+            pos = w;
+            break;
+        }
+    }
+    groupMisses[g] += (tags[pos] != lineAddr);
+    groupAccesses[g]++;
+    curAccesses++;
+    for (uint32_t w = pos; w > 0; w--) tags[w] = tags[w-1];
+    tags[0] = lineAddr;
+}
+
+uint64_t DuelingUMon::getNumAccesses() const {
+    return curAccesses << samplingShift;
+}
+
+void DuelingUMon::getMisses(uint64_t* misses) {
+    // Known points: (0, all accesses) and (groupWays[g], miss ratio of group g * accesses).
+    // Groups without samples repeat the previous point; interpolate linearly between points.
+    double total = curAccesses << samplingShift;
+    double prevMisses = total;
+    uint32_t prevWays = 0;
+    misses[0] = total;
+    for (uint32_t g = 0; g < points; g++) {
+        double m = groupAccesses[g]? total*groupMisses[g]/groupAccesses[g] : prevMisses;
+        m = MIN(m, prevMisses); //sparse samples may be slightly non-monotonic; curves must not be
+        uint32_t ways = groupWays[g];
+        for (uint32_t b = prevWays + 1; b <= ways; b++) {
+            double frac = ((double)(b - prevWays))/((double)(ways - prevWays));
+            misses[b] = (uint64_t)(prevMisses*(1-frac) + m*frac);
+        }
+        prevMisses = m;
+        prevWays = ways;
+    }
+    assert(prevWays == buckets);
+#if DEBUG_UMON
+    info("DuelingUMon miss utility curve (sampling shift %d):", samplingShift);
+    for (uint32_t i = 0; i <= buckets; i++) info(" misses[%d] = %ld", i, misses[i]);
+#endif
+}
+
+void DuelingUMon::startNextInterval() {
+    if (curAccesses > 2*targetSamples && samplingShift < maxSamplingShift) {
+        samplingShift++;
+    } else if (curAccesses < targetSamples/2 && samplingShift > 0) {
+        samplingShift--;
+    }
+
+    curAccesses = 0;
+    for (uint32_t g = 0; g < points; g++) {
+        groupAccesses[g] = 0;
+        groupMisses[g] = 0;
+    }
+}
@@ -77,5 +77,52 @@ class UMon : public GlobAlloc {
         uint32_t getBuckets() const { return buckets; }
 };
 
+/* Cheaper, hardware-style alternative to UMon. Instead of a full LRU stack
+ * per sampled set, sampled sets are split among a few leader groups (as in
+ * set dueling), each simulating a different allocation (1/points, 2/points,
+ * ..., all of the buckets). Each group only keeps a per-group hit/miss
+ * counter, so we get a sparse miss curve, which getMisses() interpolates.
+ * This needs about half the tags of UMon and, on average, half the tag checks
+ * per sampled access.
+ *
+ * The sampling ratio is adaptive: when a partition sees many more sampled
+ * accesses per interval than targetSamples, we sample half as many addresses
+ * (up to maxSamplingShift halvings), and double it back when it sees too few.
+ * Returned curves and accesses are scaled back, so they stay comparable
+ * across monitors with different sampling ratios.
+ */
+class DuelingUMon : public GlobAlloc {
+    private:
+        uint32_t buckets; //ways of the equivalent UMon
+        uint32_t points; //leader groups, one per simulated allocation
+        uint32_t groupSets; //sets per leader group. Should be power of 2.
+        uint32_t groupSetsBits;
+
+        uint32_t samplingFactorBits; //base sampling, as in UMon
+        uint32_t samplingShift; //extra sampling bits, adapted every interval
+        uint32_t maxSamplingShift;
+        uint64_t targetSamples;
+
+        uint32_t* groupWays;
+        Address** groupTags; //per group, groupSets x groupWays[g] tags, each set in MRU->LRU order
+        uint64_t* groupAccesses;
+        uint64_t* groupMisses;
+        uint64_t curAccesses; //sampled, all groups
+
+        HashFamily* hf;
+
+    public:
+        DuelingUMon(uint32_t _bankLines, uint32_t _umonLines, uint32_t _buckets, uint32_t _points, uint32_t _maxSamplingShift, uint64_t _targetSamples);
+
+        void access(Address lineAddr);
+
+        uint64_t getNumAccesses() const;
+        void getMisses(uint64_t* misses);
+        void startNextInterval();
+
+        uint32_t getBuckets() const { return buckets; }
+        uint32_t getSamplingShift() const { return samplingShift; }
+};
+
 #endif  // UTILITY_MONITOR_H_
 
@@ -0,0 +1,69 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VARINT_H_
+#define VARINT_H_
+
+/* LEB128-style variable-length integers, shared by the on-disk formats
+ * (delta-encoded stats, compressed access traces). Signed values go through
+ * zigzag first, so small negative deltas stay small.
+ */
+
+#include <stdint.h>
+#include <vector>
+
+static inline uint64_t zigzag(int64_t v) {return (((uint64_t)v) << 1) ^ (uint64_t)(v >> 63);}
+static inline int64_t unzigzag(uint64_t v) {return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);}
+
+static inline void putVarint(uint64_t v, std::vector<uint8_t>& out) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+static inline uint32_t varintSize(uint64_t v) {
+    uint32_t sz = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        sz++;
+    }
+    return sz;
+}
+
+// Returns false on truncated input
+static inline bool getVarint(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+    v = 0;
+    for (uint32_t shift = 0; shift < 64; shift += 7) {
+        if (p == end) return false;
+        uint8_t b = *(p++);
+        v |= ((uint64_t)(b & 0x7f)) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+#endif  // VARINT_H_
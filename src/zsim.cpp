@@ -49,8 +49,10 @@
 #include "debug_zsim.h"
 #include "event_queue.h"
 #include "galloc.h"
+#include "host_placement.h"
 #include "init.h"
 #include "log.h"
+#include "phase_controller.h"
 #include "pin.H"
 #include "pin_cmd.h"
 #include "process_tree.h"
@@ -122,12 +124,23 @@ static inline void clearCid(uint32_t tid) {
     cores[tid] = nullptr;
 }
 
+//Host cpu set slot (+1) each thread is pinned to, 0 if unpinned; only re-pin when this changes
+static uint32_t pinnedSlots[MAX_THREADS];
+
 static inline void setCid(uint32_t tid, uint32_t cid) {
     assert(tid < MAX_THREADS);
     assert(cids[tid] == INVALID_CID);
     assert(cid < zinfo->numCores);
     cids[tid] = cid;
     cores[tid] = zinfo->cores[cid];
+
+    if (unlikely(zinfo->hostPlacement != nullptr) && zinfo->hostPlacement->pinsThreads()) {
+        uint32_t slot = zinfo->hostPlacement->getCoreSlot(cid) + 1;
+        if (slot != pinnedSlots[tid]) {
+            zinfo->hostPlacement->pinCoreThread(cid);
+            pinnedSlots[tid] = slot;
+        }
+    }
 }
 
 uint32_t getCid(uint32_t tid) {
@@ -302,7 +315,7 @@ VOID FFITrackNFFInterval() {
         *_ffiPrevFFStartInstrs = *_ffiFFStartInstrs;
         *_ffiFFStartInstrs = zinfo->processStats->getProcessInstrs(p);
     };
-    zinfo->eventQueue->insert(makeAdaptiveEvent(ffiGet, ffiFire, 0, ffiInstrsLimit - ffiInstrsDone, MAX_IPC*zinfo->phaseLength));
+    zinfo->eventQueue->insert(makeAdaptiveEvent(ffiGet, ffiFire, 0, ffiInstrsLimit - ffiInstrsDone, MAX_IPC*zinfo->maxPhaseLength));
 
     ffiNFF = true;
 }
@@ -733,6 +746,7 @@ VOID EndOfPhaseActions() {
 
     zinfo->contentionSim->simulatePhase(zinfo->globPhaseCycles + zinfo->phaseLength);
     zinfo->eventQueue->tick();
+    if (zinfo->phaseController) zinfo->nextPhaseLength = zinfo->phaseController->endPhase(zinfo->phaseLength);
     zinfo->profSimTime->transition(PROF_BOUND);
 }
 
@@ -1353,6 +1367,11 @@ VOID SimEnd() {
             info("All other processes done, terminating");
         }
 
+        zinfo->eventQueue->finish(); //pending async events (e.g., stats writes) must land before the final dump
+        HDF5Backend::stopWriter(); //closes the stats files; the final dump writes its records synchronously
+
+        if (zinfo->hostPlacement) zinfo->hostPlacement->sampleSegmentPages();
+
         info("Dumping termination stats");
         zinfo->trigger = 20000;
         for (StatsBackend* backend : *(zinfo->statsBackends)) backend->dump(false /*unbuffered, write out*/);
@@ -1850,11 +1869,15 @@ int main(int argc, char *argv[]) {
     // Start trace-driven or exec-driven sim
     if (zinfo->traceDriven) {
         info("Running trace-driven simulation");
+        for (uint32_t i = 0; i < zinfo->traceDriver->getNumThreads(); i++) {
+            PIN_SpawnInternalThread(TraceDriver::ReplayThreadTrampoline, zinfo->traceDriver, 1024*1024, nullptr);
+        }
         while (!zinfo->terminationConditionMet && zinfo->traceDriver->executePhase()) {
             // info("Phase done");
             EndOfPhaseActions();
             zinfo->numPhases++;
             zinfo->globPhaseCycles += zinfo->phaseLength;
+            zinfo->phaseLength = zinfo->nextPhaseLength;
         }
         info("Finished trace-driven simulation");
         SimEnd();
@@ -43,11 +43,14 @@ class Core;
 class Scheduler;
 class AggregateStat;
 class StatsBackend;
+class HDF5Writer;
 class ProcessTreeNode;
 class ProcessStats;
 class ProcStats;
 class EventQueue;
 class ContentionSim;
+class PhaseController;
+class HostPlacement;
 class EventRecorder;
 class PinCmd;
 class PortVirtualizer;
@@ -55,6 +58,7 @@ class VectorCounter;
 class AccessTraceWriter;
 class TraceDriver;
 template <typename T> class g_vector;
+namespace slab { class SlabDepot; }
 
 struct ClockDomainInfo {
     uint64_t realtimeOffsetNs;
@@ -179,12 +183,17 @@ struct GlobSimInfo {
     //Contention simulation
     uint32_t numDomains;
     ContentionSim* contentionSim;
+    slab::SlabDepot* slabDepot; //global pool of free timing event slabs
+    PhaseController* phaseController; //nullptr unless phase length is adaptive
+    HostPlacement* hostPlacement; //nullptr unless host thread pinning or memory placement is on
     EventRecorder** eventRecorders; //CID->EventRecorder* array
 
     PAD();
 
     //World-readable
-    uint32_t phaseLength;
+    uint32_t phaseLength; //length of the current phase; may only change between phases (see PhaseController)
+    uint32_t nextPhaseLength; //length of the next phase, applied when the current one ends
+    uint32_t maxPhaseLength; //upper bound on phaseLength
     uint32_t statsPhaseInterval;
     uint32_t freqMHz;
 
@@ -225,9 +234,11 @@ struct GlobSimInfo {
     const char* outputDir; //all the output files mst be dumped here. Stored because complex workloads often change dir, then spawn...
 
     AggregateStat* rootStat;
+    const char* llcName; //name of the LLC cache group, whose stats are under rootStat
     g_vector<StatsBackend*>* statsBackends; // used for termination dumps
     StatsBackend* periodicStatsBackend;
     StatsBackend* eventualStatsBackend;
+    HDF5Writer* statsWriter; //nullptr until the first HDF5 backend is created
     ProcessStats* processStats;
     ProcStats* procStats;
 
@@ -0,0 +1,289 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Monitors running simulations through their live stats (see live_stats.h).
+ * Without arguments, prints one line per simulation publishing live stats on
+ * this machine; with a simulation name or harness pid, shows its per-core
+ * stats. Rates are computed over the last two published records.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include "live_stats.h"
+#include "log.h"
+
+using namespace livestats;
+
+static uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return 1000000000L*ts.tv_sec + ts.tv_nsec;
+}
+
+class LiveSim {
+    private:
+        const ShmHeader* hdr;
+        size_t bytes;
+        std::vector<uint64_t> buf[2];
+
+    public:
+        std::string name;
+        RecordHeader* cur; //latest record
+        RecordHeader* prev; //the one before, or nullptr if there is just one
+
+        explicit LiveSim(const std::string& _name) : hdr(nullptr), bytes(0), name(_name), cur(nullptr), prev(nullptr) {}
+
+        ~LiveSim() {
+            if (hdr) munmap((void*)hdr, bytes);
+        }
+
+        // Returns false if the object does not exist or is not a (compatible) live stats object
+        bool open() {
+            int fd = shm_open(name.c_str(), O_RDONLY, 0);
+            if (fd < 0) return false;
+            struct stat st;
+            if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ShmHeader)) {
+                close(fd);
+                return false;
+            }
+            bytes = st.st_size;
+            void* p = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (p == MAP_FAILED) return false;
+            hdr = static_cast<const ShmHeader*>(p);
+            if (!validHeader(hdr) || bytes < shmBytes(hdr->numCores, hdr->numSlots)) {
+                if (memcmp(hdr->magic, SHM_MAGIC, 6) == 0) {
+                    warn("%s: unsupported live stats version %d (expected %d)", name.c_str(), hdr->version, SCHEMA_VERSION);
+                }
+                return false;
+            }
+            buf[0].resize(hdr->slotBytes/sizeof(uint64_t));
+            buf[1].resize(hdr->slotBytes/sizeof(uint64_t));
+            return true;
+        }
+
+        const ShmHeader* header() const {return hdr;}
+
+        // Reads the latest two records; returns false if there are none (yet)
+        bool update() {
+            for (uint32_t retries = 0; retries < 100; retries++) {
+                uint64_t published = hdr->published;
+                if (!published) return false;
+                if (!readRecord(hdr, published - 1, &buf[0][0])) continue; //overwritten while reading, retry
+                cur = reinterpret_cast<RecordHeader*>(&buf[0][0]);
+                prev = (published > 1 && readRecord(hdr, published - 2, &buf[1][0]))? reinterpret_cast<RecordHeader*>(&buf[1][0]) : nullptr;
+                return true;
+            }
+            return false;
+        }
+
+        bool alive() const {
+            return hdr->state == SIM_RUNNING && (kill(hdr->pid, 0) == 0 || errno != ESRCH);
+        }
+
+        const char* stateName() const {
+            if (hdr->state == SIM_FINISHED) return "done";
+            return alive()? "run" : "dead";
+        }
+
+        // Deltas over the last interval (or since the start, with a single record)
+        uint64_t dInstrs(uint32_t c) const {return slotInstrs(cur, hdr->numCores)[c] - (prev? slotInstrs(prev, hdr->numCores)[c] : 0);}
+        uint64_t dCycles(uint32_t c) const {return slotCycles(cur)[c] - (prev? slotCycles(prev)[c] : 0);}
+
+        uint64_t dTotalInstrs() const {
+            uint64_t res = 0;
+            for (uint32_t c = 0; c < hdr->numCores; c++) res += dInstrs(c);
+            return res;
+        }
+
+        double ipc() const { //average over cores that ran
+            double sum = 0.0;
+            uint32_t active = 0;
+            for (uint32_t c = 0; c < hdr->numCores; c++) {
+                if (dCycles(c)) {
+                    sum += ((double)dInstrs(c))/dCycles(c);
+                    active++;
+                }
+            }
+            return active? sum/active : 0.0;
+        }
+
+        double mpki() const {
+            uint64_t instrs = dTotalInstrs();
+            uint64_t misses = cur->llcMisses - (prev? prev->llcMisses : 0);
+            return instrs? 1000.0*misses/instrs : 0.0;
+        }
+
+        double phaseRate() const {
+            uint64_t dPhases = cur->phase - (prev? prev->phase : 0);
+            uint64_t dNs = cur->wallNs - (prev? prev->wallNs : hdr->startNs);
+            return dNs? 1e9*dPhases/dNs : 0.0;
+        }
+
+        double boundFrac() const {
+            uint64_t dBound = cur->boundNs - (prev? prev->boundNs : 0);
+            uint64_t dWeave = cur->weaveNs - (prev? prev->weaveNs : 0);
+            return (dBound + dWeave)? ((double)dBound)/(dBound + dWeave) : 0.0;
+        }
+
+        double staleSecs() const {
+            uint64_t now = nowNs();
+            return (now > cur->wallNs)? (now - cur->wallNs)/1e9 : 0.0;
+        }
+};
+
+static std::vector<std::string> findSims() {
+    std::vector<std::string> res;
+    const char* prefix = SHM_PREFIX + 1; //object names start with /, /dev/shm entries don't
+    DIR* dir = opendir("/dev/shm");
+    if (!dir) panic("Could not open /dev/shm: %s", strerror(errno));
+    while (struct dirent* de = readdir(dir)) {
+        if (strncmp(de->d_name, prefix, strlen(prefix)) == 0) res.push_back(std::string("/") + de->d_name);
+    }
+    closedir(dir);
+    return res;
+}
+
+static void printList(bool removeDead) {
+    std::vector<std::string> names = findSims();
+    printf("%-20s %8s %5s %12s %9s %6s %7s %12s %6s %8s  %s\n",
+            "name", "pid", "state", "phase", "phases/s", "ipc", "llcMPKI", "ftmMisses", "bound", "stale(s)", "outputDir");
+    for (const std::string& n : names) {
+        LiveSim sim(n);
+        if (!sim.open()) continue;
+        const ShmHeader* hdr = sim.header();
+        if (!sim.update()) {
+            printf("%-20s %8d %5s (no records yet)\n", n.c_str(), hdr->pid, sim.stateName());
+        } else {
+            printf("%-20s %8d %5s %12ld %9.1f %6.2f %7.2f %12ld %5.1f%% %8.1f  %s\n",
+                    n.c_str(), hdr->pid, sim.stateName(), sim.cur->phase, sim.phaseRate(), sim.ipc(), sim.mpki(),
+                    sim.cur->ftmMisses, 100.0*sim.boundFrac(), sim.staleSecs(), hdr->outputDir);
+        }
+        if (removeDead && !sim.alive() && hdr->state == SIM_RUNNING) {
+            if (shm_unlink(n.c_str()) == 0) {
+                info("Removed %s (harness %d is gone)", n.c_str(), hdr->pid);
+            } else {
+                warn("Could not remove %s: %s", n.c_str(), strerror(errno));
+            }
+        }
+    }
+}
+
+static void printSim(LiveSim& sim) {
+    const ShmHeader* hdr = sim.header();
+    printf("%s  pid %d  %s  %s\n", sim.name.c_str(), hdr->pid, sim.stateName(), hdr->outputDir);
+    if (!sim.cur) {
+        printf("(no records yet)\n");
+        return;
+    }
+    uint64_t elapsedNs = sim.cur->wallNs - hdr->startNs;
+    printf("phase %ld  %.1f phases/s  elapsed %.1fs  stale %.1fs  bound/weave %.1f%%/%.1f%%\n",
+            sim.cur->phase, sim.phaseRate(), elapsedNs/1e9, sim.staleSecs(), 100.0*sim.boundFrac(), 100.0*(1.0 - sim.boundFrac()));
+    printf("ipc %.2f  llcMPKI %.2f  llcMisses %ld  ftmMisses %ld (+%ld)\n\n", sim.ipc(), sim.mpki(), sim.cur->llcMisses,
+            sim.cur->ftmMisses, sim.cur->ftmMisses - (sim.prev? sim.prev->ftmMisses : 0));
+    printf("%6s %6s %16s %16s\n", "core", "ipc", "instrs", "cycles");
+    for (uint32_t c = 0; c < hdr->numCores; c++) {
+        uint64_t dc = sim.dCycles(c);
+        printf("%6d %6.2f %16ld %16ld\n", c, dc? ((double)sim.dInstrs(c))/dc : 0.0,
+                slotInstrs(sim.cur, hdr->numCores)[c], slotCycles(sim.cur)[c]);
+    }
+}
+
+static void usage(const char* prog) {
+    info("Monitors running zsim simulations that publish live stats (sim.liveStatsInterval > 0)");
+    info("Usage: %s [options] [<name or harness pid>]", prog);
+    info("  (no name)        list all simulations on this machine");
+    info("  -i <secs>        refresh interval (default: 1)");
+    info("  -n <count>       number of refreshes, 0 for unlimited (default: 0; 1 with no name)");
+    info("  -b               batch mode: don't clear the screen between refreshes");
+    info("  -r               remove objects left behind by dead simulations (list mode)");
+    exit(1);
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog(""); //no log header
+
+    double interval = 1.0;
+    int64_t count = -1;
+    bool batch = false;
+    bool removeDead = false;
+    const char* simArg = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasVal = i + 1 < argc;
+        if (arg == "-i" && hasVal) {
+            interval = atof(argv[++i]);
+            if (interval <= 0.0) usage(argv[0]);
+        } else if (arg == "-n" && hasVal) {
+            count = strtol(argv[++i], nullptr, 10);
+        } else if (arg == "-b") {
+            batch = true;
+        } else if (arg == "-r") {
+            removeDead = true;
+        } else if (arg[0] != '-' && !simArg) {
+            simArg = argv[i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (count < 0) count = simArg? 0 : 1;
+
+    LiveSim* sim = nullptr;
+    if (simArg) {
+        std::string name = simArg;
+        if (name.find_first_not_of("0123456789") == std::string::npos) name = SHM_PREFIX + name;
+        else if (name[0] != '/') name = "/" + name;
+        sim = new LiveSim(name);
+        if (!sim->open()) panic("%s is not a live stats object (is the simulation running with sim.liveStatsInterval > 0?)", name.c_str());
+    }
+
+    for (int64_t iter = 0; count == 0 || iter < count; iter++) {
+        if (iter) usleep((useconds_t)(interval*1e6));
+        if (!batch && (count != 1)) printf("\033[H\033[2J");
+        if (sim) {
+            sim->update();
+            printSim(*sim);
+            if (!sim->alive()) break; //no more records will come
+        } else {
+            printList(removeDead && iter == 0);
+        }
+        if (batch) printf("\n");
+        fflush(stdout);
+    }
+
+    delete sim;
+    return 0;
+}